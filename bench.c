@@ -0,0 +1,507 @@
+#include "logic.h"
+#include "output_dev.h"
+#include "virt_ds4.h"
+#include "virt_ds5.h"
+#include "dev_iio.h"
+#include "input_map.h"
+#include "queue.h"
+#include "latency.h"
+
+#include <dirent.h>
+#include <limits.h>
+
+/*
+ * rogue-enemy-bench: in-process microbenchmarks of the decode and report-encode hot paths,
+ * built with -DROGUE_ENEMY_BENCH (cmake -DROGUE_ENEMY_BENCH=ON, then make bench).
+ *
+ * No hardware is needed: the uhid writes are left out of the measure and the IIO devices are
+ * sysfs-like fixture directories created for the run, the buffered one reading its scans from a file. Allocations are counted by linking with
+ * --wrap=malloc,--wrap=calloc,--wrap=realloc: only the calls made by the daemon code are seen.
+ *
+ * Usage: rogue-enemy-bench [<substring of the benchmark names to run>]
+ */
+
+#define BENCH_CALIBRATION_NS    (10ULL * 1000000ULL)
+#define BENCH_RUN_NS            (50ULL * 1000000ULL)
+#define BENCH_RUNS              7
+
+typedef struct bench_case {
+    const char *name;
+    void (*run)(uint64_t iterations);
+} bench_case_t;
+
+static atomic_uint_fast64_t allocations = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    return __real_realloc(ptr, size);
+}
+
+static logic_t bench_logic;
+static output_dev_t bench_out_dev = {
+    .gamepad_fd = -1,
+    .imu_fd = -1,
+    .mouse_fd = -1,
+    .logic = &bench_logic,
+};
+
+static queue_t bench_queue;
+static dev_iio_t *bench_iio = NULL;
+static dev_iio_t *bench_iio_buffered = NULL;
+static char bench_iio_dir[] = "/tmp/rogue-enemy-bench-XXXXXX";
+
+// sticks and a face button, as the gamepad evdev device reports them
+static struct input_event buttons_frame[] = {
+    { .type = EV_ABS, .code = ABS_X, .value = 1200 },
+    { .type = EV_ABS, .code = ABS_Y, .value = -3400 },
+    { .type = EV_ABS, .code = ABS_RX, .value = 560 },
+    { .type = EV_KEY, .code = BTN_SOUTH, .value = 1 },
+    { .type = EV_SYN, .code = SYN_REPORT, .value = 0 },
+};
+
+// the AC key of the RC71L keyboard device: MSC_SCAN + key, resolved by input_map_find_chord
+static struct input_event chord_frame[] = {
+    { .type = EV_MSC, .code = MSC_SCAN, .value = -13565896 },
+    { .type = EV_KEY, .code = KEY_PROG1, .value = 0 },
+};
+
+static message_t ev_message(struct input_event *const frame, size_t count) {
+    return (message_t) {
+        .type = MSG_TYPE_EV,
+        .data = {
+            .event = {
+                .ev = frame,
+                .ev_flags = 0,
+                .ev_count = (uint32_t)count,
+                .ev_size = count,
+            },
+        },
+    };
+}
+
+static void bench_input_map_apply(uint64_t iterations) {
+    message_t msg = ev_message(buttons_frame, sizeof(buttons_frame) / sizeof(buttons_frame[0]));
+    gamepad_status_t gs;
+    memset(&gs, 0, sizeof(gs));
+
+    for (uint64_t i = 0; i < iterations; ++i) {
+        buttons_frame[3].value = (int32_t)(i & 1);
+        input_map_apply(&bench_out_dev.input_map, &gs, &msg.data.event);
+    }
+}
+
+static void bench_decode_ev_buttons(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        message_t msg = ev_message(buttons_frame, sizeof(buttons_frame) / sizeof(buttons_frame[0]));
+        output_dev_bench_decode_ev(&bench_out_dev, &msg);
+    }
+}
+
+static void bench_decode_ev_chord(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        chord_frame[1].value = (int32_t)(i & 1);
+        message_t msg = ev_message(chord_frame, sizeof(chord_frame) / sizeof(chord_frame[0]));
+        output_dev_bench_decode_ev(&bench_out_dev, &msg);
+    }
+}
+
+static void bench_decode_hidraw(uint64_t iterations) {
+    message_t msg = {
+        .type = MSG_TYPE_HIDRAW,
+    };
+    msg.data.hidraw.data_size = HIDRAW_DATA_SIZE;
+    memset(msg.data.hidraw.data, 0, sizeof(msg.data.hidraw.data));
+
+    gamepad_status_t gs;
+    memset(&gs, 0, sizeof(gs));
+
+    for (uint64_t i = 0; i < iterations; ++i) {
+        // back buttons and legion buttons alternate between pressed and released
+        msg.data.hidraw.data[18] = (i & 1) ? 0xC0 : 0x00;
+        msg.data.hidraw.data[20] = (i & 1) ? 0xED : 0x00;
+        gs.flags = 0;
+        decode_hidraw_to_gamepad(&gs, &msg);
+    }
+}
+
+static void bench_ds4_report(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        virt_ds4_bench_send_data(&bench_logic);
+    }
+}
+
+static void bench_ds5_report(uint64_t iterations) {
+    for (uint64_t i = 0; i < iterations; ++i) {
+        virt_ds5_bench_send_data(&bench_logic);
+    }
+}
+
+static void bench_iio_read_imu(uint64_t iterations) {
+    imu_message_t imu;
+
+    for (uint64_t i = 0; i < iterations; ++i) {
+        dev_iio_read_imu(bench_iio, &imu);
+    }
+}
+
+static void bench_iio_read_imu_buffered(uint64_t iterations) {
+    imu_message_t imu;
+
+    for (uint64_t i = 0; i < iterations; ++i) {
+        // the fixture holds a single read() worth of scans: rewind it once they have all been returned
+        if (dev_iio_buffered_pending(bench_iio_buffered) == 0) {
+            lseek(dev_iio_get_buffer_fd(bench_iio_buffered), 0, SEEK_SET);
+        }
+
+        dev_iio_read_imu(bench_iio_buffered, &imu);
+    }
+}
+
+static void bench_queue_try_push_pop(uint64_t iterations) {
+    void *item = NULL;
+
+    for (uint64_t i = 0; i < iterations; ++i) {
+        queue_try_push(&bench_queue, (void*)&bench_logic);
+        queue_try_pop(&bench_queue, &item);
+    }
+}
+
+static void bench_queue_push_pop(uint64_t iterations) {
+    void *item = NULL;
+
+    for (uint64_t i = 0; i < iterations; ++i) {
+        queue_push(&bench_queue, (void*)&bench_logic);
+        queue_pop(&bench_queue, &item);
+    }
+}
+
+static const bench_case_t bench_cases[] = {
+    { "input_map_apply", bench_input_map_apply },
+    { "decode_ev/buttons", bench_decode_ev_buttons },
+    { "decode_ev/chord", bench_decode_ev_chord },
+    { "decode_hidraw_to_gamepad", bench_decode_hidraw },
+    { "ds4/send_data", bench_ds4_report },
+    { "ds5/send_data", bench_ds5_report },
+    { "dev_iio_read_imu/sysfs", bench_iio_read_imu },
+    { "dev_iio_read_imu/buffered", bench_iio_read_imu_buffered },
+    { "queue/try_push+try_pop", bench_queue_try_push_pop },
+    { "queue/push+pop", bench_queue_push_pop },
+};
+
+static int compare_double(const void *a, const void *b) {
+    const double da = *(const double*)a;
+    const double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+static void bench_measure(const bench_case_t *const bench) {
+    // grow the iterations until a run is long enough to be timed, then size the runs from that
+    uint64_t iterations = 1;
+    uint64_t elapsed_ns = 0;
+    for (;;) {
+        const uint64_t begin_ns = latency_now_ns();
+        bench->run(iterations);
+        elapsed_ns = latency_now_ns() - begin_ns;
+
+        if (elapsed_ns >= BENCH_CALIBRATION_NS) {
+            break;
+        }
+
+        iterations *= 2;
+    }
+
+    iterations = (uint64_t)((double)iterations * ((double)BENCH_RUN_NS / (double)elapsed_ns)) + 1;
+
+    double ns_per_op[BENCH_RUNS];
+    const uint64_t allocations_begin = atomic_load_explicit(&allocations, memory_order_relaxed);
+    for (int r = 0; r < BENCH_RUNS; ++r) {
+        const uint64_t begin_ns = latency_now_ns();
+        bench->run(iterations);
+        ns_per_op[r] = (double)(latency_now_ns() - begin_ns) / (double)iterations;
+    }
+    const uint64_t allocations_end = atomic_load_explicit(&allocations, memory_order_relaxed);
+
+    qsort(ns_per_op, BENCH_RUNS, sizeof(double), compare_double);
+
+    printf(
+        "%-28s %12.1f %12.1f %12.3f %14" PRIu64 "\n",
+        bench->name,
+        ns_per_op[BENCH_RUNS / 2],
+        ns_per_op[0],
+        (double)(allocations_end - allocations_begin) / ((double)iterations * BENCH_RUNS),
+        iterations
+    );
+}
+
+static int write_fixture_data(const char *const file, const void *const data, size_t size) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", bench_iio_dir, file);
+
+    FILE *const f = fopen(path, "w");
+    if (f == NULL) {
+        return -errno;
+    }
+
+    const size_t written = fwrite(data, 1, size, f);
+    fclose(f);
+
+    return (written == size) ? 0 : -EIO;
+}
+
+static int write_fixture(const char *const file, const char *const content) {
+    return write_fixture_data(file, content, strlen(content));
+}
+
+static int mkdir_fixture(const char *const dir) {
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", bench_iio_dir, dir);
+
+    return (mkdir(path, 0700) == 0) ? 0 : -errno;
+}
+
+// a BMI323 as exposed in /sys/bus/iio/devices: only the files dev_iio reads in sysfs polling mode
+static int create_iio_fixture(void) {
+    if (mkdtemp(bench_iio_dir) == NULL) {
+        return -errno;
+    }
+
+    int res = 0;
+    res = res ? res : write_fixture("name", "bmi323-imu\n");
+    res = res ? res : write_fixture("in_anglvel_scale", LSB_PER_RAD_S_2000_DEG_S_STR "\n");
+    res = res ? res : write_fixture("in_anglvel_x_raw", "-12\n");
+    res = res ? res : write_fixture("in_anglvel_y_raw", "7\n");
+    res = res ? res : write_fixture("in_anglvel_z_raw", "2043\n");
+    res = res ? res : write_fixture("in_accel_scale", LSB_PER_16G_STR "\n");
+    res = res ? res : write_fixture("in_accel_x_raw", "31\n");
+    res = res ? res : write_fixture("in_accel_y_raw", "2046\n");
+    res = res ? res : write_fixture("in_accel_z_raw", "-18\n");
+
+    return res;
+}
+
+/*
+ * The same BMI323 in buffered mode: scan_elements describes the anglvel then the accel x, y, z as le:s16 followed
+ * by a 64 bits timestamp, so 24 bytes per scan, and dev/iio:device0 stands in for the character device with one
+ * read() worth of scans.
+ */
+static int create_iio_buffered_fixture(void) {
+    static const char *const axes[] = { "x", "y", "z" };
+    static const char *const types[] = { "anglvel", "accel" };
+    static const int16_t samples[][6] = {
+        { -12, 7, 2043, 31, 2046, -18 },
+        { -9, 4, 2047, 29, 2049, -15 },
+        { -15, 11, 2038, 34, 2043, -21 },
+        { -11, 6, 2045, 30, 2047, -17 },
+    };
+
+    int res = 0;
+    res = res ? res : mkdir_fixture("buffered");
+    res = res ? res : mkdir_fixture("buffered/iio:device0");
+    res = res ? res : mkdir_fixture("buffered/iio:device0/scan_elements");
+    res = res ? res : mkdir_fixture("buffered/iio:device0/buffer");
+    res = res ? res : mkdir_fixture("buffered/iio:device0/trigger");
+    res = res ? res : mkdir_fixture("dev");
+
+    res = res ? res : write_fixture("buffered/iio:device0/name", "bmi323-imu\n");
+    res = res ? res : write_fixture("buffered/iio:device0/in_anglvel_scale", LSB_PER_RAD_S_2000_DEG_S_STR "\n");
+    res = res ? res : write_fixture("buffered/iio:device0/in_anglvel_x_raw", "-12\n");
+    res = res ? res : write_fixture("buffered/iio:device0/in_anglvel_y_raw", "7\n");
+    res = res ? res : write_fixture("buffered/iio:device0/in_anglvel_z_raw", "2043\n");
+    res = res ? res : write_fixture("buffered/iio:device0/in_accel_scale", LSB_PER_16G_STR "\n");
+    res = res ? res : write_fixture("buffered/iio:device0/in_accel_x_raw", "31\n");
+    res = res ? res : write_fixture("buffered/iio:device0/in_accel_y_raw", "2046\n");
+    res = res ? res : write_fixture("buffered/iio:device0/in_accel_z_raw", "-18\n");
+    res = res ? res : write_fixture("buffered/iio:device0/current_timestamp_clock", "monotonic\n");
+    res = res ? res : write_fixture("buffered/iio:device0/buffer/enable", "0\n");
+    res = res ? res : write_fixture("buffered/iio:device0/buffer/length", "2\n");
+    res = res ? res : write_fixture("buffered/iio:device0/trigger/current_trigger", "bmi323-imu-dev0\n");
+
+    for (int i = 0; (res == 0) && (i < 6); ++i) {
+        char file[PATH_MAX], index[8];
+
+        snprintf(file, sizeof(file), "buffered/iio:device0/scan_elements/in_%s_%s_en", types[i / 3], axes[i % 3]);
+        res = write_fixture(file, "0\n");
+
+        snprintf(file, sizeof(file), "buffered/iio:device0/scan_elements/in_%s_%s_index", types[i / 3], axes[i % 3]);
+        snprintf(index, sizeof(index), "%d\n", i);
+        res = res ? res : write_fixture(file, index);
+
+        snprintf(file, sizeof(file), "buffered/iio:device0/scan_elements/in_%s_%s_type", types[i / 3], axes[i % 3]);
+        res = res ? res : write_fixture(file, "le:s16/16>>0\n");
+    }
+
+    res = res ? res : write_fixture("buffered/iio:device0/scan_elements/in_timestamp_en", "0\n");
+    res = res ? res : write_fixture("buffered/iio:device0/scan_elements/in_timestamp_index", "6\n");
+    res = res ? res : write_fixture("buffered/iio:device0/scan_elements/in_timestamp_type", "le:s64/64>>0\n");
+
+    // little endian scans laid out as dev_iio computes them: six s16, four bytes of padding, then the timestamp
+    uint8_t scans[DEV_IIO_BUFFER_READ_SAMPLES][24];
+    memset(scans, 0, sizeof(scans));
+    for (int s = 0; s < DEV_IIO_BUFFER_READ_SAMPLES; ++s) {
+        const int16_t *const sample = samples[s % (sizeof(samples) / sizeof(samples[0]))];
+        for (int i = 0; i < 6; ++i) {
+            scans[s][i * 2] = (uint8_t)((uint16_t)sample[i] & 0xFF);
+            scans[s][(i * 2) + 1] = (uint8_t)((uint16_t)sample[i] >> 8);
+        }
+
+        // 1.25ms apart, as at the 800Hz output data rate
+        const uint64_t timestamp_ns = 1700000000000000000ULL + ((uint64_t)s * 1250000ULL);
+        for (int b = 0; b < 8; ++b) {
+            scans[s][16 + b] = (uint8_t)(timestamp_ns >> (b * 8));
+        }
+    }
+    res = res ? res : write_fixture_data("dev/iio:device0", scans, sizeof(scans));
+
+    return res;
+}
+
+static void remove_fixture_dir(const char *const dir_path) {
+    DIR *const d = opendir(dir_path);
+    if (d == NULL) {
+        return;
+    }
+
+    struct dirent *dir;
+    while ((dir = readdir(d)) != NULL) {
+        if ((strcmp(dir->d_name, ".") == 0) || (strcmp(dir->d_name, "..") == 0)) {
+            continue;
+        }
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, dir->d_name);
+        if (dir->d_type == DT_DIR) {
+            remove_fixture_dir(path);
+        } else {
+            unlink(path);
+        }
+    }
+    closedir(d);
+
+    rmdir(dir_path);
+}
+
+static void remove_iio_fixture(void) {
+    remove_fixture_dir(bench_iio_dir);
+}
+
+int main(int argc, char ** argv) {
+    int ret = EXIT_FAILURE;
+    const char *const filter = (argc > 1) ? argv[1] : NULL;
+
+    // a logic without threads nor devices: the settings are the defaults
+    init_config(&bench_logic.controller_settings);
+    atomic_init(&bench_logic.settings, &bench_logic.controller_settings);
+    atomic_init(&bench_logic.gamepad_seq, 0);
+    bench_logic.gamepad_update_fd = -1;
+    bench_logic.rumble_event_fd = -1;
+    bench_logic.gamepad_output = GAMEPAD_OUTPUT_DS5;
+
+    const int mutex_creation_res = pthread_mutex_init(&bench_logic.gamepad_write_mutex, NULL);
+    if (mutex_creation_res != 0) {
+        fprintf(stderr, "Unable to create mutex: %d\n", mutex_creation_res);
+        return EXIT_FAILURE;
+    }
+
+    bench_out_dev.settings = &bench_logic.controller_settings;
+    const int input_map_res = input_map_compile(&bench_out_dev.input_map, bench_out_dev.settings);
+    if (input_map_res != 0) {
+        fprintf(stderr, "Unable to compile the input map: %d\n", input_map_res);
+        goto main_err;
+    }
+
+    const int queue_init_res = queue_init(&bench_queue, 128);
+    if (queue_init_res < 0) {
+        fprintf(stderr, "Unable to create queue: %d\n", queue_init_res);
+        goto main_err;
+    }
+
+    const int run_iio_sysfs = (filter == NULL) || (strstr("dev_iio_read_imu/sysfs", filter) != NULL);
+    const int run_iio_buffered = (filter == NULL) || (strstr("dev_iio_read_imu/buffered", filter) != NULL);
+    const int run_iio = run_iio_sysfs || run_iio_buffered;
+    if (run_iio) {
+        int fixture_res = create_iio_fixture();
+        fixture_res = fixture_res ? fixture_res : create_iio_buffered_fixture();
+        if (fixture_res != 0) {
+            fprintf(stderr, "Unable to create the IIO fixture in %s: %d\n", bench_iio_dir, fixture_res);
+            goto main_err_fixture;
+        }
+    }
+
+    if (run_iio_sysfs) {
+        bench_iio = dev_iio_create(bench_iio_dir);
+        if (bench_iio == NULL) {
+            fprintf(stderr, "Unable to open the IIO fixture %s\n", bench_iio_dir);
+            goto main_err_iio;
+        }
+    }
+
+    if (run_iio_buffered) {
+        char buffered_dir[PATH_MAX], dev_dir[PATH_MAX];
+        snprintf(buffered_dir, sizeof(buffered_dir), "%s/buffered/iio:device0", bench_iio_dir);
+        snprintf(dev_dir, sizeof(dev_dir), "%s/dev", bench_iio_dir);
+
+        bench_iio_buffered = dev_iio_create(buffered_dir);
+        if (bench_iio_buffered == NULL) {
+            fprintf(stderr, "Unable to open the IIO fixture %s\n", buffered_dir);
+            goto main_err_iio;
+        }
+
+        dev_iio_bench_dev_dir = dev_dir;
+        const int buffered_res = dev_iio_enable_buffered(bench_iio_buffered);
+        dev_iio_bench_dev_dir = "/dev";
+        if (buffered_res != 0) {
+            fprintf(stderr, "Unable to enable buffered capture on the IIO fixture %s: %d\n", buffered_dir, buffered_res);
+            goto main_err_iio;
+        }
+    }
+
+    printf("\n%-28s %12s %12s %12s %14s\n", "benchmark", "ns/op", "min ns/op", "allocs/op", "iterations");
+    for (size_t i = 0; i < sizeof(bench_cases) / sizeof(bench_cases[0]); ++i) {
+        if ((filter != NULL) && (strstr(bench_cases[i].name, filter) == NULL)) {
+            continue;
+        } else if ((bench_iio == NULL) && (bench_cases[i].run == bench_iio_read_imu)) {
+            continue;
+        } else if ((bench_iio_buffered == NULL) && (bench_cases[i].run == bench_iio_read_imu_buffered)) {
+            continue;
+        }
+
+        bench_measure(&bench_cases[i]);
+    }
+
+    ret = EXIT_SUCCESS;
+
+main_err_iio:
+    if (bench_iio_buffered != NULL) {
+        dev_iio_destroy(bench_iio_buffered);
+    }
+
+    if (bench_iio != NULL) {
+        dev_iio_destroy(bench_iio);
+    }
+
+main_err_fixture:
+    if (run_iio) {
+        remove_iio_fixture();
+    }
+
+    queue_destroy(&bench_queue);
+
+main_err:
+    pthread_mutex_destroy(&bench_logic.gamepad_write_mutex);
+
+    return ret;
+}
@@ -1,5 +1,8 @@
 #include "dev_iio.h"
+#include "ring_log.h"
 #include <stdlib.h>
+#include <dirent.h>
+#include <limits.h>
 
 static char* read_file(const char* base_path, const char *file) {
     char* res = NULL;
@@ -85,18 +88,351 @@ write_file_err:
     return res;
 }
 
+/*
+ * Channels feeding every field of imu_message_t in buffered mode: these mirror the sysfs *_raw
+ * files opened by dev_iio_create so that both capture modes produce the very same samples.
+ */
+static const char* const scan_accel_channels[3] = { "anglvel_x", "anglvel_y", "anglvel_z" };
+static const char* const scan_accel_sensor_channels[3] = { "accel_x", "accel_y", "accel_z" };
+static const char* const scan_anglvel_channels[3] = { "anglvel_y", "anglvel_x", "anglvel_z" };
+static const char* const scan_temp_channel = "anglvel_z";
+static const char* const scan_timestamp_channel = "timestamp";
+
+#define DEV_IIO_MAX_SCAN_CHANNELS 8
+
+static int scan_channel_is_wanted(const char* channel) {
+    for (int i = 0; i < 3; ++i) {
+        if (
+            (strcmp(channel, scan_accel_channels[i]) == 0) ||
+            (strcmp(channel, scan_accel_sensor_channels[i]) == 0) ||
+            (strcmp(channel, scan_anglvel_channels[i]) == 0)
+        ) {
+            return 1;
+        }
+    }
+
+    return (strcmp(channel, scan_temp_channel) == 0) || (strcmp(channel, scan_timestamp_channel) == 0);
+}
+
+static int scan_channel_parse(const char* scan_path, const char* channel, dev_iio_scan_channel_t *const out, long *const index) {
+    char file[128];
+
+    snprintf(file, sizeof(file), "/in_%s_index", channel);
+    char* const index_str = read_file(scan_path, file);
+    if (index_str == NULL) {
+        return -ENOENT;
+    }
+    *index = strtol(index_str, NULL, 10);
+    free(index_str);
+
+    // format is [be|le]:[s|u]bits/storagebits>>shift, i.e. le:s16/16>>0
+    snprintf(file, sizeof(file), "/in_%s_type", channel);
+    char* const type_str = read_file(scan_path, file);
+    if (type_str == NULL) {
+        return -ENOENT;
+    }
+
+    char endianness = '\0', sign = '\0';
+    unsigned int bits = 0, storage_bits = 0, shift = 0;
+    const int matched = sscanf(type_str, "%ce:%c%u/%u>>%u", &endianness, &sign, &bits, &storage_bits, &shift);
+    free(type_str);
+
+    if ((matched != 5) || (storage_bits == 0) || (storage_bits > 64) || ((storage_bits % 8) != 0) || (bits > storage_bits)) {
+        fprintf(stderr, "Unsupported scan type for channel %s.\n", channel);
+        return -EINVAL;
+    }
+
+    out->enabled = 1;
+    out->offset = 0;
+    out->storage_bytes = storage_bits / 8;
+    out->bits = bits;
+    out->shift = shift;
+    out->is_signed = sign == 's';
+    out->is_be = endianness == 'b';
+
+    return 0;
+}
+
+static int64_t scan_channel_value(const dev_iio_scan_channel_t *const ch, const uint8_t *const scan) {
+    uint64_t raw = 0;
+    for (uint8_t b = 0; b < ch->storage_bytes; ++b) {
+        const uint8_t byte = scan[ch->offset + (ch->is_be ? b : (ch->storage_bytes - 1 - b))];
+        raw = (raw << 8) | byte;
+    }
+
+    raw >>= ch->shift;
+    if (ch->bits < 64) {
+        const uint64_t mask = ((uint64_t)1 << ch->bits) - 1;
+        raw &= mask;
+        if ((ch->is_signed) && (raw & ((uint64_t)1 << (ch->bits - 1)))) {
+            raw |= ~mask;
+        }
+    }
+
+    return (int64_t)raw;
+}
+
+/*
+ * HID sensors (and most IMU drivers) register their own data-ready trigger named <device name>-dev<N>:
+ * select it if the device has no trigger assigned yet.
+ */
+static void dev_iio_select_trigger(const dev_iio_t *const iio) {
+    char* const current = read_file(iio->path, "/trigger/current_trigger");
+    if (current == NULL) {
+        // this driver does not use triggers
+        return;
+    }
+
+    const int has_trigger = (current[0] != '\0') && (current[0] != '\n');
+    free(current);
+    if (has_trigger) {
+        return;
+    }
+
+    const char* const triggers_path = "/sys/bus/iio/devices/";
+    DIR *const d = opendir(triggers_path);
+    if (d == NULL) {
+        return;
+    }
+
+    struct dirent *dir;
+    while ((dir = readdir(d)) != NULL) {
+        if (strncmp(dir->d_name, "trigger", strlen("trigger")) != 0) {
+            continue;
+        }
+
+        char trigger_path[512];
+        snprintf(trigger_path, sizeof(trigger_path), "%s%s", triggers_path, dir->d_name);
+
+        char* const trigger_name = read_file(trigger_path, "/name");
+        if (trigger_name == NULL) {
+            continue;
+        }
+
+        const size_t name_len = strcspn(trigger_name, "\n");
+        trigger_name[name_len] = '\0';
+
+        if (strncmp(trigger_name, iio->name, strlen(iio->name)) == 0) {
+            write_file(iio->path, "/trigger/current_trigger", trigger_name, name_len);
+            printf("Selected trigger %s for iio device %s\n", trigger_name, iio->name);
+            free(trigger_name);
+            break;
+        }
+
+        free(trigger_name);
+    }
+
+    closedir(d);
+}
+
+#if defined(ROGUE_ENEMY_BENCH)
+const char* dev_iio_bench_dev_dir = "/dev";
+#endif
+
+/*
+ * Switch the device to buffered capture: samples are then read as packed binary scans from
+ * /dev/iio:deviceN, many at a time, instead of parsing a sysfs file per axis per sample.
+ */
+static int dev_iio_buffer_setup(dev_iio_t *const iio) {
+    int res = 0;
+
+    const char* const dev_name = strrchr(iio->path, '/');
+    if ((dev_name == NULL) || (dev_name[1] == '\0')) {
+        return -EINVAL;
+    }
+
+    char scan_path[512];
+    snprintf(scan_path, sizeof(scan_path), "%s/scan_elements", iio->path);
+
+    // scan elements can only be changed while the buffer is disabled
+    write_file(iio->path, "/buffer/enable", "0", 1);
+
+    dev_iio_select_trigger(iio);
+
+    DIR *const d = opendir(scan_path);
+    if (d == NULL) {
+        fprintf(stderr, "iio device %s has no scan_elements.\n", iio->name);
+        return -ENOENT;
+    }
+
+    // enable the channels in use and disable everything else: the scan layout depends on every enabled channel
+    char channels[DEV_IIO_MAX_SCAN_CHANNELS][64];
+    dev_iio_scan_channel_t layout[DEV_IIO_MAX_SCAN_CHANNELS];
+    long indexes[DEV_IIO_MAX_SCAN_CHANNELS];
+    size_t channels_count = 0;
+
+    struct dirent *dir;
+    while ((dir = readdir(d)) != NULL) {
+        const size_t len = strlen(dir->d_name);
+        if ((len <= 6) || (strncmp(dir->d_name, "in_", 3) != 0) || (strcmp(&dir->d_name[len - 3], "_en") != 0)) {
+            continue;
+        }
+
+        char channel[64];
+        if ((len - 6) >= sizeof(channel)) {
+            continue;
+        }
+        snprintf(channel, sizeof(channel), "%.*s", (int)(len - 6), &dir->d_name[3]);
+
+        char en_file[NAME_MAX + 2];
+        snprintf(en_file, sizeof(en_file), "/%s", dir->d_name);
+
+        const int wanted = scan_channel_is_wanted(channel);
+        write_file(scan_path, en_file, wanted ? "1" : "0", 1);
+
+        if ((!wanted) || (channels_count == DEV_IIO_MAX_SCAN_CHANNELS)) {
+            continue;
+        }
+
+        if (scan_channel_parse(scan_path, channel, &layout[channels_count], &indexes[channels_count]) != 0) {
+            res = -EINVAL;
+            break;
+        }
+
+        strcpy(channels[channels_count], channel);
+        ++channels_count;
+    }
+
+    closedir(d);
+
+    if (res != 0) {
+        return res;
+    }
+
+    // channels are packed by ascending index, each one naturally aligned to its storage size
+    size_t scan_size = 0;
+    size_t max_storage = 1;
+    for (long index = 0, placed = 0; placed < (long)channels_count; ++index) {
+        for (size_t c = 0; c < channels_count; ++c) {
+            if (indexes[c] != index) {
+                continue;
+            }
+
+            const size_t sz = layout[c].storage_bytes;
+            scan_size = ((scan_size + sz - 1) / sz) * sz;
+            layout[c].offset = scan_size;
+            scan_size += sz;
+            max_storage = (sz > max_storage) ? sz : max_storage;
+            ++placed;
+        }
+
+        if (index > 1024) {
+            return -EINVAL;
+        }
+    }
+    scan_size = ((scan_size + max_storage - 1) / max_storage) * max_storage;
+
+    memset(iio->scan_accel, 0, sizeof(iio->scan_accel));
+    memset(iio->scan_accel_sensor, 0, sizeof(iio->scan_accel_sensor));
+    memset(iio->scan_anglvel, 0, sizeof(iio->scan_anglvel));
+    memset(&iio->scan_temp, 0, sizeof(iio->scan_temp));
+    memset(&iio->scan_timestamp, 0, sizeof(iio->scan_timestamp));
+    for (size_t c = 0; c < channels_count; ++c) {
+        for (int i = 0; i < 3; ++i) {
+            if (strcmp(channels[c], scan_accel_channels[i]) == 0) {
+                iio->scan_accel[i] = layout[c];
+            }
+
+            if (strcmp(channels[c], scan_accel_sensor_channels[i]) == 0) {
+                iio->scan_accel_sensor[i] = layout[c];
+            }
+
+            if (strcmp(channels[c], scan_anglvel_channels[i]) == 0) {
+                iio->scan_anglvel[i] = layout[c];
+            }
+        }
+
+        if (strcmp(channels[c], scan_temp_channel) == 0) {
+            iio->scan_temp = layout[c];
+        }
+
+        if (strcmp(channels[c], scan_timestamp_channel) == 0) {
+            iio->scan_timestamp = layout[c];
+        }
+    }
+
+    if ((scan_size == 0) || (!iio->scan_anglvel[0].enabled) || (!iio->scan_anglvel[1].enabled) || (!iio->scan_anglvel[2].enabled)) {
+        fprintf(stderr, "iio device %s does not expose the required channels in its buffer.\n", iio->name);
+        return -ENOENT;
+    }
+
+    if ((!iio->scan_accel_sensor[0].enabled) || (!iio->scan_accel_sensor[1].enabled) || (!iio->scan_accel_sensor[2].enabled)) {
+        fprintf(stderr, "iio device %s has no accel_{x,y,z} scan elements: sensor fusion will stay disabled.\n", iio->name);
+    }
+
+    char length_str[16];
+    snprintf(length_str, sizeof(length_str), "%d", DEV_IIO_BUFFER_LENGTH);
+    write_file(iio->path, "/buffer/length", length_str, strlen(length_str));
+
+    // timestamps are compared against gettimeofday() elsewhere
+    write_file(iio->path, "/current_timestamp_clock", "realtime", strlen("realtime"));
+
+    write_file(iio->path, "/buffer/enable", "1", 1);
+
+    char* const enabled = read_file(iio->path, "/buffer/enable");
+    const int is_enabled = (enabled != NULL) && (enabled[0] == '1');
+    free(enabled);
+    if (!is_enabled) {
+        fprintf(stderr, "Unable to enable the buffer of iio device %s.\n", iio->name);
+        return -EIO;
+    }
+
+    iio->scan_buf = malloc(scan_size * DEV_IIO_BUFFER_READ_SAMPLES);
+    if (iio->scan_buf == NULL) {
+        write_file(iio->path, "/buffer/enable", "0", 1);
+        return -ENOMEM;
+    }
+
+    char dev_path[512];
+#if defined(ROGUE_ENEMY_BENCH)
+    snprintf(dev_path, sizeof(dev_path), "%s%s", dev_iio_bench_dev_dir, dev_name);
+#else
+    snprintf(dev_path, sizeof(dev_path), "/dev%s", dev_name);
+#endif
+    iio->buf_fd = open(dev_path, O_RDONLY | O_CLOEXEC);
+    if (iio->buf_fd < 0) {
+        // the cleanup below can overwrite errno
+        const int open_errno = errno;
+        fprintf(stderr, "Cannot open %s: %d\n", dev_path, open_errno);
+        write_file(iio->path, "/buffer/enable", "0", 1);
+        free(iio->scan_buf);
+        iio->scan_buf = NULL;
+        return -open_errno;
+    }
+
+    iio->scan_size = scan_size;
+    iio->scan_buf_count = 0;
+    iio->scan_buf_next = 0;
+
+    printf("Buffered capture enabled on %s: %zu bytes per scan\n", dev_path, scan_size);
+
+    return 0;
+}
+
 dev_iio_t* dev_iio_create(const char* path) {
     dev_iio_t *iio = malloc(sizeof(dev_iio_t));
     if (iio == NULL) {
         return NULL;
     }
 
+    iio->buf_fd = -1;
+    iio->scan_size = 0;
+    iio->scan_buf = NULL;
+    iio->scan_buf_count = 0;
+    iio->scan_buf_next = 0;
+
+    iio->gyro_calib = NULL;
+    iio->gyro_calib_path = NULL;
+
     iio->anglvel_x_fd = NULL;
     iio->anglvel_y_fd = NULL;
     iio->anglvel_z_fd = NULL;
     iio->accel_x_fd = NULL;
     iio->accel_y_fd = NULL;
     iio->accel_z_fd = NULL;
+    iio->accel_sensor_x_fd = NULL;
+    iio->accel_sensor_y_fd = NULL;
+    iio->accel_sensor_z_fd = NULL;
     iio->temp_fd = NULL;
 
     iio->accel_scale_x = 0.0f;
@@ -106,6 +442,7 @@ dev_iio_t* dev_iio_create(const char* path) {
     iio->anglvel_scale_y = 0.0f;
     iio->anglvel_scale_z = 0.0f;
     iio->temp_scale = 0.0f;
+    iio->accel_sensor_scale = 0.0;
 
     iio->outer_accel_scale_x = ACCEL_SCALE;
     iio->outer_accel_scale_y = ACCEL_SCALE;
@@ -215,6 +552,21 @@ dev_iio_t* dev_iio_create(const char* path) {
     }
     // ==========================================================================================================
 
+    // ======================================== accelerometer scale =============================================
+    {
+        // left as the driver set it: only the fusion reads this channel
+        const char *scale_main_file = "/in_accel_scale";
+
+        char* const accel_sensor_scale = read_file(iio->path, scale_main_file);
+        if (accel_sensor_scale != NULL) {
+            iio->accel_sensor_scale = strtod(accel_sensor_scale, NULL);
+            free((void*)accel_sensor_scale);
+        } else {
+            fprintf(stderr, "Unable to read %s%s: sensor fusion will stay disabled.\n", iio->path, scale_main_file);
+        }
+    }
+    // ==========================================================================================================
+
     // ============================================= temp_scale =================================================
     {
         const char *scale_main_file = "/in_anglvel_scale";
@@ -294,6 +646,27 @@ dev_iio_t* dev_iio_create(const char* path) {
     strcat(tmp, "/in_anglvel_z_raw");
     iio->temp_fd = fopen(tmp, "r");
 
+    if (iio->accel_sensor_scale != 0.0) {
+        memset(tmp, 0, tmp_sz);
+        strcat(tmp, iio->path);
+        strcat(tmp, "/in_accel_x_raw");
+        iio->accel_sensor_x_fd = fopen(tmp, "r");
+
+        memset(tmp, 0, tmp_sz);
+        strcat(tmp, iio->path);
+        strcat(tmp, "/in_accel_y_raw");
+        iio->accel_sensor_y_fd = fopen(tmp, "r");
+
+        memset(tmp, 0, tmp_sz);
+        strcat(tmp, iio->path);
+        strcat(tmp, "/in_accel_z_raw");
+        iio->accel_sensor_z_fd = fopen(tmp, "r");
+
+        if ((iio->accel_sensor_x_fd == NULL) || (iio->accel_sensor_y_fd == NULL) || (iio->accel_sensor_z_fd == NULL)) {
+            fprintf(stderr, "iio device %s has no in_accel_{x,y,z}_raw: sensor fusion will stay disabled.\n", iio->name);
+        }
+    }
+
     free(tmp);
 
     printf(
@@ -314,9 +687,33 @@ dev_iio_create_err:
 }
 
 void dev_iio_destroy(dev_iio_t* iio) {
+    if (dev_iio_is_buffered(iio)) {
+        close(iio->buf_fd);
+        write_file(iio->path, "/buffer/enable", "0", 1);
+    }
+    if (iio->gyro_calib != NULL) {
+        gyro_calib_unregister(iio->gyro_calib);
+
+        // the saver is out of the way: whatever it did not persist yet is written now
+        if ((iio->gyro_calib->dirty) || (atomic_load_explicit(&iio->gyro_calib->snapshot_ready, memory_order_acquire))) {
+            gyro_calib_save(iio->gyro_calib, iio->gyro_calib_path);
+        }
+    }
+    free(iio->gyro_calib);
+    free(iio->gyro_calib_path);
+    free(iio->scan_buf);
     fclose(iio->accel_x_fd);
     fclose(iio->accel_y_fd);
     fclose(iio->accel_z_fd);
+    if (iio->accel_sensor_x_fd != NULL) {
+        fclose(iio->accel_sensor_x_fd);
+    }
+    if (iio->accel_sensor_y_fd != NULL) {
+        fclose(iio->accel_sensor_y_fd);
+    }
+    if (iio->accel_sensor_z_fd != NULL) {
+        fclose(iio->accel_sensor_z_fd);
+    }
     fclose(iio->anglvel_x_fd);
     fclose(iio->anglvel_y_fd);
     fclose(iio->anglvel_z_fd);
@@ -334,6 +731,64 @@ const char* dev_iio_get_path(const dev_iio_t* iio) {
     return iio->path;
 }
 
+int dev_iio_enable_buffered(dev_iio_t *const iio) {
+    if (dev_iio_is_buffered(iio)) {
+        return 0;
+    }
+
+    const int buffer_setup_res = dev_iio_buffer_setup(iio);
+    if (buffer_setup_res != 0) {
+        fprintf(stderr, "Buffered capture unavailable for %s (%d): falling back to sysfs polling.\n", iio->name, buffer_setup_res);
+    }
+
+    return buffer_setup_res;
+}
+
+int dev_iio_enable_gyro_calibration(dev_iio_t *const iio, const char *const dir) {
+    if ((!dev_iio_has_anglvel(iio)) || (iio->gyro_calib != NULL)) {
+        return 0;
+    }
+
+    if ((mkdir(dir, 0755) != 0) && (errno != EEXIST)) {
+        fprintf(stderr, "Unable to create the gyro calibration directory %s: %d\n", dir, errno);
+    }
+
+    gyro_calib_t *const calib = malloc(sizeof(gyro_calib_t));
+    char *const path = malloc(PATH_MAX);
+    if ((calib == NULL) || (path == NULL)) {
+        free(calib);
+        free(path);
+        return -ENOMEM;
+    }
+
+    // one file per sensor model: the name cannot contain path separators
+    snprintf(path, PATH_MAX, "%s/gyro_%s.bin", dir, iio->name);
+    for (char *c = &path[strlen(dir) + 1]; *c != '\0'; ++c) {
+        if (*c == '/') {
+            *c = '_';
+        }
+    }
+
+    const double scale[3] = { iio->anglvel_scale_x, iio->anglvel_scale_y, iio->anglvel_scale_z };
+    gyro_calib_init(calib, scale);
+
+    const int load_res = gyro_calib_load(calib, path);
+    if (load_res == 0) {
+        printf("Gyro bias of %s loaded from %s: %f %f %f\n", iio->name, path, calib->bias[0], calib->bias[1], calib->bias[2]);
+    } else if (load_res != -ENOENT) {
+        fprintf(stderr, "Unable to load the gyro calibration %s: %d, starting from scratch\n", path, load_res);
+    }
+
+    iio->gyro_calib = calib;
+    iio->gyro_calib_path = path;
+
+    if (gyro_calib_register(calib, path) != 0) {
+        fprintf(stderr, "Too many gyro calibrations: %s will only be saved when the device is closed\n", path);
+    }
+
+    return 0;
+}
+
 int dev_iio_read(
     const dev_iio_t *const iio,
     struct input_event *const buf,
@@ -363,7 +818,7 @@ int dev_iio_read(
             ev->code = ABS_X;
             ev->value = (__s32)(val_in_m2s * iio->outer_accel_scale_x);
         } else {
-            fprintf(stderr, "While reading accel(x): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading accel(x): %d\n", tmp_read);
             return tmp_read;
         }
 
@@ -388,7 +843,7 @@ int dev_iio_read(
             ev->code = ABS_Y;
             ev->value = (__s32)(val_in_m2s * iio->outer_accel_scale_y);
         } else {
-            fprintf(stderr, "While reading accel(y): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading accel(y): %d\n", tmp_read);
             return tmp_read;
         }
 
@@ -413,7 +868,7 @@ int dev_iio_read(
             ev->code = ABS_Z;
             ev->value = (__s32)(val_in_m2s * iio->outer_accel_scale_z);
         } else {
-            fprintf(stderr, "While reading accel(z): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading accel(z): %d\n", tmp_read);
             return tmp_read;
         }
 
@@ -438,7 +893,7 @@ int dev_iio_read(
             ev->code = ABS_RX;
             ev->value = (__s32)(val_in_m2s * iio->outer_anglvel_scale_x);
         } else {
-            fprintf(stderr, "While reading anglvel(x): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading anglvel(x): %d\n", tmp_read);
             return tmp_read;
         }
 
@@ -463,7 +918,7 @@ int dev_iio_read(
             ev->code = ABS_RY;
             ev->value = (__s32)(val_in_m2s * iio->outer_anglvel_scale_y);
         } else {
-            fprintf(stderr, "While reading anglvel(y): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading anglvel(y): %d\n", tmp_read);
             return tmp_read;
         }
 
@@ -488,7 +943,7 @@ int dev_iio_read(
             ev->code = ABS_RZ;
             ev->value = (__s32)(val_in_m2s * iio->outer_anglvel_scale_z);
         } else {
-            fprintf(stderr, "While reading anglvel(z): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading anglvel(z): %d\n", tmp_read);
             return tmp_read;
         }
 
@@ -498,13 +953,127 @@ int dev_iio_read(
     return 0;
 }
 
+// updates the bias estimate with the sample just read and removes the bias from it (raw counts and gyro_in)
+static void apply_gyro_calibration(dev_iio_t *const iio, imu_message_t *const out, double gyro_in[3]) {
+    gyro_calib_t *const calib = iio->gyro_calib;
+
+    // accel_m2s is not read from the accelerometer: without a real one stillness is judged on the gyro alone
+    const double *const accel = ((out->flags & IMU_MESSAGE_FLAGS_ACCEL_SENSOR) != 0) ? out->accel_sensor_m2s : NULL;
+
+    const long raw[3] = { out->gyro_x_raw, out->gyro_y_raw, out->gyro_z_raw };
+    if (gyro_calib_update(calib, raw, accel, &out->gyro_read_time)) {
+        gyro_calib_request_save(calib);
+    }
+
+    const double scale[3] = { iio->anglvel_scale_x, iio->anglvel_scale_y, iio->anglvel_scale_z };
+    for (int i = 0; i < 3; ++i) {
+        gyro_in[i] = ((double)raw[i] - calib->bias[i]) * scale[i];
+    }
+
+    out->gyro_x_raw = lround((double)raw[0] - calib->bias[0]);
+    out->gyro_y_raw = lround((double)raw[1] - calib->bias[1]);
+    out->gyro_z_raw = lround((double)raw[2] - calib->bias[2]);
+}
+
 static void multiplyMatrixVector(const double matrix[3][3], const double vector[3], double result[3]) {
     result[0] = matrix[0][0] * vector[0] + matrix[1][0] * vector[1] + matrix[2][0] * vector[2];
     result[1] = matrix[0][1] * vector[0] + matrix[1][1] * vector[1] + matrix[2][1] * vector[2];
     result[2] = matrix[0][2] * vector[0] + matrix[1][2] * vector[1] + matrix[2][2] * vector[2];
 }
 
-int dev_iio_read_imu(const dev_iio_t *const iio, imu_message_t *const out) {
+static int dev_iio_read_imu_buffered(dev_iio_t *const iio, imu_message_t *const out) {
+    // a single blocking read() fetches every scan captured since the last one
+    if (iio->scan_buf_next >= iio->scan_buf_count) {
+        const ssize_t read_bytes = read(iio->buf_fd, iio->scan_buf, iio->scan_size * DEV_IIO_BUFFER_READ_SAMPLES);
+        if (read_bytes < 0) {
+            const int read_errno = errno;
+            if ((read_errno == EAGAIN) || (read_errno == EINTR)) {
+                return -EAGAIN;
+            }
+
+            RING_LOG(RING_LOG_ERROR, "While reading the buffer of %s: %d\n", iio->name, read_errno);
+            return -read_errno;
+        }
+
+        iio->scan_buf_count = (size_t)read_bytes / iio->scan_size;
+        iio->scan_buf_next = 0;
+
+        if (iio->scan_buf_count == 0) {
+            return -EAGAIN;
+        }
+    }
+
+    const uint8_t *const scan = &iio->scan_buf[iio->scan_buf_next * iio->scan_size];
+    ++iio->scan_buf_next;
+
+    struct timeval read_time;
+    if (iio->scan_timestamp.enabled) {
+        const int64_t timestamp_ns = scan_channel_value(&iio->scan_timestamp, scan);
+        read_time.tv_sec = timestamp_ns / 1000000000;
+        read_time.tv_usec = (timestamp_ns % 1000000000) / 1000;
+    } else {
+        gettimeofday(&read_time, NULL);
+    }
+
+    double gyro_in[3];
+    double accel_in[3];
+
+    double gyro_out[3];
+    double accel_out[3];
+
+    out->accel_x_raw = scan_channel_value(&iio->scan_accel[0], scan);
+    out->accel_y_raw = scan_channel_value(&iio->scan_accel[1], scan);
+    out->accel_z_raw = scan_channel_value(&iio->scan_accel[2], scan);
+    accel_in[0] = (double)out->accel_x_raw * iio->accel_scale_x;
+    accel_in[1] = (double)out->accel_y_raw * iio->accel_scale_y;
+    accel_in[2] = (double)out->accel_z_raw * iio->accel_scale_z;
+    out->accel_read_time = read_time;
+
+    out->gyro_x_raw = scan_channel_value(&iio->scan_anglvel[0], scan);
+    out->gyro_y_raw = scan_channel_value(&iio->scan_anglvel[1], scan);
+    out->gyro_z_raw = scan_channel_value(&iio->scan_anglvel[2], scan);
+    gyro_in[0] = (double)out->gyro_x_raw * iio->anglvel_scale_x;
+    gyro_in[1] = (double)out->gyro_y_raw * iio->anglvel_scale_y;
+    gyro_in[2] = (double)out->gyro_z_raw * iio->anglvel_scale_z;
+    out->gyro_read_time = read_time;
+
+    out->flags = IMU_MESSAGE_FLAGS_ACCEL | IMU_MESSAGE_FLAGS_ANGLVEL;
+
+    if (dev_iio_has_accel_sensor(iio)) {
+        double accel_sensor_in[3];
+        for (int i = 0; i < 3; ++i) {
+            accel_sensor_in[i] = (double)scan_channel_value(&iio->scan_accel_sensor[i], scan) * iio->accel_sensor_scale;
+        }
+
+        const double (*const mount_matrix)[3] = (const double (*)[3])iio->mount_matrix;
+        multiplyMatrixVector(mount_matrix, accel_sensor_in, out->accel_sensor_m2s);
+        out->flags |= IMU_MESSAGE_FLAGS_ACCEL_SENSOR;
+    }
+
+    if (iio->scan_temp.enabled) {
+        out->temp_raw = scan_channel_value(&iio->scan_temp, scan);
+        out->temp_in_k = (double)out->temp_raw * iio->temp_scale;
+    }
+
+    if (iio->gyro_calib != NULL) {
+        apply_gyro_calibration(iio, out, gyro_in);
+    }
+
+    // ISO C (before C23) does not convert double (*)[3] to const double (*)[3] implicitly
+    const double (*const mount_matrix)[3] = (const double (*)[3])iio->mount_matrix;
+    multiplyMatrixVector(mount_matrix, gyro_in, gyro_out);
+    multiplyMatrixVector(mount_matrix, accel_in, accel_out);
+
+    memcpy(out->accel_m2s, accel_out, sizeof(double[3]));
+    memcpy(out->gyro_rad_s, gyro_out, sizeof(double[3]));
+    return 0;
+}
+
+int dev_iio_read_imu(dev_iio_t *const iio, imu_message_t *const out) {
+    if (dev_iio_is_buffered(iio)) {
+        return dev_iio_read_imu_buffered(iio, out);
+    }
+
     struct timeval read_time;
     gettimeofday(&read_time, NULL);
 
@@ -530,7 +1099,7 @@ int dev_iio_read_imu(const dev_iio_t *const iio, imu_message_t *const out) {
                 out->flags |= IMU_MESSAGE_FLAGS_ACCEL;
             }
         } else {
-            fprintf(stderr, "While reading accel(x): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading accel(x): %d\n", tmp_read);
             return tmp_read;
         }
     }
@@ -547,7 +1116,7 @@ int dev_iio_read_imu(const dev_iio_t *const iio, imu_message_t *const out) {
                 out->flags |= IMU_MESSAGE_FLAGS_ACCEL;
             }
         } else {
-            fprintf(stderr, "While reading accel(y): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading accel(y): %d\n", tmp_read);
             return tmp_read;
         }
     }
@@ -564,7 +1133,7 @@ int dev_iio_read_imu(const dev_iio_t *const iio, imu_message_t *const out) {
                 out->flags |= IMU_MESSAGE_FLAGS_ACCEL;
             }
         } else {
-            fprintf(stderr, "While reading accel(z): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading accel(z): %d\n", tmp_read);
             return tmp_read;
         }
     }
@@ -581,7 +1150,7 @@ int dev_iio_read_imu(const dev_iio_t *const iio, imu_message_t *const out) {
                 out->flags |= IMU_MESSAGE_FLAGS_ANGLVEL;
             }
         } else {
-            fprintf(stderr, "While reading anglvel(x): %d \n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading anglvel(x): %d \n", tmp_read);
             return tmp_read;
         }
     }
@@ -598,7 +1167,7 @@ int dev_iio_read_imu(const dev_iio_t *const iio, imu_message_t *const out) {
                 out->flags |= IMU_MESSAGE_FLAGS_ANGLVEL;
             }
         } else {
-            fprintf(stderr, "While reading anglvel(y): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading anglvel(y): %d\n", tmp_read);
             return tmp_read;
         }
     }
@@ -615,7 +1184,7 @@ int dev_iio_read_imu(const dev_iio_t *const iio, imu_message_t *const out) {
                 out->flags |= IMU_MESSAGE_FLAGS_ANGLVEL;
             }
         } else {
-            fprintf(stderr, "While reading anglvel(z): %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading anglvel(z): %d\n", tmp_read);
             return tmp_read;
         }
     }
@@ -628,15 +1197,39 @@ int dev_iio_read_imu(const dev_iio_t *const iio, imu_message_t *const out) {
             out->temp_raw = strtol(&tmp[0], NULL, 10);
             out->temp_in_k = (double)out->temp_raw *iio->temp_scale;
         } else {
-            fprintf(stderr, "While reading temp: %d\n", tmp_read);
+            RING_LOG(RING_LOG_ERROR, "While reading temp: %d\n", tmp_read);
             return tmp_read;
         }
     }
 
-    
+    if (dev_iio_has_accel_sensor(iio)) {
+        FILE *const accel_sensor_fds[3] = { iio->accel_sensor_x_fd, iio->accel_sensor_y_fd, iio->accel_sensor_z_fd };
+        double accel_sensor_in[3];
+        for (int i = 0; i < 3; ++i) {
+            rewind(accel_sensor_fds[i]);
+            memset((void*)&tmp[0], 0, sizeof(tmp));
+            const int tmp_read = fread((void*)&tmp[0], 1, sizeof(tmp), accel_sensor_fds[i]);
+            if (tmp_read < 0) {
+                RING_LOG(RING_LOG_ERROR, "While reading the accelerometer: %d\n", tmp_read);
+                return tmp_read;
+            }
+
+            accel_sensor_in[i] = (double)strtol(&tmp[0], NULL, 10) * iio->accel_sensor_scale;
+        }
+
+        const double (*const mount_matrix)[3] = (const double (*)[3])iio->mount_matrix;
+        multiplyMatrixVector(mount_matrix, accel_sensor_in, out->accel_sensor_m2s);
+        out->flags |= IMU_MESSAGE_FLAGS_ACCEL_SENSOR;
+    }
+
+    if ((iio->gyro_calib != NULL) && ((out->flags & IMU_MESSAGE_FLAGS_ANGLVEL) != 0)) {
+        apply_gyro_calibration(iio, out, gyro_in);
+    }
 
-    multiplyMatrixVector(iio->mount_matrix, gyro_in, gyro_out);
-    multiplyMatrixVector(iio->mount_matrix, accel_in, accel_out);
+    // ISO C (before C23) does not convert double (*)[3] to const double (*)[3] implicitly
+    const double (*const mount_matrix)[3] = (const double (*)[3])iio->mount_matrix;
+    multiplyMatrixVector(mount_matrix, gyro_in, gyro_out);
+    multiplyMatrixVector(mount_matrix, accel_in, accel_out);
 
     memcpy(out->accel_m2s, accel_out, sizeof(double[3]));
     memcpy(out->gyro_rad_s, gyro_out, sizeof(double[3]));
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "imu_message.h"
+#include "gyro_calib.h"
 
 #define DEV_IIO_HAS_ACCEL   0x00000001U
 #define DEV_IIO_HAS_ANGLVEL 0x00000002U
@@ -8,6 +9,22 @@
 #define ACCEL_SCALE     ((double)(255.0)/(double)(9.81)) // convert m/s^2 to g's, and scale x255 to increase precision when passed to evdev as an int
 #define GYRO_SCALE      ((double)(180.0)/(double)(M_PI))  // convert radians/s to degrees/s
 
+#define DEV_IIO_BUFFER_LENGTH       128 // samples the kernel keeps in the IIO buffer
+#define DEV_IIO_BUFFER_READ_SAMPLES 16  // maximum samples fetched by a single read()
+
+/**
+ * Position and format of a channel inside a buffered scan, as described by scan_elements/in_*_type
+ */
+typedef struct dev_iio_scan_channel {
+    int enabled;
+    size_t offset;
+    uint8_t storage_bytes;
+    uint8_t bits;
+    uint8_t shift;
+    uint8_t is_signed;
+    uint8_t is_be;
+} dev_iio_scan_channel_t;
+
 typedef struct dev_iio {
     char* path;
     char* name;
@@ -43,9 +60,35 @@ typedef struct dev_iio {
     
     double outer_temp_scale;
 
+    // the accelerometer itself (in_accel_{x,y,z}_raw): the accel_* fields above keep the mapping the reports
+    // were tuned on, these only feed sensor fusion. accel_sensor_x_fd is NULL when the device has none.
+    FILE* accel_sensor_x_fd;
+    FILE* accel_sensor_y_fd;
+    FILE* accel_sensor_z_fd;
+
+    double accel_sensor_scale;
+
     double mount_matrix[3][3];
 
     double sampling_rate_hz;
+
+    // buffered capture from /dev/iio:deviceN: buf_fd is -1 when sysfs polling is in use
+    int buf_fd;
+    size_t scan_size;
+
+    dev_iio_scan_channel_t scan_accel[3];
+    dev_iio_scan_channel_t scan_accel_sensor[3];
+    dev_iio_scan_channel_t scan_anglvel[3];
+    dev_iio_scan_channel_t scan_temp;
+    dev_iio_scan_channel_t scan_timestamp;
+
+    uint8_t* scan_buf;
+    size_t scan_buf_count;
+    size_t scan_buf_next;
+
+    // NULL unless dev_iio_enable_gyro_calibration was called
+    gyro_calib_t* gyro_calib;
+    char* gyro_calib_path;
 } dev_iio_t;
 
 dev_iio_t* dev_iio_create(const char* path);
@@ -56,6 +99,24 @@ const char* dev_iio_get_name(const dev_iio_t* iio);
 
 const char* dev_iio_get_path(const dev_iio_t* iio);
 
+/**
+ * Switch to buffered capture through /dev/iio:deviceN: the trigger, scan elements and timestamp clock of the
+ * device are changed, so only call this on a device that is going to be used. On failure (returned as a
+ * negative errno) the device keeps being polled through sysfs.
+ */
+int dev_iio_enable_buffered(dev_iio_t *const iio);
+
+#if defined(ROGUE_ENEMY_BENCH)
+// directory holding the buffer device nodes, /dev unless rogue-enemy-bench (bench.c) points it at its fixture
+extern const char* dev_iio_bench_dev_dir;
+#endif
+
+/**
+ * Estimate the gyro bias while the device is still and subtract it from every sample: the estimate is
+ * loaded from and saved to a file named after the device inside dir.
+ */
+int dev_iio_enable_gyro_calibration(dev_iio_t *const iio, const char *const dir);
+
 inline int dev_iio_has_anglvel(const dev_iio_t* iio) {
     return (iio->flags & DEV_IIO_HAS_ANGLVEL) != 0;
 }
@@ -64,6 +125,28 @@ inline int dev_iio_has_accel(const dev_iio_t* iio) {
     return (iio->flags & DEV_IIO_HAS_ACCEL) != 0;
 }
 
+// whether samples carry a real accelerometer reading (IMU_MESSAGE_FLAGS_ACCEL_SENSOR)
+static inline int dev_iio_has_accel_sensor(const dev_iio_t* iio) {
+    if (iio->buf_fd >= 0) {
+        return iio->scan_accel_sensor[0].enabled && iio->scan_accel_sensor[1].enabled && iio->scan_accel_sensor[2].enabled;
+    }
+
+    return (iio->accel_sensor_x_fd != NULL) && (iio->accel_sensor_y_fd != NULL) && (iio->accel_sensor_z_fd != NULL);
+}
+
+static inline int dev_iio_is_buffered(const dev_iio_t* iio) {
+    return iio->buf_fd >= 0;
+}
+
+static inline int dev_iio_get_buffer_fd(const dev_iio_t* iio) {
+    return iio->buf_fd;
+}
+
+// scans fetched by the last read() of the buffer that dev_iio_read_imu has not returned yet
+static inline size_t dev_iio_buffered_pending(const dev_iio_t* iio) {
+    return iio->scan_buf_count - iio->scan_buf_next;
+}
+
 int dev_iio_read(
     const dev_iio_t *const iio,
     struct input_event *const buf,
@@ -72,6 +155,6 @@ int dev_iio_read(
 );
 
 int dev_iio_read_imu(
-    const dev_iio_t *const iio,
+    dev_iio_t *const iio,
     imu_message_t *const out
 );
@@ -0,0 +1,238 @@
+#include "gyro_calib.h"
+#include "logic.h"
+#include "ring_log.h"
+
+// fast running mean the stillness is measured against
+#define GYRO_CALIB_MEAN_ALPHA   0.05
+
+void gyro_calib_init(gyro_calib_t *const calib, const double scale[3]) {
+    memset(calib, 0, sizeof(gyro_calib_t));
+    atomic_init(&calib->snapshot_ready, 0);
+
+    for (int i = 0; i < 3; ++i) {
+        const double s = (scale[i] > 0.0) ? scale[i] : LSB_PER_RAD_S_2000_DEG_S;
+        calib->gyro_noise[i] = GYRO_CALIB_GYRO_NOISE_RAD_S / s;
+        calib->max_bias[i] = GYRO_CALIB_MAX_BIAS_RAD_S / s;
+    }
+}
+
+int gyro_calib_load(gyro_calib_t *const calib, const char *const path) {
+    FILE *const f = fopen(path, "rb");
+    if (f == NULL) {
+        return -errno;
+    }
+
+    gyro_calib_file_t file;
+    const size_t read_count = fread(&file, sizeof(file), 1, f);
+    fclose(f);
+
+    if (read_count != 1) {
+        fprintf(stderr, "Gyro calibration file %s is truncated: ignored\n", path);
+        return -EINVAL;
+    } else if ((memcmp(file.magic, GYRO_CALIB_FILE_MAGIC, sizeof(GYRO_CALIB_FILE_MAGIC)) != 0) || (file.version != GYRO_CALIB_FILE_VERSION)) {
+        fprintf(stderr, "Gyro calibration file %s has an unknown format: ignored\n", path);
+        return -EINVAL;
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        if ((!isfinite(file.bias[i])) || (fabs(file.bias[i]) > calib->max_bias[i])) {
+            fprintf(stderr, "Gyro calibration file %s holds an implausible bias: ignored\n", path);
+            return -EINVAL;
+        }
+    }
+
+    memcpy(calib->bias, file.bias, sizeof(calib->bias));
+    calib->samples = (file.samples < GYRO_CALIB_WINDOW_SAMPLES) ? file.samples : GYRO_CALIB_WINDOW_SAMPLES;
+
+    return 0;
+}
+
+static void fill_file(const gyro_calib_t *const calib, gyro_calib_file_t *const file) {
+    memset(file, 0, sizeof(gyro_calib_file_t));
+    memcpy(file->magic, GYRO_CALIB_FILE_MAGIC, sizeof(GYRO_CALIB_FILE_MAGIC));
+    file->version = GYRO_CALIB_FILE_VERSION;
+    memcpy(file->bias, calib->bias, sizeof(file->bias));
+    file->samples = calib->samples;
+}
+
+static int write_calib_file(const gyro_calib_file_t *const file, const char *const path) {
+    // written aside and renamed over the old one: a crash never leaves a half-written file
+    char tmp_path[512];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *const f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        const int res = -errno;
+        RING_LOG(RING_LOG_ERROR, "Unable to write the gyro calibration to %s: %d\n", tmp_path, res);
+        return res;
+    }
+
+    const size_t written = fwrite(file, sizeof(gyro_calib_file_t), 1, f);
+    const int close_res = fclose(f);
+    if ((written != 1) || (close_res != 0)) {
+        RING_LOG(RING_LOG_ERROR, "Unable to write the gyro calibration to %s\n", tmp_path);
+        unlink(tmp_path);
+        return -EIO;
+    }
+
+    if (rename(tmp_path, path) != 0) {
+        const int res = -errno;
+        RING_LOG(RING_LOG_ERROR, "Unable to replace the gyro calibration %s: %d\n", path, res);
+        unlink(tmp_path);
+        return res;
+    }
+
+    return 0;
+}
+
+int gyro_calib_save(gyro_calib_t *const calib, const char *const path) {
+    gyro_calib_file_t file;
+    fill_file(calib, &file);
+
+    const int res = write_calib_file(&file, path);
+    if (res == 0) {
+        calib->dirty = 0;
+    }
+
+    return res;
+}
+
+typedef struct gyro_calib_registration {
+    gyro_calib_t *calib;
+    const char *path;
+} gyro_calib_registration_t;
+
+// only taken by the saver and by (un)registration, never on the reader hot path
+static pthread_mutex_t registered_mutex = PTHREAD_MUTEX_INITIALIZER;
+static gyro_calib_registration_t registered[GYRO_CALIB_MAX_REGISTERED];
+
+int gyro_calib_register(gyro_calib_t *const calib, const char *const path) {
+    int res = -ENOSPC;
+
+    pthread_mutex_lock(&registered_mutex);
+    for (int i = 0; i < GYRO_CALIB_MAX_REGISTERED; ++i) {
+        if (registered[i].calib == NULL) {
+            registered[i].calib = calib;
+            registered[i].path = path;
+            res = 0;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registered_mutex);
+
+    return res;
+}
+
+void gyro_calib_unregister(gyro_calib_t *const calib) {
+    pthread_mutex_lock(&registered_mutex);
+    for (int i = 0; i < GYRO_CALIB_MAX_REGISTERED; ++i) {
+        if (registered[i].calib == calib) {
+            registered[i].calib = NULL;
+            registered[i].path = NULL;
+        }
+    }
+    pthread_mutex_unlock(&registered_mutex);
+}
+
+void gyro_calib_request_save(gyro_calib_t *const calib) {
+    // the saver still holds the previous snapshot: dirty stays set and the next save_due retries
+    if (atomic_load_explicit(&calib->snapshot_ready, memory_order_acquire)) {
+        return;
+    }
+
+    fill_file(calib, &calib->snapshot);
+    calib->dirty = 0;
+    atomic_store_explicit(&calib->snapshot_ready, 1, memory_order_release);
+}
+
+void *gyro_calib_saver_thread_func(void *ptr) {
+    logic_t *const logic = (logic_t*)ptr;
+
+    while (!logic_termination_requested(logic)) {
+        usleep(GYRO_CALIB_SAVER_CHECK_MS * 1000);
+
+        pthread_mutex_lock(&registered_mutex);
+        for (int i = 0; i < GYRO_CALIB_MAX_REGISTERED; ++i) {
+            gyro_calib_t *const calib = registered[i].calib;
+            if ((calib == NULL) || (!atomic_load_explicit(&calib->snapshot_ready, memory_order_acquire))) {
+                continue;
+            }
+
+            write_calib_file(&calib->snapshot, registered[i].path);
+            atomic_store_explicit(&calib->snapshot_ready, 0, memory_order_release);
+        }
+        pthread_mutex_unlock(&registered_mutex);
+    }
+
+    return NULL;
+}
+
+static int save_due(gyro_calib_t *const calib, uint64_t now_ms) {
+    if ((!calib->dirty) || ((now_ms - calib->last_save_ms) < (GYRO_CALIB_SAVE_INTERVAL_S * 1000ULL))) {
+        return 0;
+    }
+
+    calib->last_save_ms = now_ms;
+    return 1;
+}
+
+int gyro_calib_update(
+    gyro_calib_t *const calib,
+    const long gyro_raw[3],
+    const double *const accel_m2s,
+    const struct timeval *const time
+) {
+    const uint64_t now_ms = ((uint64_t)time->tv_sec * 1000ULL) + ((uint64_t)time->tv_usec / 1000ULL);
+    const double accel_norm = (accel_m2s != NULL) ?
+        sqrt((accel_m2s[0] * accel_m2s[0]) + (accel_m2s[1] * accel_m2s[1]) + (accel_m2s[2] * accel_m2s[2])) : 0.0;
+
+    if (!calib->has_mean) {
+        for (int i = 0; i < 3; ++i) {
+            calib->gyro_mean[i] = (double)gyro_raw[i];
+        }
+        calib->accel_mean = accel_norm;
+        calib->has_mean = 1;
+        calib->last_save_ms = now_ms;
+        return 0;
+    }
+
+    int still = (accel_m2s == NULL) || (fabs(accel_norm - calib->accel_mean) < GYRO_CALIB_ACCEL_NOISE_M2S);
+    for (int i = 0; i < 3; ++i) {
+        const double g = (double)gyro_raw[i];
+        still = still && (fabs(g - calib->gyro_mean[i]) < calib->gyro_noise[i]) && (fabs(calib->gyro_mean[i]) < calib->max_bias[i]);
+        calib->gyro_mean[i] += GYRO_CALIB_MEAN_ALPHA * (g - calib->gyro_mean[i]);
+    }
+    calib->accel_mean += GYRO_CALIB_MEAN_ALPHA * (accel_norm - calib->accel_mean);
+
+    if (!still) {
+        const int was_still = calib->still;
+        calib->still = 0;
+
+        // the device just got picked up: a good moment to persist what was learned while it was still
+        return (was_still) && (save_due(calib, now_ms));
+    }
+
+    // a clock stepping backwards restarts the settle time instead of skipping it
+    if ((!calib->still) || (now_ms < calib->still_since_ms)) {
+        calib->still = 1;
+        calib->still_since_ms = now_ms;
+    }
+
+    if ((now_ms - calib->still_since_ms) < GYRO_CALIB_SETTLE_MS) {
+        return 0;
+    }
+
+    // cumulative average for a fresh estimate, then a moving average over the window
+    if (calib->samples < GYRO_CALIB_WINDOW_SAMPLES) {
+        ++calib->samples;
+    }
+
+    const double gain = 1.0 / (double)calib->samples;
+    for (int i = 0; i < 3; ++i) {
+        calib->bias[i] += gain * ((double)gyro_raw[i] - calib->bias[i]);
+    }
+    calib->dirty = 1;
+
+    // left still for a long time: do not wait for it to be picked up
+    return save_due(calib, now_ms);
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "rogue_enemy.h"
+
+#define GYRO_CALIB_FILE_MAGIC           "RGEGYRO"
+#define GYRO_CALIB_FILE_VERSION         1
+
+#define GYRO_CALIB_GYRO_NOISE_RAD_S     0.02    // max deviation from the running mean for a still device
+#define GYRO_CALIB_ACCEL_NOISE_M2S      0.25    // max change of the acceleration magnitude for a still device
+#define GYRO_CALIB_MAX_BIAS_RAD_S       0.1     // a steadier rotation than this is real motion, not drift
+#define GYRO_CALIB_SETTLE_MS            500     // stillness required before samples are trusted
+#define GYRO_CALIB_WINDOW_SAMPLES       2000    // the estimate averages (about) the last still samples
+#define GYRO_CALIB_SAVE_INTERVAL_S      60
+#define GYRO_CALIB_MAX_REGISTERED       4
+#define GYRO_CALIB_SAVER_CHECK_MS       1000
+
+typedef struct gyro_calib_file {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    double bias[3];
+    uint64_t samples;
+} __attribute__((packed)) gyro_calib_file_t;
+
+/*
+ * Running gyro bias estimate, in sensor counts: samples are accumulated only while the device is still
+ * (gyro close to its running mean, acceleration magnitude steady) and the estimate is subtracted from
+ * every gyro sample.
+ */
+typedef struct gyro_calib {
+    double bias[3];
+    uint64_t samples;
+
+    // noise thresholds converted to sensor counts
+    double gyro_noise[3];
+    double max_bias[3];
+
+    double gyro_mean[3];
+    double accel_mean;
+    int has_mean;
+
+    uint64_t still_since_ms;
+    int still;
+
+    int dirty;
+    uint64_t last_save_ms;
+
+    // handed to gyro_calib_saver_thread_func: written by the reader while ready is 0, read by the saver while it is 1
+    gyro_calib_file_t snapshot;
+    atomic_int snapshot_ready;
+} gyro_calib_t;
+
+/**
+ * scale: rad/s of one count for each axis
+ */
+void gyro_calib_init(gyro_calib_t *const calib, const double scale[3]);
+
+int gyro_calib_load(gyro_calib_t *const calib, const char *const path);
+
+/**
+ * Write the estimate to path right away: not for the reader thread, see gyro_calib_request_save.
+ */
+int gyro_calib_save(gyro_calib_t *const calib, const char *const path);
+
+/**
+ * Let gyro_calib_saver_thread_func persist calib to path: path must outlive the registration.
+ */
+int gyro_calib_register(gyro_calib_t *const calib, const char *const path);
+
+/**
+ * After this returns the saver no longer touches calib: a snapshot not saved yet is left in calib->snapshot_ready.
+ */
+void gyro_calib_unregister(gyro_calib_t *const calib);
+
+/**
+ * Called by the reader when gyro_calib_update returns 1: hands a copy of the estimate to the saver, no I/O.
+ */
+void gyro_calib_request_save(gyro_calib_t *const calib);
+
+/**
+ * Writes the requested snapshots of the registered estimates until termination is requested: file I/O
+ * stays off the (possibly real-time) IMU reader threads.
+ */
+void *gyro_calib_saver_thread_func(void *ptr);
+
+/**
+ * Feed a gyro sample and the accelerometer reading taken with it, NULL when the device has no accelerometer:
+ * stillness is then judged on the gyro alone. Returns 1 when the estimate changed enough time after the last
+ * save that it should be persisted again.
+ */
+int gyro_calib_update(
+    gyro_calib_t *const calib,
+    const long gyro_raw[3],
+    const double *const accel_m2s,
+    const struct timeval *const time
+);
@@ -0,0 +1,90 @@
+#include "gyro_mouse.h"
+
+// samples further apart than this (or out of order) do not move the pointer
+#define GYRO_MOUSE_MAX_DT_S     0.1
+
+#define RAD_TO_DEG              ((double)(180.0) / (double)(M_PI))
+
+void gyro_mouse_init(gyro_mouse_t *const gm, const controller_settings_t *const settings) {
+    memset(gm, 0, sizeof(gyro_mouse_t));
+
+    gyro_mouse_configure(gm, settings);
+}
+
+void gyro_mouse_configure(gyro_mouse_t *const gm, const controller_settings_t *const settings) {
+    gm->mode = (gyro_mouse_mode_t)settings->gyro_mouse;
+    gm->sensitivity = settings->gyro_mouse_sensitivity;
+    gm->min_sensitivity = settings->gyro_mouse_min_sensitivity;
+    gm->slow_dps = settings->gyro_mouse_slow_dps;
+    gm->fast_dps = settings->gyro_mouse_fast_dps;
+    gm->deadzone_dps = settings->gyro_mouse_deadzone_dps;
+}
+
+int gyro_mouse_active(const gyro_mouse_t *const gm) {
+    switch (gm->mode) {
+        case GYRO_MOUSE_ALWAYS:
+            return 1;
+        case GYRO_MOUSE_HOLD:
+            return (gm->hold_buttons > 0) || (gm->gyro_mode > 0);
+        default:
+            return 0;
+    }
+}
+
+static double sensitivity_at(const gyro_mouse_t *const gm, double speed_dps) {
+    if (gm->fast_dps <= gm->slow_dps) {
+        return gm->sensitivity;
+    }
+
+    double t = (speed_dps - gm->slow_dps) / (gm->fast_dps - gm->slow_dps);
+    t = (t < 0.0) ? 0.0 : ((t > 1.0) ? 1.0 : t);
+
+    return gm->min_sensitivity + ((gm->sensitivity - gm->min_sensitivity) * t);
+}
+
+int gyro_mouse_update(
+    gyro_mouse_t *const gm,
+    const double gyro[3],
+    const struct timeval *const time,
+    int32_t *const dx,
+    int32_t *const dy
+) {
+    const int had_time = gm->has_time;
+    const struct timeval last_time = gm->last_time;
+    gm->last_time = *time;
+    gm->has_time = 1;
+
+    if (!gyro_mouse_active(gm)) {
+        gm->remainder[0] = gm->remainder[1] = 0.0;
+        return 0;
+    }
+
+    const double dt = had_time ?
+        ((double)(time->tv_sec - last_time.tv_sec) + ((double)(time->tv_usec - last_time.tv_usec) / 1000000.0)) : 0.0;
+    if ((dt <= 0.0) || (dt > GYRO_MOUSE_MAX_DT_S)) {
+        return 0;
+    }
+
+    // yaw (around y, up) and pitch (around x, right): positive is turning left and tilting up
+    const double yaw_dps = gyro[1] * RAD_TO_DEG;
+    const double pitch_dps = gyro[0] * RAD_TO_DEG;
+    const double speed_dps = sqrt((yaw_dps * yaw_dps) + (pitch_dps * pitch_dps));
+
+    double scale = sensitivity_at(gm, speed_dps) * dt;
+    if ((gm->deadzone_dps > 0.0) && (speed_dps < gm->deadzone_dps)) {
+        scale *= speed_dps / gm->deadzone_dps;
+    }
+
+    gm->remainder[0] += -yaw_dps * scale;
+    gm->remainder[1] += -pitch_dps * scale;
+
+    const double move_x = trunc(gm->remainder[0]);
+    const double move_y = trunc(gm->remainder[1]);
+    gm->remainder[0] -= move_x;
+    gm->remainder[1] -= move_y;
+
+    *dx = (int32_t)move_x;
+    *dy = (int32_t)move_y;
+
+    return (*dx != 0) || (*dy != 0);
+}
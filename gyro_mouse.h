@@ -0,0 +1,57 @@
+#pragma once
+
+#include "settings.h"
+
+typedef enum gyro_mouse_mode {
+    GYRO_MOUSE_OFF = 0,
+    GYRO_MOUSE_HOLD,        // only while a gyro-mouse button is held
+    GYRO_MOUSE_ALWAYS,
+} gyro_mouse_mode_t;
+
+/*
+ * Turns every gyro sample into relative mouse motion: yaw moves the pointer horizontally and pitch
+ * vertically, with a sensitivity blended between min_sensitivity (slow, precise movements) and
+ * sensitivity (fast flicks), both in pixels per degree.
+ */
+typedef struct gyro_mouse {
+    gyro_mouse_mode_t mode;
+
+    double sensitivity;
+    double min_sensitivity;
+    double slow_dps;
+    double fast_dps;
+
+    // below this speed the motion is scaled down smoothly instead of cut: hides the sensor noise
+    double deadzone_dps;
+
+    // buttons currently holding the gyro mouse active (back buttons and the gyro key)
+    int hold_buttons;
+    int gyro_mode;
+
+    // sub-pixel motion carried over to the next sample
+    double remainder[2];
+
+    struct timeval last_time;
+    int has_time;
+} gyro_mouse_t;
+
+void gyro_mouse_init(gyro_mouse_t *const gm, const controller_settings_t *const settings);
+
+/**
+ * Apply new settings keeping the held buttons and the sub-pixel remainder.
+ */
+void gyro_mouse_configure(gyro_mouse_t *const gm, const controller_settings_t *const settings);
+
+int gyro_mouse_active(const gyro_mouse_t *const gm);
+
+/**
+ * Feed a gyro sample (rad/s, imu_message_t frame) read at time: returns 1 if the pointer moved by at
+ * least a pixel, with the movement in dx and dy.
+ */
+int gyro_mouse_update(
+    gyro_mouse_t *const gm,
+    const double gyro[3],
+    const struct timeval *const time,
+    int32_t *const dx,
+    int32_t *const dy
+);
@@ -0,0 +1,200 @@
+#include "hotplug.h"
+#include "logic.h"
+
+#include <libudev.h>
+#include <poll.h>
+
+static const char *const hotplug_subsystem_names[HOTPLUG_SUBSYSTEM_COUNT] = {
+    [HOTPLUG_SUBSYSTEM_INPUT] = "input",
+    [HOTPLUG_SUBSYSTEM_IIO] = "iio",
+    [HOTPLUG_SUBSYSTEM_HIDRAW] = "hidraw",
+};
+
+int hotplug_init(hotplug_t *const hotplug) {
+    memset(hotplug, 0, sizeof(hotplug_t));
+
+    pthread_mutex_init(&hotplug->mutex, NULL);
+
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&hotplug->changed, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    hotplug->udev = udev_new();
+    if (hotplug->udev == NULL) {
+        fprintf(stderr, "Unable to create the udev context: devices will be searched every %d ms\n", HOTPLUG_FALLBACK_RESCAN_MS);
+        return -ENODEV;
+    }
+
+    // "udev" rather than "kernel": events arrive once rules ran and the device node is usable
+    hotplug->monitor = udev_monitor_new_from_netlink(hotplug->udev, "udev");
+    if (hotplug->monitor == NULL) {
+        fprintf(stderr, "Unable to create the udev monitor: devices will be searched every %d ms\n", HOTPLUG_FALLBACK_RESCAN_MS);
+        goto hotplug_init_err;
+    }
+
+    for (int i = 0; i < HOTPLUG_SUBSYSTEM_COUNT; ++i) {
+        if (udev_monitor_filter_add_match_subsystem_devtype(hotplug->monitor, hotplug_subsystem_names[i], NULL) < 0) {
+            fprintf(stderr, "Unable to watch the %s subsystem\n", hotplug_subsystem_names[i]);
+        }
+    }
+
+    if (udev_monitor_enable_receiving(hotplug->monitor) < 0) {
+        fprintf(stderr, "Unable to receive udev events: devices will be searched every %d ms\n", HOTPLUG_FALLBACK_RESCAN_MS);
+        udev_monitor_unref(hotplug->monitor);
+        hotplug->monitor = NULL;
+        goto hotplug_init_err;
+    }
+
+    return 0;
+
+hotplug_init_err:
+    udev_unref(hotplug->udev);
+    hotplug->udev = NULL;
+    return -ENODEV;
+}
+
+void hotplug_destroy(hotplug_t *const hotplug) {
+    if (hotplug->monitor != NULL) {
+        udev_monitor_unref(hotplug->monitor);
+        hotplug->monitor = NULL;
+    }
+
+    if (hotplug->udev != NULL) {
+        udev_unref(hotplug->udev);
+        hotplug->udev = NULL;
+    }
+
+    pthread_cond_destroy(&hotplug->changed);
+    pthread_mutex_destroy(&hotplug->mutex);
+}
+
+int hotplug_get_fd(const hotplug_t *const hotplug) {
+    return (hotplug->monitor != NULL) ? udev_monitor_get_fd(hotplug->monitor) : -1;
+}
+
+void hotplug_set_callback(hotplug_t *const hotplug, hotplug_callback_t callback, void *user_data) {
+    pthread_mutex_lock(&hotplug->mutex);
+    hotplug->callback = callback;
+    hotplug->user_data = user_data;
+    pthread_mutex_unlock(&hotplug->mutex);
+}
+
+static int hotplug_subsystem_from_name(const char* name) {
+    for (int i = 0; (name != NULL) && (i < HOTPLUG_SUBSYSTEM_COUNT); ++i) {
+        if (strcmp(name, hotplug_subsystem_names[i]) == 0) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+int hotplug_dispatch(hotplug_t *const hotplug) {
+    if (hotplug->monitor == NULL) {
+        return 0;
+    }
+
+    int dispatched = 0;
+
+    struct udev_device *dev;
+    while ((dev = udev_monitor_receive_device(hotplug->monitor)) != NULL) {
+        const int subsystem = hotplug_subsystem_from_name(udev_device_get_subsystem(dev));
+        const char *const action_name = udev_device_get_action(dev);
+        const char *const devnode = udev_device_get_devnode(dev);
+
+        // parents without a node (i.e. input/inputN for input/eventN) and "change"/"bind" events are of no use
+        hotplug_action_t action;
+        int relevant = (subsystem >= 0) && (action_name != NULL);
+        if ((relevant) && (strcmp(action_name, "add") == 0)) {
+            action = HOTPLUG_ACTION_ADD;
+        } else if ((relevant) && (strcmp(action_name, "remove") == 0)) {
+            action = HOTPLUG_ACTION_REMOVE;
+        } else {
+            relevant = 0;
+        }
+
+        // iio devices have no node when only their sysfs attributes are exported: they count anyway
+        if ((subsystem != HOTPLUG_SUBSYSTEM_IIO) && (devnode == NULL)) {
+            relevant = 0;
+        }
+
+        if (relevant) {
+            pthread_mutex_lock(&hotplug->mutex);
+            if (action == HOTPLUG_ACTION_ADD) {
+                ++hotplug->generation[subsystem];
+                pthread_cond_broadcast(&hotplug->changed);
+            }
+            const hotplug_callback_t callback = hotplug->callback;
+            void *const user_data = hotplug->user_data;
+            pthread_mutex_unlock(&hotplug->mutex);
+
+            printf("hotplug: %s %s %s\n", action_name, hotplug_subsystem_names[subsystem], (devnode != NULL) ? devnode : udev_device_get_syspath(dev));
+
+            if (callback != NULL) {
+                callback((hotplug_subsystem_t)subsystem, action, devnode, user_data);
+            }
+
+            ++dispatched;
+        }
+
+        udev_device_unref(dev);
+    }
+
+    return dispatched;
+}
+
+unsigned hotplug_generation(hotplug_t *const hotplug, hotplug_subsystem_t subsystem) {
+    pthread_mutex_lock(&hotplug->mutex);
+    const unsigned generation = hotplug->generation[subsystem];
+    pthread_mutex_unlock(&hotplug->mutex);
+
+    return generation;
+}
+
+void hotplug_wait(hotplug_t *const hotplug, hotplug_subsystem_t subsystem, unsigned seen_generation) {
+    pthread_mutex_lock(&hotplug->mutex);
+    const int monitored = (hotplug->monitor != NULL) && (!hotplug->stopped);
+    while ((monitored) && (hotplug->generation[subsystem] == seen_generation) && (!hotplug->stopped)) {
+        pthread_cond_wait(&hotplug->changed, &hotplug->mutex);
+    }
+    pthread_mutex_unlock(&hotplug->mutex);
+
+    // nobody is going to wake us up: look for the device again a bit later
+    if (!monitored) {
+        usleep(HOTPLUG_FALLBACK_RESCAN_MS * 1000);
+    }
+}
+
+void hotplug_stop(hotplug_t *const hotplug) {
+    pthread_mutex_lock(&hotplug->mutex);
+    hotplug->stopped = 1;
+    pthread_cond_broadcast(&hotplug->changed);
+    pthread_mutex_unlock(&hotplug->mutex);
+}
+
+void *hotplug_thread_func(void *ptr) {
+    logic_t *const logic = (logic_t*)ptr;
+    hotplug_t *const hotplug = &logic->hotplug;
+
+    struct pollfd pfd = {
+        .fd = hotplug_get_fd(hotplug),
+        .events = POLLIN,
+        .revents = 0,
+    };
+
+    while ((pfd.fd >= 0) && (!logic_termination_requested(logic))) {
+        const int poll_res = poll(&pfd, 1, HOTPLUG_TERMINATION_CHECK_MS);
+        if (poll_res > 0) {
+            hotplug_dispatch(hotplug);
+        } else if ((poll_res < 0) && (errno != EINTR)) {
+            fprintf(stderr, "Error waiting for udev events: %d\n", errno);
+            break;
+        }
+    }
+
+    hotplug_stop(hotplug);
+
+    return NULL;
+}
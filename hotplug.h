@@ -0,0 +1,78 @@
+#pragma once
+
+#include "rogue_enemy.h"
+
+// without a udev monitor the waiters fall back to rescanning at this interval
+#define HOTPLUG_FALLBACK_RESCAN_MS 250
+
+// how often the monitor thread checks for termination while no device comes or goes
+#define HOTPLUG_TERMINATION_CHECK_MS 1000
+
+typedef enum hotplug_subsystem {
+    HOTPLUG_SUBSYSTEM_INPUT = 0,
+    HOTPLUG_SUBSYSTEM_IIO,
+    HOTPLUG_SUBSYSTEM_HIDRAW,
+
+    HOTPLUG_SUBSYSTEM_COUNT,
+} hotplug_subsystem_t;
+
+typedef enum hotplug_action {
+    HOTPLUG_ACTION_ADD,
+    HOTPLUG_ACTION_REMOVE,
+} hotplug_action_t;
+
+struct udev;
+struct udev_monitor;
+
+typedef void (*hotplug_callback_t)(hotplug_subsystem_t subsystem, hotplug_action_t action, const char* devnode, void* user_data);
+
+/**
+ * Device add/remove notifications from udev (netlink), replacing periodic rescans of /dev and /sys.
+ *
+ * Readers running on their own thread sleep in hotplug_wait until a device of their subsystem appears,
+ * the reactor puts hotplug_get_fd in its epoll set and calls hotplug_dispatch when it becomes readable.
+ */
+typedef struct hotplug {
+    struct udev *udev;
+
+    // NULL if udev is unavailable: waiters then rescan every HOTPLUG_FALLBACK_RESCAN_MS
+    struct udev_monitor *monitor;
+
+    hotplug_callback_t callback;
+    void *user_data;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t changed;
+    unsigned generation[HOTPLUG_SUBSYSTEM_COUNT];
+    int stopped;
+} hotplug_t;
+
+int hotplug_init(hotplug_t *const hotplug);
+
+void hotplug_destroy(hotplug_t *const hotplug);
+
+// udev monitor fd (non-blocking) or -1 when running without udev
+int hotplug_get_fd(const hotplug_t *const hotplug);
+
+// callback invoked (from the dispatching thread) for every add/remove: only one can be set
+void hotplug_set_callback(hotplug_t *const hotplug, hotplug_callback_t callback, void *user_data);
+
+// consume every pending udev event: returns the number of events dispatched
+int hotplug_dispatch(hotplug_t *const hotplug);
+
+/**
+ * Read the number of devices added so far to subsystem: take it before looking for a device
+ * and pass it to hotplug_wait so that a device appearing in between is not missed.
+ */
+unsigned hotplug_generation(hotplug_t *const hotplug, hotplug_subsystem_t subsystem);
+
+// sleep until a device is added to subsystem after seen_generation (or the monitor stops)
+void hotplug_wait(hotplug_t *const hotplug, hotplug_subsystem_t subsystem, unsigned seen_generation);
+
+// wake every waiter for good: used on termination
+void hotplug_stop(hotplug_t *const hotplug);
+
+/**
+ * Dispatch udev events until termination is requested on the logic_t passed as ptr.
+ */
+void *hotplug_thread_func(void *ptr);
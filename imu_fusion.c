@@ -0,0 +1,272 @@
+#include "imu_fusion.h"
+
+static double inv_norm3(const double v[3]) {
+    const double n = sqrt((v[0] * v[0]) + (v[1] * v[1]) + (v[2] * v[2]));
+    return (n > 0.0) ? (1.0 / n) : 0.0;
+}
+
+static void normalize_q(double q[4]) {
+    const double n = sqrt((q[0] * q[0]) + (q[1] * q[1]) + (q[2] * q[2]) + (q[3] * q[3]));
+    if (n > 0.0) {
+        q[0] /= n;
+        q[1] /= n;
+        q[2] /= n;
+        q[3] /= n;
+    } else {
+        q[0] = 1.0;
+        q[1] = q[2] = q[3] = 0.0;
+    }
+}
+
+static double dot3(const double a[3], const double b[3]) {
+    return (a[0] * b[0]) + (a[1] * b[1]) + (a[2] * b[2]);
+}
+
+static void cross3(const double a[3], const double b[3], double out[3]) {
+    out[0] = (a[1] * b[2]) - (a[2] * b[1]);
+    out[1] = (a[2] * b[0]) - (a[0] * b[2]);
+    out[2] = (a[0] * b[1]) - (a[1] * b[0]);
+}
+
+// horizontal component of axis (the part orthogonal to up), normalized: 0 if axis is (almost) vertical
+static int horizontal_axis(const double axis[3], const double up[3], double out[3]) {
+    const double d = dot3(axis, up);
+    for (int i = 0; i < 3; ++i) {
+        out[i] = axis[i] - (d * up[i]);
+    }
+
+    const double n2 = dot3(out, out);
+    if (n2 < 0.01) {
+        return 0;
+    }
+
+    const double inv = 1.0 / sqrt(n2);
+    for (int i = 0; i < 3; ++i) {
+        out[i] *= inv;
+    }
+
+    return 1;
+}
+
+void imu_fusion_init(imu_fusion_t *const fusion, const controller_settings_t *const settings) {
+    memset(fusion, 0, sizeof(imu_fusion_t));
+
+    fusion->q[0] = 1.0;
+
+    imu_fusion_configure(fusion, settings);
+}
+
+void imu_fusion_configure(imu_fusion_t *const fusion, const controller_settings_t *const settings) {
+    fusion->algorithm = (imu_fusion_algorithm_t)settings->imu_fusion;
+    fusion->space = (imu_motion_space_t)settings->imu_motion_space;
+    fusion->report_gravity = settings->imu_report_gravity;
+    fusion->beta = settings->imu_fusion_beta;
+    fusion->kp = settings->imu_fusion_kp;
+    fusion->ki = settings->imu_fusion_ki;
+}
+
+int imu_fusion_enabled(const imu_fusion_t *const fusion) {
+    return fusion->algorithm != IMU_FUSION_OFF;
+}
+
+// start from the attitude given by gravity alone instead of converging from an arbitrary one
+static void seed_orientation(imu_fusion_t *const fusion) {
+    const double inv = inv_norm3(fusion->accel);
+    if (inv == 0.0) {
+        return;
+    }
+
+    const double a[3] = { fusion->accel[0] * inv, fusion->accel[1] * inv, fusion->accel[2] * inv };
+
+    // shortest rotation bringing the measured up direction onto the earth z axis
+    if (a[2] < -0.999999) {
+        fusion->q[0] = 0.0;
+        fusion->q[1] = 1.0;
+        fusion->q[2] = 0.0;
+        fusion->q[3] = 0.0;
+    } else {
+        fusion->q[0] = 1.0 + a[2];
+        fusion->q[1] = a[1];
+        fusion->q[2] = -a[0];
+        fusion->q[3] = 0.0;
+        normalize_q(fusion->q);
+    }
+
+    fusion->has_orientation = 1;
+}
+
+void imu_fusion_update_accel(imu_fusion_t *const fusion, const double accel[3]) {
+    memcpy(fusion->accel, accel, sizeof(double[3]));
+    fusion->has_accel = 1;
+
+    if (!fusion->has_orientation) {
+        seed_orientation(fusion);
+    }
+}
+
+static void madgwick_update(imu_fusion_t *const fusion, double gx, double gy, double gz, double dt) {
+    double *const q = fusion->q;
+    const double q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+
+    // rate of change of the quaternion from the gyroscope
+    double qd0 = 0.5 * ((-q1 * gx) - (q2 * gy) - (q3 * gz));
+    double qd1 = 0.5 * ((q0 * gx) + (q2 * gz) - (q3 * gy));
+    double qd2 = 0.5 * ((q0 * gy) - (q1 * gz) + (q3 * gx));
+    double qd3 = 0.5 * ((q0 * gz) + (q1 * gy) - (q2 * gx));
+
+    const double inv = fusion->has_accel ? inv_norm3(fusion->accel) : 0.0;
+    if (inv != 0.0) {
+        const double ax = fusion->accel[0] * inv, ay = fusion->accel[1] * inv, az = fusion->accel[2] * inv;
+
+        const double _2q0 = 2.0 * q0, _2q1 = 2.0 * q1, _2q2 = 2.0 * q2, _2q3 = 2.0 * q3;
+        const double _4q0 = 4.0 * q0, _4q1 = 4.0 * q1, _4q2 = 4.0 * q2;
+        const double _8q1 = 8.0 * q1, _8q2 = 8.0 * q2;
+        const double q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+        // gradient of the error between the measured and the estimated gravity direction
+        double s0 = (_4q0 * q2q2) + (_2q2 * ax) + (_4q0 * q1q1) - (_2q1 * ay);
+        double s1 = (_4q1 * q3q3) - (_2q3 * ax) + (4.0 * q0q0 * q1) - (_2q0 * ay) - _4q1 + (_8q1 * q1q1) + (_8q1 * q2q2) + (_4q1 * az);
+        double s2 = (4.0 * q0q0 * q2) + (_2q0 * ax) + (_4q2 * q3q3) - (_2q3 * ay) - _4q2 + (_8q2 * q1q1) + (_8q2 * q2q2) + (_4q2 * az);
+        double s3 = (4.0 * q1q1 * q3) - (_2q1 * ax) + (4.0 * q2q2 * q3) - (_2q2 * ay);
+
+        const double sn = sqrt((s0 * s0) + (s1 * s1) + (s2 * s2) + (s3 * s3));
+        if (sn > 0.0) {
+            qd0 -= fusion->beta * (s0 / sn);
+            qd1 -= fusion->beta * (s1 / sn);
+            qd2 -= fusion->beta * (s2 / sn);
+            qd3 -= fusion->beta * (s3 / sn);
+        }
+    }
+
+    q[0] += qd0 * dt;
+    q[1] += qd1 * dt;
+    q[2] += qd2 * dt;
+    q[3] += qd3 * dt;
+    normalize_q(q);
+}
+
+static void mahony_update(imu_fusion_t *const fusion, double gx, double gy, double gz, double dt) {
+    double *const q = fusion->q;
+
+    const double inv = fusion->has_accel ? inv_norm3(fusion->accel) : 0.0;
+    if (inv != 0.0) {
+        const double ax = fusion->accel[0] * inv, ay = fusion->accel[1] * inv, az = fusion->accel[2] * inv;
+
+        // estimated direction of gravity (half of it)
+        const double hvx = (q[1] * q[3]) - (q[0] * q[2]);
+        const double hvy = (q[0] * q[1]) + (q[2] * q[3]);
+        const double hvz = (q[0] * q[0]) - 0.5 + (q[3] * q[3]);
+
+        // error: cross product between the measured and the estimated direction
+        const double hex = (ay * hvz) - (az * hvy);
+        const double hey = (az * hvx) - (ax * hvz);
+        const double hez = (ax * hvy) - (ay * hvx);
+
+        if (fusion->ki > 0.0) {
+            fusion->integral[0] += 2.0 * fusion->ki * hex * dt;
+            fusion->integral[1] += 2.0 * fusion->ki * hey * dt;
+            fusion->integral[2] += 2.0 * fusion->ki * hez * dt;
+            gx += fusion->integral[0];
+            gy += fusion->integral[1];
+            gz += fusion->integral[2];
+        } else {
+            fusion->integral[0] = fusion->integral[1] = fusion->integral[2] = 0.0;
+        }
+
+        gx += 2.0 * fusion->kp * hex;
+        gy += 2.0 * fusion->kp * hey;
+        gz += 2.0 * fusion->kp * hez;
+    }
+
+    gx *= 0.5 * dt;
+    gy *= 0.5 * dt;
+    gz *= 0.5 * dt;
+
+    const double qa = q[0], qb = q[1], qc = q[2];
+    q[0] += (-qb * gx) - (qc * gy) - (q[3] * gz);
+    q[1] += (qa * gx) + (qc * gz) - (q[3] * gy);
+    q[2] += (qa * gy) - (qb * gz) + (q[3] * gx);
+    q[3] += (qa * gz) + (qb * gy) - (qc * gx);
+    normalize_q(q);
+}
+
+void imu_fusion_update_gyro(imu_fusion_t *const fusion, const double gyro[3], const struct timeval *const time) {
+    if (!fusion->has_gyro_time) {
+        fusion->last_gyro_time = *time;
+        fusion->has_gyro_time = 1;
+        return;
+    }
+
+    const double dt =
+        (double)(time->tv_sec - fusion->last_gyro_time.tv_sec) +
+        ((double)(time->tv_usec - fusion->last_gyro_time.tv_usec) / 1000000.0);
+    fusion->last_gyro_time = *time;
+
+    if ((dt <= 0.0) || (dt > IMU_FUSION_MAX_DT_S)) {
+        return;
+    }
+
+    if (fusion->algorithm == IMU_FUSION_MADGWICK) {
+        madgwick_update(fusion, gyro[0], gyro[1], gyro[2], dt);
+    } else if (fusion->algorithm == IMU_FUSION_MAHONY) {
+        mahony_update(fusion, gyro[0], gyro[1], gyro[2], dt);
+    }
+
+    fusion->has_orientation = 1;
+}
+
+void imu_fusion_gravity(const imu_fusion_t *const fusion, double up[3]) {
+    const double *const q = fusion->q;
+
+    // earth z axis expressed in the sensor frame
+    up[0] = 2.0 * ((q[1] * q[3]) - (q[0] * q[2]));
+    up[1] = 2.0 * ((q[0] * q[1]) + (q[2] * q[3]));
+    up[2] = (q[0] * q[0]) - (q[1] * q[1]) - (q[2] * q[2]) + (q[3] * q[3]);
+}
+
+void imu_fusion_motion(
+    const imu_fusion_t *const fusion,
+    const double gyro[3],
+    const double accel[3],
+    double gyro_out[3],
+    double accel_out[3]
+) {
+    double up[3];
+    imu_fusion_gravity(fusion, up);
+
+    double accel_src[3];
+    if (fusion->report_gravity) {
+        for (int i = 0; i < 3; ++i) {
+            accel_src[i] = up[i] * IMU_FUSION_STANDARD_GRAVITY;
+        }
+    } else {
+        memcpy(accel_src, accel, sizeof(double[3]));
+    }
+
+    if (fusion->space == IMU_MOTION_SPACE_LOCAL) {
+        memcpy(gyro_out, gyro, sizeof(double[3]));
+        memcpy(accel_out, accel_src, sizeof(double[3]));
+        return;
+    }
+
+    // world space: keep the device right axis (or, lying on a side, the towards-player one) and level it
+    static const double device_right[3] = { 1.0, 0.0, 0.0 };
+    static const double device_back[3] = { 0.0, 0.0, 1.0 };
+
+    double right[3], back[3];
+    if (horizontal_axis(device_right, up, right)) {
+        cross3(right, up, back);
+    } else {
+        horizontal_axis(device_back, up, back);
+        cross3(up, back, right);
+    }
+
+    // pitch around the levelled right axis, yaw around gravity, roll around the levelled forward axis
+    gyro_out[0] = dot3(gyro, right);
+    gyro_out[1] = dot3(gyro, up);
+    gyro_out[2] = dot3(gyro, back);
+
+    accel_out[0] = dot3(accel_src, right);
+    accel_out[1] = dot3(accel_src, up);
+    accel_out[2] = dot3(accel_src, back);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "settings.h"
+
+#define IMU_FUSION_STANDARD_GRAVITY     9.80665
+
+// gyro samples further apart than this (or out of order) restart the integration instead of jumping
+#define IMU_FUSION_MAX_DT_S             0.1
+
+typedef enum imu_fusion_algorithm {
+    IMU_FUSION_OFF = 0,
+    IMU_FUSION_MADGWICK,
+    IMU_FUSION_MAHONY,
+} imu_fusion_algorithm_t;
+
+typedef enum imu_motion_space {
+    IMU_MOTION_SPACE_LOCAL = 0,     // gyro/accel axes fixed to the device
+    IMU_MOTION_SPACE_WORLD,         // yaw around gravity and roll around the horizontal forward axis, whatever the grip
+} imu_motion_space_t;
+
+/*
+ * 6-axis orientation filter fed at the full IMU rate by the output thread.
+ *
+ * Vectors use the frame of imu_message_t: x right, y up, z towards the player, gyro in rad/s following the
+ * right-hand rule and accel in m/s^2.
+ */
+typedef struct imu_fusion {
+    imu_fusion_algorithm_t algorithm;
+    imu_motion_space_t space;
+    int report_gravity;
+
+    double beta;            // Madgwick gradient-descent gain
+    double kp;              // Mahony proportional gain
+    double ki;              // Mahony integral gain
+
+    double q[4];            // w, x, y, z: rotation from the sensor frame to the earth frame (z up)
+    double integral[3];     // Mahony integral feedback, rad/s
+
+    double accel[3];        // latest accelerometer sample
+    int has_accel;          // the filter stays unused until the first accelerometer sample
+    int no_accel_logged;
+    int has_orientation;
+
+    struct timeval last_gyro_time;
+    int has_gyro_time;
+} imu_fusion_t;
+
+void imu_fusion_init(imu_fusion_t *const fusion, const controller_settings_t *const settings);
+
+/**
+ * Apply new settings keeping the current orientation.
+ */
+void imu_fusion_configure(imu_fusion_t *const fusion, const controller_settings_t *const settings);
+
+int imu_fusion_enabled(const imu_fusion_t *const fusion);
+
+void imu_fusion_update_accel(imu_fusion_t *const fusion, const double accel[3]);
+
+/**
+ * Integrate a gyro sample read at time: the latest accelerometer sample corrects the drift.
+ */
+void imu_fusion_update_gyro(imu_fusion_t *const fusion, const double gyro[3], const struct timeval *const time);
+
+/**
+ * Unit vector pointing up (opposite to gravity), in the sensor frame.
+ */
+void imu_fusion_gravity(const imu_fusion_t *const fusion, double up[3]);
+
+/**
+ * Motion to report for the latest gyro and accel samples, in the configured space: accel is replaced by the
+ * filtered gravity vector when report_gravity is set.
+ */
+void imu_fusion_motion(
+    const imu_fusion_t *const fusion,
+    const double gyro[3],
+    const double accel[3],
+    double gyro_out[3],
+    double accel_out[3]
+);
@@ -4,6 +4,7 @@
 
 #define IMU_MESSAGE_FLAGS_ACCEL   0x00000001U
 #define IMU_MESSAGE_FLAGS_ANGLVEL 0x00000002U
+#define IMU_MESSAGE_FLAGS_ACCEL_SENSOR 0x00000004U // accel_sensor_m2s holds a real accelerometer reading
 
 typedef struct imu_message {
     struct timeval gyro_read_time;
@@ -24,6 +25,10 @@ typedef struct imu_message {
     double gyro_rad_s[3]; // | x, y, z| right-hand-rules -- in rad/s
     double accel_m2s[3]; // | x, y, z| positive: right, up, towards player -- in m/s^2
 
+    // accel_m2s (and accel_*_raw) is what the virtual controllers report, which on the supported devices is
+    // not read from the accelerometer: fusion, gravity and world space must only use this one
+    double accel_sensor_m2s[3]; // | x, y, z| same axes as accel_m2s -- in m/s^2
+
     uint32_t flags;
 
 } imu_message_t;
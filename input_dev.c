@@ -4,6 +4,14 @@
 #include "queue.h"
 #include "dev_iio.h"
 #include "platform.h"
+#include "reactor.h"
+#include "latency.h"
+#include "message_pool.h"
+#include "hotplug.h"
+#include "rt_profile.h"
+#include "ring_log.h"
+#include "trace.h"
+#include "metrics.h"
 
 #include <stdlib.h>
 #include <libevdev-1.0/libevdev/libevdev.h>
@@ -14,13 +22,18 @@
 #include <errno.h>
 #include <termios.h>
 #include <dirent.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 
 static const char *input_path = "/dev/input/";
 static const char *iio_path = "/sys/bus/iio/devices/";
 
 #define DATA_LENGTH 64
 #define READ_TIMEOUT 1 // Timeout in seconds
-#define DEVICE_CHECK_INTERVAL 5
+
+#define INPUT_REACTOR_RESCAN_MS     250 // how often the reactor looks for missing devices
+#define INPUT_REACTOR_IIO_POLL_MS   15  // sysfs sampling period for iio devices without a buffer
 
 
 uint32_t input_filter_imu_identity(struct input_event* events, size_t* size, uint32_t* count, uint32_t* flags) {
@@ -129,6 +142,9 @@ static dev_iio_t* iio_matches(const char* sysfs_entry, const iio_filters_t* cons
         return NULL;
     }
 
+    // only now: the buffer setup reconfigures the device for everyone else reading it
+    dev_iio_enable_buffered(dev_iio);
+
     return dev_iio;
 }
 
@@ -145,39 +161,66 @@ static char* open_sysfs[] = {
 #define MAX_MESSAGES_IN_FLIGHT 32
 #define DEFAULT_EVENTS_IN_REPORT 8
 
+// how long a reader sleeps on an exhausted message pool before reporting the stall
+#define MESSAGE_ACQUIRE_TIMEOUT_MS 1000
+
+// evdev events fetched by a single read(): several complete frames of a fast stick motion
+#define INPUT_EV_READ_BATCH 64
+
 #define INPUT_CTX_FLAGS_READ_TERMINATED 0x00000001U
 
+// events of an evdev batch were left behind: the next frame is a resync against the device state
+#define INPUT_CTX_FLAGS_EV_RESYNC       0x00000002U
+
 struct input_ctx {
     struct libevdev* dev;
 dev_iio_t *iio_dev;
 queue_t* queue;
-    queue_t* rumble_queue;
+    logic_t* logic;
     controller_settings_t* settings;
     uint32_t flags;
-    message_t messages[MAX_MESSAGES_IN_FLIGHT];
+    message_pool_t pool;
     ev_input_filter_t input_filter_fn;
 };
 
+/**
+ * Take a free message, sleeping while the output thread still owns all of them.
+ *
+ * Returns NULL after MESSAGE_ACQUIRE_TIMEOUT_MS without a message being released.
+ */
+static message_t* input_ctx_acquire_message(struct input_ctx *const ctx) {
+    message_t *const msg = message_pool_try_acquire(&ctx->pool);
+    if (msg != NULL) {
+        return msg;
+    }
+
+    message_t *const waited_msg = message_pool_acquire_timeout(&ctx->pool, MESSAGE_ACQUIRE_TIMEOUT_MS);
+    if (waited_msg == NULL) {
+        // the output thread has held every message for a whole second: keep the trace of what led here
+        trace_record(TRACE_EV_STALL, (ctx->iio_dev != NULL) ? MSG_TYPE_IMU : ((ctx->dev != NULL) ? MSG_TYPE_EV : MSG_TYPE_HIDRAW), 0);
+        trace_request_dump(TRACE_DUMP_STALL);
+        metrics_count_drop(METRICS_DROP_STALL);
+    }
+
+    return waited_msg;
+}
+
 static void* iio_read_thread_func(void* ptr) {
     struct input_ctx* ctx = (struct input_ctx*)ptr;
 
+    trace_register_thread("iio reader");
+
     message_t* msg = NULL;
     
     int rc = -1;
 
     do {
         if (msg == NULL) {
-            for (int h = 0; h < MAX_MESSAGES_IN_FLIGHT; ++h) {
-                if ((ctx->messages[h].flags & MESSAGE_FLAGS_HANDLE_DONE) != 0) {
-                    msg = &ctx->messages[h];
-                    //TODO: msg->ev_count = 0;
-                    break;
-                }
-            }
+            msg = input_ctx_acquire_message(ctx);
         }
 
         if (msg == NULL) {
-            fprintf(stderr, "iio: Events are stalled.\n");
+            RING_LOG(RING_LOG_WARN, "iio: Events are stalled.\n");
             continue;
         }
 
@@ -185,27 +228,36 @@ static void* iio_read_thread_func(void* ptr) {
         if (rc == 0) {
             // OK: good read. go on....
         } else if (rc == -ENOMEM) {
-            fprintf(stderr, "Error: out-of-memory will skip the current frame.\n");
+            RING_LOG(RING_LOG_ERROR, "Error: out-of-memory will skip the current frame.\n");
+            continue;
+        } else if (rc == -EAGAIN) {
+            // interrupted or empty buffered read: retry with the same message
+            metrics_count_eagain(MSG_TYPE_IMU);
             continue;
         } else {
             fprintf(stderr, "Error: reading %s: %d\n", dev_iio_get_name(ctx->iio_dev), rc);
+            message_pool_release(msg);
             break;
         }
 
+        msg->ts.read_ns = latency_now_ns();
+        trace_record(TRACE_EV_READ, MSG_TYPE_IMU, 0);
+        metrics_count_message(MSG_TYPE_IMU);
+
         // clear out flags
         msg->flags = 0x00000000U;
 
-        if (queue_push(ctx->queue, (void*)msg) != 0) {
-            fprintf(stderr, "Error pushing iio event.\n");
+        // IMU samples take the latest-wins lane: a burst never delays the buttons
+        msg->ts.enqueue_ns = latency_now_ns();
+        logic_post_imu(ctx->logic, msg);
 
-            // flag the memory to be safe to reuse
-            msg->flags |= MESSAGE_FLAGS_HANDLE_DONE;
+        // in buffered mode the blocking read paces this loop at the sensor rate
+        if (!dev_iio_is_buffered(ctx->iio_dev)) {
+            // TODO: configure equal as sampling rate
+            // usleep(1250);
+            usleep(15000);
         }
 
-        // TODO: configure equal as sampling rate
-        // usleep(1250);
-        usleep(15000);
-
 
         // either way.... fill a new buffer on the next cycle
         msg = NULL;
@@ -214,116 +266,265 @@ static void* iio_read_thread_func(void* ptr) {
     return NULL;
 }
 
-static void* input_read_thread_func(void* ptr) {
-    struct input_ctx* ctx = (struct input_ctx*)ptr;
-    struct libevdev* dev = ctx->dev;
+/**
+ * Make room for count events in the buffer of msg, keeping the ones already there.
+ */
+static int input_ev_reserve(message_t *const msg, size_t count) {
+    if (msg->data.event.ev_size >= count) {
+        return 0;
+    }
 
-    int has_syn = libevdev_has_event_type(ctx->dev, EV_SYN);
+    size_t new_size = (msg->data.event.ev_size > 0) ? msg->data.event.ev_size * 2 : DEFAULT_EVENTS_IN_REPORT;
+    while (new_size < count) {
+        new_size *= 2;
+    }
 
-    int rc = 1;
+    struct input_event *const new_buf = realloc(msg->data.event.ev, sizeof(struct input_event) * new_size);
+    if (new_buf == NULL) {
+        return -ENOMEM;
+    }
 
-    message_t* msg = NULL;
-    
-    do {
-        
-        if (msg == NULL) {
-            for (int h = 0; h < MAX_MESSAGES_IN_FLIGHT; ++h) {
-                if ((ctx->messages[h].flags & MESSAGE_FLAGS_HANDLE_DONE) != 0) {
-                    msg = &ctx->messages[h];
-                    msg->data.event.ev_count = 0;
-                    break;
-                }
-            }
+    msg->data.event.ev = new_buf;
+    msg->data.event.ev_size = new_size;
+
+    return 0;
+}
+
+/**
+ * Filter a complete frame and push it to the output queue: msg must not be used afterwards.
+ */
+static void input_ev_frame_submit(struct input_ctx *const ctx, message_t *const msg) {
+#if defined(INCLUDE_INPUT_DEBUG)
+    for (uint32_t i = 0; i < msg->data.event.ev_count; ++i) {
+        RING_LOG(
+            RING_LOG_DEBUG,
+            "Input: %s %s %d\n",
+            libevdev_event_type_get_name(msg->data.event.ev[i].type),
+            libevdev_event_code_get_name(msg->data.event.ev[i].type, msg->data.event.ev[i].code),
+            msg->data.event.ev[i].value
+        );
+    }
+    RING_LOG(RING_LOG_DEBUG, "Sync ---------------------------------------\n");
+#endif
+
+    // clear out flags
+    msg->flags = 0x00000000U;
+    msg->data.event.ev_flags = 0x00000000U;
+
+    const uint32_t input_filter_res = ctx->input_filter_fn(msg->data.event.ev, &msg->data.event.ev_size, &msg->data.event.ev_count, &msg->data.event.ev_flags);
+
+    if (((input_filter_res & INPUT_FILTER_FLAGS_DO_NOT_EMIT) == 0) && (msg->data.event.ev_count > 0)) {
+        msg->ts.enqueue_ns = latency_now_ns();
+        metrics_count_message(MSG_TYPE_EV);
+        if (queue_push(ctx->queue, (void*)msg) != 0) {
+            RING_LOG(RING_LOG_ERROR, "Error pushing event.\n");
+            metrics_count_drop(METRICS_DROP_QUEUE_FULL);
+            message_pool_release(msg);
         }
+    } else {
+        message_pool_release(msg);
+    }
+}
 
-        if (msg == NULL) {
-            fprintf(stderr, "udev: Events are stalled.\n");
+/**
+ * Recover from a SYN_DROPPED: libevdev compares the device state with its own copy and the difference
+ * is submitted as a single frame in msg.
+ */
+static void input_ev_resync(struct input_ctx *const ctx, message_t *const msg) {
+    const int fd = libevdev_get_fd(ctx->dev);
+
+    // libevdev drains the kernel buffer before querying the state: that must not block
+    const int fd_flags = fcntl(fd, F_GETFL);
+    if ((fd_flags != -1) && ((fd_flags & O_NONBLOCK) == 0)) {
+        fcntl(fd, F_SETFL, fd_flags | O_NONBLOCK);
+    }
+
+    msg->data.event.ev_count = 0;
+    msg->ts.read_ns = latency_now_ns();
+
+    struct input_event sync_ev;
+    int rc = libevdev_next_event(ctx->dev, LIBEVDEV_READ_FLAG_FORCE_SYNC, &sync_ev);
+    while (rc == LIBEVDEV_READ_STATUS_SYNC) {
+        rc = libevdev_next_event(ctx->dev, LIBEVDEV_READ_FLAG_SYNC, &sync_ev);
+        if ((rc != LIBEVDEV_READ_STATUS_SYNC) || (sync_ev.type == EV_SYN)) {
             continue;
         }
 
-        struct input_event read_ev;
-        rc = libevdev_next_event(dev, LIBEVDEV_READ_FLAG_BLOCKING, &read_ev);
-        if (rc == 0) {
-            const int is_syn = (read_ev.type == EV_SYN) && (read_ev.code == SYN_REPORT);
-            
-            if (read_ev.type == EV_MSC) {
-                if (read_ev.code == MSC_SCAN) {
-#if defined(IGNORE_INPUT_SCAN)
-                    continue;
-#endif // IGNORE_INPUT_SCAN
-                } else if (read_ev.code == MSC_TIMESTAMP) {
-                    // the output device will handle that
-                    //printf("MSC_TIMESTAMP found. Ignoring...\n");
-                }
-            }
+        if (input_ev_reserve(msg, msg->data.event.ev_count + 1) == 0) {
+            msg->data.event.ev[msg->data.event.ev_count++] = sync_ev;
+        }
+    }
 
-            if ((!has_syn) || ((has_syn) && (!is_syn))) {
-#if defined(INCLUDE_INPUT_DEBUG)
-                printf(
-                    "Input: %s %s %d\n",
-                    libevdev_event_type_get_name(read_ev.type),
-                    libevdev_event_code_get_name(read_ev.type, read_ev.code),
-                    read_ev.value
-                );
-#endif
+    if ((fd_flags != -1) && ((fd_flags & O_NONBLOCK) == 0)) {
+        fcntl(fd, F_SETFL, fd_flags);
+    }
 
-                if ((msg->data.event.ev_count+1) == msg->data.event.ev_size) {
-                    printf("maximum number of events reached, buffer enlarged.\n");
-                    
-                    const size_t new_size = msg->data.event.ev_size * 2;
-                    struct input_event* new_buf = malloc(sizeof(struct input_event) * new_size);
-                    if (new_buf != NULL) {
-                        void* old_buf = (void*)msg->data.event.ev;
-                        
-                        // copy events already in the buffer
-                        memcpy((void*)new_buf, (const void*)old_buf, sizeof(struct input_event) * msg->data.event.ev_size);
-                        
-                        // copy the new event
-                        memcpy((void*)(&new_buf[msg->data.event.ev_count]), (const void*)&read_ev, sizeof(struct input_event));
-                        ++msg->data.event.ev_count;
-
-                        msg->data.event.ev = new_buf;
-                        msg->data.event.ev_size = new_size;
-
-                        free(old_buf);
-                    } else {
-                        fprintf(stderr, "Unable to allocate data for incoming events.");
-                    }
-                } else {
-                    // just copy the input event
-                    msg->data.event.ev[msg->data.event.ev_count] = read_ev;
-                    ++msg->data.event.ev_count;
-                }
-                
-            }
+    RING_LOG(RING_LOG_WARN, "Events of %s lost: %u changes resynchronized\n", libevdev_get_name(ctx->dev), msg->data.event.ev_count);
 
-            if ((!has_syn) || ((has_syn) && (is_syn))) {
-#if defined(INCLUDE_INPUT_DEBUG)
-                printf("Sync ---------------------------------------\n");
+    input_ev_frame_submit(ctx, msg);
+}
+
+/**
+ * Read the pending events of the evdev device with a single read() straight into the frame being assembled in *msg_ptr.
+ *
+ * Every SYN_REPORT completes a frame that is filtered and pushed to the output queue, events read past it start the
+ * next frame in a new message. libevdev never sees these events: its copy of the device state is updated here so that
+ * a SYN_DROPPED can still be resolved by libevdev.
+ *
+ * Returns the number of events read or a negative errno (-EAGAIN if a non-blocking device has nothing to read).
+ */
+static int input_ev_read_frames(struct input_ctx *const ctx, message_t **const msg_ptr, int has_syn) {
+    message_t *msg = *msg_ptr;
+    if (msg == NULL) {
+        msg = input_ctx_acquire_message(ctx);
+        if (msg == NULL) {
+            RING_LOG(RING_LOG_WARN, "udev: Events are stalled.\n");
+            return -EAGAIN;
+        }
+
+        msg->data.event.ev_count = 0;
+
+        // events of the last batch had no message: their changes are still missing from libevdev's copy of the state
+        if (ctx->flags & INPUT_CTX_FLAGS_EV_RESYNC) {
+            ctx->flags &= ~INPUT_CTX_FLAGS_EV_RESYNC;
+            input_ev_resync(ctx, msg);
+            *msg_ptr = NULL;
+            return 0;
+        }
+    }
+
+    // room for a whole batch after the events of the frame already assembled
+    if (input_ev_reserve(msg, msg->data.event.ev_count + INPUT_EV_READ_BATCH) != 0) {
+        RING_LOG(RING_LOG_ERROR, "Unable to allocate data for incoming events.\n");
+        if (msg->data.event.ev_count == msg->data.event.ev_size) {
+            // no room at all: drop the partial frame
+            msg->data.event.ev_count = 0;
+        }
+    }
+
+    const size_t first = msg->data.event.ev_count;
+    const size_t batch = msg->data.event.ev_size - first;
+    const ssize_t read_res = read(libevdev_get_fd(ctx->dev), (void*)&msg->data.event.ev[first], sizeof(struct input_event) * ((batch < INPUT_EV_READ_BATCH) ? batch : INPUT_EV_READ_BATCH));
+    if (read_res <= 0) {
+        *msg_ptr = msg;
+        if ((read_res < 0) && (errno == EAGAIN)) {
+            metrics_count_eagain(MSG_TYPE_EV);
+        }
+        return (read_res == 0) ? -ENODEV : -errno;
+    }
+
+    const int read_count = (int)(read_res / sizeof(struct input_event));
+    const uint64_t read_ns = latency_now_ns();
+    trace_record(TRACE_EV_READ, MSG_TYPE_EV, (uint64_t)read_count);
+
+    // the frame latency is measured from the read of its first event
+    if (first == 0) {
+        msg->ts.read_ns = read_ns;
+    }
+
+    size_t w = first; // next free slot of the frame
+    size_t r = first; // next event to look at
+    size_t end = first + read_count;
+    while (r < end) {
+        struct input_event *const evs = msg->data.event.ev;
+        const struct input_event read_ev = evs[r++];
+
+        if ((read_ev.type == EV_SYN) && (read_ev.code == SYN_DROPPED)) {
+            // the current frame and the rest of the batch are incomplete: replace them with the current state
+            metrics_count_drop(METRICS_DROP_KERNEL);
+            input_ev_resync(ctx, msg);
+            *msg_ptr = NULL;
+            return read_count;
+        }
+
+        if ((read_ev.type == EV_KEY) || (read_ev.type == EV_ABS) || (read_ev.type == EV_SW)) {
+            libevdev_set_event_value(ctx->dev, read_ev.type, read_ev.code, read_ev.value);
+        }
+
+#if defined(IGNORE_INPUT_SCAN)
+        if ((read_ev.type == EV_MSC) && (read_ev.code == MSC_SCAN)) {
+            continue;
+        }
 #endif
 
-                // clear out flags
-                msg->flags = 0x00000000U;
-                msg->data.event.ev_flags = 0x00000000U;
+        const int is_syn = (read_ev.type == EV_SYN) && (read_ev.code == SYN_REPORT);
+        if ((!has_syn) || (!is_syn)) {
+            evs[w++] = read_ev;
+        }
+
+        if ((has_syn) && (!is_syn)) {
+            continue;
+        }
 
-                const uint32_t input_filter_res = ctx->input_filter_fn(msg->data.event.ev, &msg->data.event.ev_size, &msg->data.event.ev_count, &msg->data.event.ev_flags);
+        msg->data.event.ev_count = w;
+
+        // events read past the end of this frame belong to the next one
+        message_t *next = NULL;
+        if (r < end) {
+            next = input_ctx_acquire_message(ctx);
+            if (next == NULL) {
+                RING_LOG(RING_LOG_WARN, "udev: Events are stalled.\n");
+            } else if (input_ev_reserve(next, end - r) != 0) {
+                RING_LOG(RING_LOG_ERROR, "Unable to allocate data for incoming events.\n");
+                message_pool_release(next);
+                next = NULL;
+            } else {
+                memcpy((void*)next->data.event.ev, (const void*)&evs[r], sizeof(struct input_event) * (end - r));
+                next->ts.read_ns = read_ns;
+            }
+        }
 
-                if (((input_filter_res & INPUT_FILTER_FLAGS_DO_NOT_EMIT) == 0) && (msg->data.event.ev_count > 0)) {
-                    if (queue_push(ctx->queue, (void*)msg) != 0) {
-                        fprintf(stderr, "Error pushing event.\n");
+        input_ev_frame_submit(ctx, msg);
 
-                        // flag the memory to be safe to reuse
-                        msg->flags |= MESSAGE_FLAGS_HANDLE_DONE;
-                    }
-                } else {
-                    // flag the memory to be safe to reuse
-                    msg->flags |= MESSAGE_FLAGS_HANDLE_DONE;
+        msg = next;
+        if (msg == NULL) {
+            if (r < end) {
+                // not applied to libevdev: the resync done once a message is available emits exactly these changes
+                uint64_t lost_frames = 0;
+                for (size_t l = r; l < end; ++l) {
+                    const struct input_event *const lost_ev = &evs[l];
+                    lost_frames += (!has_syn) || ((lost_ev->type == EV_SYN) && (lost_ev->code == SYN_REPORT));
                 }
-                // either way.... fill a new buffer on the next cycle
-                msg = NULL;
+
+                metrics_count_drops(METRICS_DROP_NO_MESSAGE, (lost_frames > 0) ? lost_frames : 1);
+                ctx->flags |= INPUT_CTX_FLAGS_EV_RESYNC;
             }
+
+            *msg_ptr = NULL;
+            return read_count;
         }
-    } while (rc == 1 || rc == 0 || rc == -EAGAIN);
+
+        end -= r;
+        r = 0;
+        w = 0;
+    }
+
+    msg->data.event.ev_count = w;
+    *msg_ptr = msg;
+
+    return read_count;
+}
+
+static void* input_read_thread_func(void* ptr) {
+    struct input_ctx* ctx = (struct input_ctx*)ptr;
+
+    trace_register_thread("evdev reader");
+
+    const int has_syn = libevdev_has_event_type(ctx->dev, EV_SYN);
+
+    int rc;
+
+    message_t* msg = NULL;
+
+    do {
+        // blocks until the device has something, then takes everything it has in one go
+        rc = input_ev_read_frames(ctx, &msg, has_syn);
+    } while ((rc >= 0) || (rc == -EAGAIN) || (rc == -EINTR));
+
+    // a half-assembled frame is dropped
+    if (msg != NULL) {
+        message_pool_release(msg);
+    }
 
     ctx->flags |= INPUT_CTX_FLAGS_READ_TERMINATED;
 
@@ -422,46 +623,64 @@ int dev_hidraw_read(int  fd, hidraw_message_t *const out){
     return 0; //No data read, but no error
 }
 
-char* find_matching_hidraw_devices() {
-    while (1) {
-        DIR *dir = opendir("/sys/class/hidraw");
-        if (!dir) {
-            perror("opendir");
-            sleep(DEVICE_CHECK_INTERVAL);
-            continue;
-        }
-        
-        struct dirent *entry;
-        while ((entry = readdir(dir))) {
-            if (entry->d_name[0] == '.') continue;
-
-            char sysfs_device_path[256];
-            snprintf(sysfs_device_path, sizeof(sysfs_device_path), "/sys/class/hidraw/%s", entry->d_name);
-
-            if (check_device_match(sysfs_device_path)) {
-                printf("Matching device found: %s\n", sysfs_device_path);
-                char *dev_path = malloc(256);
-                if(!dev_path) {
-                    perror("malloc failed");
-                    continue;
-                }
+/**
+ * Single pass over /sys/class/hidraw: returns the (malloc'd) path of the first matching device or NULL.
+ */
+static char* find_matching_hidraw_device_once(void) {
+    DIR *dir = opendir("/sys/class/hidraw");
+    if (!dir) {
+        perror("opendir");
+        return NULL;
+    }
 
-                snprintf(dev_path, 256, "/dev/%s", entry->d_name);
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (entry->d_name[0] == '.') continue;
 
-                if (test_device_data_length(dev_path)) {
-                    printf("Device %s has 64 bytes of data available.\n", dev_path);
-                    // read_and_print_data(dev_path);
-                    closedir(dir);
-                    return dev_path;
-                } else {
-                    printf("Device %s does not have data available or not 64 bytes.\n", dev_path);
-                }
+        char sysfs_device_path[256];
+        snprintf(sysfs_device_path, sizeof(sysfs_device_path), "/sys/class/hidraw/%s", entry->d_name);
+
+        if (check_device_match(sysfs_device_path)) {
+            printf("Matching device found: %s\n", sysfs_device_path);
+            char *dev_path = malloc(256);
+            if(!dev_path) {
+                perror("malloc failed");
+                continue;
+            }
+
+            snprintf(dev_path, 256, "/dev/%s", entry->d_name);
+
+            if (test_device_data_length(dev_path)) {
+                printf("Device %s has 64 bytes of data available.\n", dev_path);
+                // read_and_print_data(dev_path);
+                closedir(dir);
+                return dev_path;
+            } else {
+                printf("Device %s does not have data available or not 64 bytes.\n", dev_path);
+                free(dev_path);
             }
         }
+    }
+
+    closedir(dir);
+    return NULL;
+}
+
+char* find_matching_hidraw_devices(logic_t *const logic) {
+    hotplug_t *const hotplug = &logic->hotplug;
+
+    while (!logic_termination_requested(logic)) {
+        const unsigned seen_generation = hotplug_generation(hotplug, HOTPLUG_SUBSYSTEM_HIDRAW);
+
+        char *const dev_path = find_matching_hidraw_device_once();
+        if (dev_path != NULL) {
+            return dev_path;
+        }
 
-        closedir(dir);
-        sleep(DEVICE_CHECK_INTERVAL);
+        hotplug_wait(hotplug, HOTPLUG_SUBSYSTEM_HIDRAW, seen_generation);
     }
+
+    return NULL;
 }
 void* hidraw_reading_thread(void* ptr){
     struct input_ctx* ctx = (struct input_ctx*)ptr;
@@ -469,61 +688,87 @@ void* hidraw_reading_thread(void* ptr){
         fprintf(stderr, "Context is NULL\n");
         return NULL;
     }
-    char* device = find_matching_hidraw_devices();
-    int fd = open(device, O_RDONLY);
+
+    trace_register_thread("hidraw reader");
+    hotplug_t *const hotplug = &ctx->logic->hotplug;
+
+    // a device added after this point is the one to reconnect to once the current one is lost
+    unsigned opened_generation = hotplug_generation(hotplug, HOTPLUG_SUBSYSTEM_HIDRAW);
+    char* device = find_matching_hidraw_devices(ctx->logic);
+    if (device == NULL) {
+        return NULL;
+    }
+    int fd = open(device, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
     if (fd < 0) {
         perror("Failed to open device");
-        close(fd);
+        free(device);
         return NULL;
     }
-    int rc;
-    int termination_condition = 1; 
     message_t* msg = NULL;
-    while(termination_condition == 1) {  
+    while (!logic_termination_requested(ctx->logic)) {
+        // sleep until the device has a report (or is gone): wake up now and then to notice a termination request
+        struct pollfd pfd = {
+            .fd = fd,
+            .events = POLLIN,
+            .revents = 0,
+        };
+        const int poll_res = poll(&pfd, 1, HOTPLUG_TERMINATION_CHECK_MS);
+        if ((poll_res == 0) || ((poll_res < 0) && (errno == EINTR))) {
+            continue;
+        }
+
         if (msg == NULL) {
-            for (int h = 0; h < MAX_MESSAGES_IN_FLIGHT; ++h) {
-                if ((ctx->messages[h].flags & MESSAGE_FLAGS_HANDLE_DONE)) {
-                    msg = &ctx->messages[h];
-                    break;
-                }
-            }
+            msg = input_ctx_acquire_message(ctx);
         }
         if (msg == NULL) {
-            usleep(30000); // Wait a bit before retrying
+            RING_LOG(RING_LOG_WARN, "hidraw: Events are stalled.\n");
             continue;
         }
-        
-        int rc = dev_hidraw_read(fd, &msg->data.hidraw);
+
+        msg->data.hidraw.data_size = 0;
+        int rc = (poll_res > 0) ? dev_hidraw_read(fd, &msg->data.hidraw) : 99;
         if(rc == 99){  // Handle Legion L + R1 hold
             close(fd); //Close the descriptor
-            sleep(3);
-            printf("Lost device i/o error");
-            device = find_matching_hidraw_devices();
-            fd = open(device, O_RDONLY | O_NONBLOCK);
+            RING_LOG(RING_LOG_WARN, "Lost device i/o error\n");
+            free(device);
+
+            // the lost node can still be listed for a moment: wait for the device added back after it was opened
+            hotplug_wait(hotplug, HOTPLUG_SUBSYSTEM_HIDRAW, opened_generation);
+            opened_generation = hotplug_generation(hotplug, HOTPLUG_SUBSYSTEM_HIDRAW);
+            device = find_matching_hidraw_devices(ctx->logic);
+            fd = (device != NULL) ? open(device, O_RDONLY | O_NONBLOCK | O_CLOEXEC) : -1;
             
             if (fd < 0) {
+                message_pool_release(msg);
                 free(device);
                 return NULL;
             }
-            
+
+            continue;
         }
-        if(rc == 0){
+        if((rc == 0) && (msg->data.hidraw.data_size > 0)){
+            msg->ts.read_ns = latency_now_ns();
+            trace_record(TRACE_EV_READ, MSG_TYPE_HIDRAW, (uint64_t)msg->data.hidraw.data_size);
+            metrics_count_message(MSG_TYPE_HIDRAW);
             msg->type = MSG_TYPE_HIDRAW;
             msg->flags = 0; //Reset            
+            msg->ts.enqueue_ns = latency_now_ns();
             if(queue_push(ctx->queue, (void*)msg)!=0){
-                fprintf(stderr, "Error pushing HIDRAW event\n");
+                RING_LOG(RING_LOG_ERROR, "Error pushing HIDRAW event\n");
+                metrics_count_drop(METRICS_DROP_QUEUE_FULL);
+                message_pool_release(msg);
             }
             msg=NULL;
         } else if (rc == -1) {
             perror("Read error");
-            msg->flags |= MESSAGE_FLAGS_HANDLE_DONE;
-            msg = NULL;
-        } else {
-            msg->flags |= MESSAGE_FLAGS_HANDLE_DONE;
+            message_pool_release(msg);
             msg = NULL;
+        } else if (rc == 0) {
+            // spurious wakeup: the message is kept for the next report
+            metrics_count_eagain(MSG_TYPE_HIDRAW);
         }
-        usleep(20000);
     }
+    if (msg != NULL) message_pool_release(msg);
     if(fd>=0) close(fd);
     free(device);
     return NULL;
@@ -551,227 +796,339 @@ static void input_hidraw(
 
 }
 
-static void input_iio(
+/**
+ * Scan the iio bus for a device matching in_dev's filters that is not already opened by another reader.
+ *
+ * Returns 0 with ctx->iio_dev set or -EAGAIN if nothing could be opened: the caller retries later.
+ */
+static int input_iio_acquire(
     input_dev_t *const in_dev,
-    struct input_ctx *const ctx
+    struct input_ctx *const ctx,
+    int *const open_sysfs_idx_ptr
 ) {
-    int open_sysfs_idx = -1;
+    int open_sysfs_idx = *open_sysfs_idx_ptr;
 
-    for (;;) {
-        if (logic_termination_requested(in_dev->logic)) {
-            break;
-        }
+    const int input_acquire_lock_result = pthread_mutex_lock(&input_acquire_mutex);
+    if (input_acquire_lock_result != 0) {
+        fprintf(stderr, "Cannot lock input mutex: %d, will retry later...\n", input_acquire_lock_result);
+        return -EAGAIN;
+    }
 
-        // clean up from previous iteration
-        if (ctx->iio_dev != NULL) {
-            dev_iio_destroy(ctx->iio_dev);
-            ctx->dev = NULL;
-        }
-        
-        const int input_acquire_lock_result = pthread_mutex_lock(&input_acquire_mutex);
-        if (input_acquire_lock_result != 0) {
-            fprintf(stderr, "Cannot lock input mutex: %d, will retry later...\n", input_acquire_lock_result);
-            usleep(150000);
-            continue;
-        }
+    // clean up leftover from previous opening
+    if (open_sysfs_idx >= 0) {
+        free(open_sysfs[open_sysfs_idx]);
+        open_sysfs[open_sysfs_idx] = NULL;
+        open_sysfs_idx = -1;
+    }
 
-        // clean up leftover from previous opening
-        if (open_sysfs_idx >= 0) {
-            free(open_sysfs[open_sysfs_idx]);
-            open_sysfs[open_sysfs_idx] = NULL;
-        }
+    char path[512] = "\0";
+    
+    DIR *d;
+    struct dirent *dir;
+    d = opendir(iio_path);
+    if (d) {
+        while ((dir = readdir(d)) != NULL) {
+            if (dir->d_name[0] == '.') {
+                continue;
+            } else if (dir->d_name[0] == 'b') { // by-id
+                continue;
+            } else if (dir->d_name[0] == 'j') { // js-0
+                continue;
+            }
 
-        char path[512] = "\0";
-        
-        DIR *d;
-        struct dirent *dir;
-        d = opendir(iio_path);
-        if (d) {
-            while ((dir = readdir(d)) != NULL) {
-                if (dir->d_name[0] == '.') {
-                    continue;
-                } else if (dir->d_name[0] == 'b') { // by-id
-                    continue;
-                } else if (dir->d_name[0] == 'j') { // js-0
-                    continue;
+            sprintf(path, "%s%s", iio_path, dir->d_name);
+
+            // check if that has been already opened
+            // open_sysfs
+            int skip = 0;
+            for (int o = 0; o < (sizeof(open_sysfs) / sizeof(const char*)); ++o) {
+                if ((open_sysfs[o] != NULL) && (strcmp(open_sysfs[o], path) == 0)) {
+                    fprintf(stderr, "already opened iio device %s: skip.\n", path);
+                    skip = 1;
+                    break;
                 }
+            }
 
-                sprintf(path, "%s%s", iio_path, dir->d_name);
+            if (skip) {
+                continue;
+            }
 
-                // check if that has been already opened
-                // open_sysfs
-                int skip = 0;
-                for (int o = 0; o < (sizeof(open_sysfs) / sizeof(const char*)); ++o) {
-                    if ((open_sysfs[o] != NULL) && (strcmp(open_sysfs[o], path) == 0)) {
-                        fprintf(stderr, "already opened iio device %s: skip.\n", path);
-                        skip = 1;
-                        break;
-                    }
+            // try to open the device
+            ctx->iio_dev = iio_matches(path, in_dev->iio_filters);
+            if (ctx->iio_dev != NULL) {
+                open_sysfs_idx = 0;
+                while (open_sysfs[open_sysfs_idx] != NULL) {
+                    ++open_sysfs_idx;
                 }
+                open_sysfs[open_sysfs_idx] = malloc(sizeof(path));
+                memcpy(open_sysfs[open_sysfs_idx], path, 512);    
 
-                if (skip) {
-                    continue;
-                }
+                printf("Opened iio %s\n    name: %s\n",
+                    path,
+                    dev_iio_get_name(ctx->iio_dev)
+                );
 
-                // try to open the device
-                ctx->iio_dev = iio_matches(path, in_dev->iio_filters);
-                if (ctx->iio_dev != NULL) {
-                    open_sysfs_idx = 0;
-                    while (open_sysfs[open_sysfs_idx] != NULL) {
-                        ++open_sysfs_idx;
+                if (ctx->settings->gyro_calibration) {
+                    const int calib_res = dev_iio_enable_gyro_calibration(ctx->iio_dev, ctx->settings->gyro_calibration_dir);
+                    if (calib_res != 0) {
+                        fprintf(stderr, "Unable to enable the gyro calibration of %s: %d\n", path, calib_res);
                     }
-                    open_sysfs[open_sysfs_idx] = malloc(sizeof(path));
-                    memcpy(open_sysfs[open_sysfs_idx], path, 512);    
-
-                    printf("Opened iio %s\n    name: %s\n",
-                        path,
-                        dev_iio_get_name(ctx->iio_dev)
-                    );
-                    
-                    break;
-                } else {
-                    fprintf(stderr, "iio device in %s does NOT matches\n", path);
-                    ctx->iio_dev = NULL;
                 }
+                
+                break;
+            } else {
+                fprintf(stderr, "iio device in %s does NOT matches\n", path);
+                ctx->iio_dev = NULL;
             }
-            closedir(d);
-        }
-
-        pthread_mutex_unlock(&input_acquire_mutex);
-
-        // if device was not open "continue"
-        if (ctx->iio_dev == NULL) {
-            usleep(250000);
-            continue;
         }
+        closedir(d);
+    }
 
-        pthread_t incoming_events_thread;
+    pthread_mutex_unlock(&input_acquire_mutex);
 
-        const int incoming_events_thread_creation = pthread_create(&incoming_events_thread, NULL, iio_read_thread_func, (void*)ctx);
-        if (incoming_events_thread_creation != 0) {
-            fprintf(stderr, "Error creating the input thread for device %s: %d\n", dev_iio_get_name(ctx->iio_dev), incoming_events_thread_creation);
-        }
+    *open_sysfs_idx_ptr = open_sysfs_idx;
 
-        if (incoming_events_thread_creation == 0) {
-            pthread_join(incoming_events_thread, NULL);
-        }
-    }
+    return (ctx->iio_dev != NULL) ? 0 : -EAGAIN;
 }
-// Debug function to reduce CPU usage
-static void input_udev(
+
+/**
+ * Scan /dev/input for a device matching in_dev's filters that is not already opened by another reader.
+ *
+ * Returns 0 with ctx->dev set or -EAGAIN if nothing could be opened: the caller retries later.
+ */
+static int input_udev_acquire(
     input_dev_t *const in_dev,
-    struct input_ctx *const ctx
+    struct input_ctx *const ctx,
+    int *const open_sysfs_idx_ptr
 ) {
-    int open_sysfs_idx = -1;
+    int open_sysfs_idx = *open_sysfs_idx_ptr;
 
-    for (;;) {
-        if (logic_termination_requested(in_dev->logic)) {
-            break;
-        }
+    const int input_acquire_lock_result = pthread_mutex_lock(&input_acquire_mutex);
+    if (input_acquire_lock_result != 0) {
+        fprintf(stderr, "Cannot lock input mutex: %d, will retry later...\n", input_acquire_lock_result);
+        return -EAGAIN;
+    }
 
-        // clean up from previous iteration
-        if (ctx->dev != NULL) {
-            libevdev_free(ctx->dev);
-            ctx->dev = NULL;
-        }
+    // clean up leftover from previous opening
+    if (open_sysfs_idx >= 0) {
+        free(open_sysfs[open_sysfs_idx]);
+        open_sysfs[open_sysfs_idx] = NULL;
+        open_sysfs_idx = -1;
+    }
 
-        const int input_acquire_lock_result = pthread_mutex_lock(&input_acquire_mutex);
-        if (input_acquire_lock_result != 0) {
-            fprintf(stderr, "Cannot lock input mutex: %d, will retry later...\n", input_acquire_lock_result);
-            usleep(250000);
-            continue;
-        }
+    char path[512] = "\0";
+    
+    DIR *d;
+    struct dirent *dir;
+    d = opendir(input_path);
+    if (d) {
+        while ((dir = readdir(d)) != NULL) {
+            if (dir->d_name[0] == '.') {
+                continue;
+            } else if (dir->d_name[0] == 'b') { // by-id
+                continue;
+            } else if (dir->d_name[0] == 'j') { // js-0
+                continue;
+            }
 
-        // clean up leftover from previous opening
-        if (open_sysfs_idx >= 0) {
-            free(open_sysfs[open_sysfs_idx]);
-            open_sysfs[open_sysfs_idx] = NULL;
-        }
+            sprintf(path, "%s%s", input_path, dir->d_name);
 
-        char path[512] = "\0";
-        
-        DIR *d;
-        struct dirent *dir;
-        d = opendir(input_path);
-        if (d) {
-            while ((dir = readdir(d)) != NULL) {
-                if (dir->d_name[0] == '.') {
-                    continue;
-                } else if (dir->d_name[0] == 'b') { // by-id
-                    continue;
-                } else if (dir->d_name[0] == 'j') { // js-0
-                    continue;
+            // check if that has been already opened
+            // open_sysfs
+            int skip = 0;
+            for (int o = 0; o < (sizeof(open_sysfs) / sizeof(const char*)); ++o) {
+                if ((open_sysfs[o] != NULL) && (strcmp(open_sysfs[o], path) == 0)) {
+                    skip = 1;
+                    break;
                 }
+            }
 
-                sprintf(path, "%s%s", input_path, dir->d_name);
-
-                // check if that has been already opened
-                // open_sysfs
-                int skip = 0;
-                for (int o = 0; o < (sizeof(open_sysfs) / sizeof(const char*)); ++o) {
-                    if ((open_sysfs[o] != NULL) && (strcmp(open_sysfs[o], path) == 0)) {
-                        skip = 1;
-                        break;
-                    }
-                }
+            if (skip) {
+                continue;
+            }
 
-                if (skip) {
-                    continue;
+            // try to open the device
+            ctx->dev = ev_matches(path, in_dev->ev_filters);
+            if (ctx->dev != NULL) {
+                open_sysfs_idx = 0;
+                while (open_sysfs[open_sysfs_idx] != NULL) {
+                    ++open_sysfs_idx;
                 }
+                open_sysfs[open_sysfs_idx] = malloc(sizeof(path));
+                memcpy(open_sysfs[open_sysfs_idx], path, 512);    
 
-                // try to open the device
-                ctx->dev = ev_matches(path, in_dev->ev_filters);
-                if (ctx->dev != NULL) {
-                    open_sysfs_idx = 0;
-                    while (open_sysfs[open_sysfs_idx] != NULL) {
-                        ++open_sysfs_idx;
-                    }
-                    open_sysfs[open_sysfs_idx] = malloc(sizeof(path));
-                    memcpy(open_sysfs[open_sysfs_idx], path, 512);    
-
-                    if (libevdev_has_event_type(ctx->dev, EV_FF)) {
-                        printf("Opened device %s\n    name: %s\n    rumble: %s\n",
-                            path,
-                            libevdev_get_name(ctx->dev),
-                            libevdev_has_event_code(ctx->dev, EV_FF, FF_RUMBLE) ? "true" : "false"
-                        );
-                    } else {
-                        printf("Opened device %s\n    name: %s\n    rumble: no EV_FF\n",
-                            path,
-                            libevdev_get_name(ctx->dev)
-                        );
-                    }
-                    
-                    break;
+                if (libevdev_has_event_type(ctx->dev, EV_FF)) {
+                    printf("Opened device %s\n    name: %s\n    rumble: %s\n",
+                        path,
+                        libevdev_get_name(ctx->dev),
+                        libevdev_has_event_code(ctx->dev, EV_FF, FF_RUMBLE) ? "true" : "false"
+                    );
+                } else {
+                    printf("Opened device %s\n    name: %s\n    rumble: no EV_FF\n",
+                        path,
+                        libevdev_get_name(ctx->dev)
+                    );
                 }
+                
+                break;
             }
-            closedir(d);
+        }
+        closedir(d);
+    }
+
+    pthread_mutex_unlock(&input_acquire_mutex);
+
+    *open_sysfs_idx_ptr = open_sysfs_idx;
+
+    return (ctx->dev != NULL) ? 0 : -EAGAIN;
+}
+
+static void input_iio(
+    input_dev_t *const in_dev,
+    struct input_ctx *const ctx
+) {
+    int open_sysfs_idx = -1;
+
+    for (;;) {
+        if (logic_termination_requested(in_dev->logic)) {
+            break;
         }
 
-        pthread_mutex_unlock(&input_acquire_mutex);
+        // clean up from previous iteration
+        if (ctx->iio_dev != NULL) {
+            dev_iio_destroy(ctx->iio_dev);
+            ctx->dev = NULL;
+        }
+        
+        const unsigned seen_generation = hotplug_generation(&in_dev->logic->hotplug, HOTPLUG_SUBSYSTEM_IIO);
 
-        if (ctx->dev == NULL) {
-            usleep(250000);
+        // if device was not open "continue" once another one shows up
+        if (input_iio_acquire(in_dev, ctx, &open_sysfs_idx) != 0) {
+            hotplug_wait(&in_dev->logic->hotplug, HOTPLUG_SUBSYSTEM_IIO, seen_generation);
             continue;
         }
 
-        const int fd = libevdev_get_fd(ctx->dev);
-        //Ally derived effect was not working on the Legion Go. Modifying the length
-        struct ff_effect current_effect = {
-            .type = FF_RUMBLE,
-            .id = -1,
-            .replay = {
-                .delay = 0,
-                .length = 250, //This value determines the length of the rumble (250 is a nice value)
-            },
-            .u = {
-                .rumble = {
-                    .strong_magnitude = 0xFFFF,
-                    .weak_magnitude = 0xFFFF,
-                }
-            }
+        pthread_t incoming_events_thread;
+
+        const int incoming_events_thread_creation = pthread_create(&incoming_events_thread, NULL, iio_read_thread_func, (void*)ctx);
+        if (incoming_events_thread_creation != 0) {
+            fprintf(stderr, "Error creating the input thread for device %s: %d\n", dev_iio_get_name(ctx->iio_dev), incoming_events_thread_creation);
+        }
+
+        if (incoming_events_thread_creation == 0) {
+            pthread_join(incoming_events_thread, NULL);
+        }
+    }
+}
+//Ally derived effect was not working on the Legion Go. Modifying the length
+static const struct ff_effect input_rumble_effect_template = {
+    .type = FF_RUMBLE,
+    .id = -1,
+    .replay = {
+        .delay = 0,
+        .length = 250, //This value determines the length of the rumble (250 is a nice value)
+    },
+    .u = {
+        .rumble = {
+            .strong_magnitude = 0xFFFF,
+            .weak_magnitude = 0xFFFF,
+        }
+    }
+};
+
+/**
+ * Replace the force-feedback effect playing on fd with one using the requested magnitudes.
+ */
+static void input_ff_play(int fd, struct ff_effect *const current_effect, const rumble_message_t *const rumble_msg) {
+    // here stop the previous rumble
+    if (current_effect->id != -1) {
+        struct input_event rumble_stop = {
+            .type = EV_FF,
+            .code = current_effect->id,
+            .value = 0,
         };
 
+        const int rumble_stop_res = write(fd, (const void*) &rumble_stop, sizeof(rumble_stop));
+        if (rumble_stop_res != sizeof(rumble_stop)) {
+            RING_LOG(RING_LOG_ERROR, "Unable to stop the previous rumble: %d\n", rumble_stop_res);
+        }
+    }
+
+    current_effect->u.rumble.strong_magnitude = rumble_msg->strong_magnitude;
+    current_effect->u.rumble.weak_magnitude = rumble_msg->weak_magnitude;
+
+#if defined(INCLUDE_INPUT_DEBUG)
+    RING_LOG(RING_LOG_DEBUG, "Rumble event received -- strong_magnitude: %u, weak_magnitude: %u\n", (unsigned)current_effect->u.rumble.strong_magnitude, (unsigned)current_effect->u.rumble.weak_magnitude);
+#endif
+
+    const int effect_upload_res = ioctl(fd, EVIOCSFF, current_effect);
+    if (effect_upload_res == 0) {
+        const struct input_event rumble_play = {
+            .type = EV_FF,
+            .code = current_effect->id,
+            .value = 1,
+        };
+
+        const int effect_start_res = write(fd, (const void*)&rumble_play, sizeof(rumble_play));
+        if (effect_start_res == sizeof(rumble_play)) {
+            trace_record(TRACE_EV_RUMBLE, 0, ((uint64_t)current_effect->u.rumble.strong_magnitude << 16) | (uint64_t)current_effect->u.rumble.weak_magnitude);
+            metrics_count_rumble();
+#if defined(INCLUDE_INPUT_DEBUG)
+            RING_LOG(RING_LOG_DEBUG, "Rumble effect play requested to driver\n");
+#endif
+        } else {
+            RING_LOG(RING_LOG_ERROR, "Unable to write input event starting the rumble: %d\n", effect_start_res);
+        }
+    } else {
+        RING_LOG(RING_LOG_ERROR, "Unable to update force-feedback effect: %d\n", effect_upload_res);
+
+        current_effect->id = -1;
+    }
+}
+
+static void input_ff_remove(int fd, struct ff_effect *const current_effect) {
+    if (current_effect->id == -1) {
+        return;
+    }
+
+    const int effect_removal_res = ioctl(fd, EVIOCRMFF, current_effect->id);
+    if (effect_removal_res == 0) {
+        printf("\n");
+    } else {
+        fprintf(stderr, "Error removing rumble effect: %d\n", effect_removal_res);
+    }
+
+    current_effect->id = -1;
+}
+
+// Debug function to reduce CPU usage
+static void input_udev(
+    input_dev_t *const in_dev,
+    struct input_ctx *const ctx
+) {
+    int open_sysfs_idx = -1;
+
+    for (;;) {
+        if (logic_termination_requested(in_dev->logic)) {
+            break;
+        }
+
+        // clean up from previous iteration
+        if (ctx->dev != NULL) {
+            libevdev_free(ctx->dev);
+            ctx->dev = NULL;
+        }
+
+        const unsigned seen_generation = hotplug_generation(&in_dev->logic->hotplug, HOTPLUG_SUBSYSTEM_INPUT);
+
+        if (input_udev_acquire(in_dev, ctx, &open_sysfs_idx) != 0) {
+            hotplug_wait(&in_dev->logic->hotplug, HOTPLUG_SUBSYSTEM_INPUT, seen_generation);
+            continue;
+        }
+
+        const int fd = libevdev_get_fd(ctx->dev);
+        struct ff_effect current_effect = input_rumble_effect_template;
+
         // start the incoming events read thread
         pthread_t incoming_events_thread;
         const int incoming_events_thread_creation = pthread_create(&incoming_events_thread, NULL, input_read_thread_func, (void*)ctx);
@@ -806,58 +1163,22 @@ static void input_udev(
         while ((ctx->flags & INPUT_CTX_FLAGS_READ_TERMINATED) == 0) {
 
             if (has_ff) {
-                usleep(1000); 
-                //(debounce)  Also reduces the amount of extra reporting done when a button is pressed, currently set at 1ms
-                void* rmsg = NULL;
-                const int rumble_msg_recv_res = queue_pop_timeout(ctx->rumble_queue, &rmsg, timeout_ms);
-                if (rumble_msg_recv_res == 0) {
-                    rumble_message_t *const rumble_msg = (rumble_message_t*)rmsg;
-
-                    // here stop the previous rumble
-                    if (current_effect.id != -1) {
-                        struct input_event rumble_stop = {
-                            .type = EV_FF,
-                            .code = current_effect.id,
-                            .value = 0,
-                        };
-
-                        const int rumble_stop_res = write(fd, (const void*) &rumble_stop, sizeof(rumble_stop));
-                        if (rumble_stop_res != sizeof(rumble_stop)) {
-                            fprintf(stderr, "Unable to stop the previous rumble: %d\n", rumble_stop_res);
-                        }
-                    }
-
-                    current_effect.u.rumble.strong_magnitude = rumble_msg->strong_magnitude;
-                    current_effect.u.rumble.weak_magnitude = rumble_msg->weak_magnitude;
-
-#if defined(INCLUDE_INPUT_DEBUG)
-                    printf("Rumble event received -- strong_magnitude: %u, weak_magnitude: %u\n", (unsigned)current_effect.u.rumble.strong_magnitude, (unsigned)current_effect.u.rumble.weak_magnitude);
-#endif
-
-                    const int effect_upload_res = ioctl(fd, EVIOCSFF, &current_effect);
-                    if (effect_upload_res == 0) {
-                        const struct input_event rumble_play = {
-                            .type = EV_FF,
-                            .code = current_effect.id,
-                            .value = 1,
-                        };
-
-                        const int effect_start_res = write(fd, (const void*)&rumble_play, sizeof(rumble_play));
-                        if (effect_start_res == sizeof(rumble_play)) {
-#if defined(INCLUDE_INPUT_DEBUG)
-                            printf("Rumble effect play requested to driver\n");
-#endif
-                        } else {
-                            fprintf(stderr, "Unable to write input event starting the rumble: %d\n", effect_start_res);
-                        }
-                    } else {
-                        fprintf(stderr, "Unable to update force-feedback effect: %d\n", effect_upload_res);
-
-                        current_effect.id = -1;
-                    }
+                // sleep until a virtual controller requests a rumble: requests arriving meanwhile are coalesced into the latest one
+                struct pollfd rumble_pfd = {
+                    .fd = ctx->logic->rumble_event_fd,
+                    .events = POLLIN,
+                };
+
+                const int rumble_poll_res = poll(&rumble_pfd, 1, timeout_ms);
+                if ((rumble_poll_res < 0) && (errno != EINTR)) {
+                    RING_LOG(RING_LOG_ERROR, "Error waiting for rumble requests: %d\n", errno);
+                    usleep(timeout_ms * 1000);
+                    continue;
+                }
 
-                    // this message was allocated by output_dev so I have to free it
-                    free(rumble_msg);
+                rumble_message_t rumble_req;
+                if ((rumble_poll_res > 0) && (logic_take_rumble(ctx->logic, &rumble_req) == 0)) {
+                    input_ff_play(fd, &current_effect, &rumble_req);
                 }
             } else {
                 //Sleep while there is no inputs
@@ -869,13 +1190,8 @@ static void input_udev(
 
 
         // stop any effect
-        if ((has_ff) && (current_effect.id != -1)) {
-            const int effect_removal_res = ioctl(fd, EVIOCRMFF, current_effect.id);
-            if (effect_removal_res == 0) {
-                printf("\n");
-            } else {
-                fprintf(stderr, "Error removing rumble effect: %d\n", effect_removal_res);
-            }
+        if (has_ff) {
+            input_ff_remove(fd, &current_effect);
         }
 
         // wait for incoming events thread to totally stop 
@@ -883,46 +1199,657 @@ static void input_udev(
     }
 }
 
-void *input_dev_thread_func(void *ptr) {
-    input_dev_t *in_dev = (input_dev_t*)ptr;
+static int input_ctx_prepare(input_dev_t *const in_dev, struct input_ctx *const ctx) {
+    memset(ctx, 0, sizeof(struct input_ctx));
 
-    struct input_ctx ctx = {
-        .dev = NULL,
-        .queue = &in_dev->logic->input_queue,
-        .rumble_queue = &in_dev->logic->rumble_events_queue,
-        .settings = &in_dev->logic->controller_settings,
-        .input_filter_fn = in_dev->ev_input_filter_fn,
-        .flags = 0x00000000U
-    };
+    ctx->dev = NULL;
+    ctx->iio_dev = NULL;
+    ctx->queue = &in_dev->logic->input_queue;
+    ctx->logic = in_dev->logic;
+    ctx->settings = &in_dev->logic->controller_settings;
+    ctx->input_filter_fn = in_dev->ev_input_filter_fn;
+    ctx->flags = 0x00000000U;
+
+    const int pool_res = message_pool_init(&ctx->pool, MAX_MESSAGES_IN_FLIGHT);
+    if (pool_res != 0) {
+        return pool_res;
+    }
 
     if (in_dev->dev_type == input_dev_type_uinput) {
         // prepare space and empty messages
-        for (int h = 0; h < MAX_MESSAGES_IN_FLIGHT; ++h) {
-            ctx.messages[h].flags = MESSAGE_FLAGS_HANDLE_DONE;
-            ctx.messages[h].type = MSG_TYPE_EV;
-            ctx.messages[h].data.event.ev_size = DEFAULT_EVENTS_IN_REPORT;
-            ctx.messages[h].data.event.ev = malloc(sizeof(struct input_event) * ctx.messages[h].data.event.ev_size);
+        for (size_t h = 0; h < ctx->pool.count; ++h) {
+            ctx->pool.messages[h].type = MSG_TYPE_EV;
+            ctx->pool.messages[h].data.event.ev_size = DEFAULT_EVENTS_IN_REPORT;
+            ctx->pool.messages[h].data.event.ev = malloc(sizeof(struct input_event) * ctx->pool.messages[h].data.event.ev_size);
+        }
+    } else if (in_dev->dev_type == input_dev_type_iio) {
+        // prepare space and empty messages
+        for (size_t h = 0; h < ctx->pool.count; ++h) {
+            ctx->pool.messages[h].type = MSG_TYPE_IMU;
+        }
+    } else if (in_dev->dev_type == input_dev_type_hidraw) {
+        for (size_t h = 0; h < ctx->pool.count; ++h) {
+            ctx->pool.messages[h].type = MSG_TYPE_IMU;
         }
+    }
 
+    return 0;
+}
+
+static void input_ctx_release(input_dev_t *const in_dev, struct input_ctx *const ctx) {
+    // the output thread may still be handling messages of this pool
+    if (message_pool_quiesce(&ctx->pool, MESSAGE_ACQUIRE_TIMEOUT_MS) != 0) {
+        fprintf(stderr, "Messages still in flight: their memory will not be released\n");
+        return;
+    }
+
+    if (in_dev->dev_type == input_dev_type_uinput) {
+        for (size_t h = 0; h < ctx->pool.count; ++h) {
+            free(ctx->pool.messages[h].data.event.ev);
+            ctx->pool.messages[h].data.event.ev = NULL;
+        }
+    }
+
+    message_pool_destroy(&ctx->pool);
+}
+
+void *input_dev_thread_func(void *ptr) {
+    input_dev_t *in_dev = (input_dev_t*)ptr;
+
+    // the reader threads spawned below inherit scheduling policy and affinity
+    rt_thread_setup(&in_dev->logic->controller_settings, RT_ROLE_INPUT);
+    trace_register_thread("input device");
+
+    struct input_ctx ctx;
+    const int prepare_res = input_ctx_prepare(in_dev, &ctx);
+    if (prepare_res != 0) {
+        fprintf(stderr, "Unable to prepare the input context: %d\n", prepare_res);
+        return NULL;
+    }
+
+    if (in_dev->dev_type == input_dev_type_uinput) {
         input_udev(in_dev, &ctx);
     } 
     else if (in_dev->dev_type == input_dev_type_iio) {
-        // prepare space and empty messages
-        for (int h = 0; h < MAX_MESSAGES_IN_FLIGHT; ++h) {
-            ctx.messages[h].flags = MESSAGE_FLAGS_HANDLE_DONE;
-            ctx.messages[h].type = MSG_TYPE_IMU;
-        }
         //Disabling had no effect on CPU usage 12.3 vs 12.6
         input_iio(in_dev, &ctx);
     } 
     else if (in_dev->dev_type == input_dev_type_hidraw) {
-        for (int h = 0; h < MAX_MESSAGES_IN_FLIGHT; ++h) {
-            ctx.messages[h].flags = MESSAGE_FLAGS_HANDLE_DONE;
-            ctx.messages[h].type = MSG_TYPE_IMU;
-        }
         //Disabling had no effect on CPU usage
         input_hidraw(in_dev, &ctx);
     }
-    free(ctx.messages);
+
+    input_ctx_release(in_dev, &ctx);
+    return NULL;
+}
+
+typedef enum input_source_state {
+    INPUT_SOURCE_CLOSED = 0,    // nothing held: the reactor can ask the opener for it
+    INPUT_SOURCE_REQUESTED,     // waiting for the opener thread
+    INPUT_SOURCE_OPENING,       // the opener thread is discovering and opening the device
+    INPUT_SOURCE_OPENED,        // opened: waiting for the reactor to register opened_fd
+    INPUT_SOURCE_ACTIVE,        // registered in the reactor
+} input_source_state_t;
+
+struct input_source;
+
+/*
+ * Discovering and opening a device blocks (dev_iio_create waits for the new scale to settle, the hidraw probe
+ * waits for a report): that runs on this helper thread and the reactor only registers the fds it hands back.
+ */
+typedef struct input_opener {
+    pthread_t thread;
+
+    // guards stop and the state of every source
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int stop;
+
+    // eventfd signalled each time a source reaches INPUT_SOURCE_OPENED
+    reactor_handler_t opened_handler;
+
+    logic_t *logic;
+    struct input_source *sources;
+    size_t sources_count;
+} input_opener_t;
+
+typedef struct input_source {
+    input_dev_t *in_dev;
+    reactor_t *reactor;
+    input_opener_t *opener;
+    struct input_ctx ctx;
+
+    input_source_state_t state;
+
+    // the device fd (evdev, hidraw or the iio buffer) or the polling timer of a sysfs-only iio device: -1 while closed
+    reactor_handler_t handler;
+
+    // what the opener thread got for the reactor to register
+    int opened_fd;
+    reactor_callback_t opened_callback;
+
+    int open_sysfs_idx;
+
+    // evdev only
+    int has_syn;
+    int has_ff;
+    struct ff_effect current_effect;
+    message_t *msg;
+
+    // hidraw only
+    char *hidraw_path;
+} input_source_t;
+
+static void input_source_set_state(input_source_t *const src, input_source_state_t state) {
+    pthread_mutex_lock(&src->opener->mutex);
+    src->state = state;
+    pthread_mutex_unlock(&src->opener->mutex);
+}
+
+// frees what input_source_acquire got hold of: fd is not (or no longer) registered in the reactor
+static void input_source_release(input_source_t *const src, int fd) {
+    if (src->in_dev->dev_type == input_dev_type_uinput) {
+        if (src->has_ff) {
+            input_ff_remove(fd, &src->current_effect);
+        }
+
+        libevdev_free(src->ctx.dev);
+        src->ctx.dev = NULL;
+        close(fd);
+
+        // a half-assembled frame is dropped: its message was never handed to the output thread
+        if (src->msg != NULL) {
+            message_pool_release(src->msg);
+            src->msg = NULL;
+        }
+    } else if (src->in_dev->dev_type == input_dev_type_iio) {
+        // the buffer fd is owned (and closed) by the iio device, the polling timer is ours
+        if (!dev_iio_is_buffered(src->ctx.iio_dev)) {
+            close(fd);
+        }
+
+        dev_iio_destroy(src->ctx.iio_dev);
+        src->ctx.iio_dev = NULL;
+    } else if (src->in_dev->dev_type == input_dev_type_hidraw) {
+        close(fd);
+        free(src->hidraw_path);
+        src->hidraw_path = NULL;
+    }
+}
+
+static void input_source_close(input_source_t *const src) {
+    if (src->handler.fd < 0) {
+        return;
+    }
+
+    reactor_remove(src->reactor, &src->handler);
+    input_source_release(src, src->handler.fd);
+    src->handler.fd = -1;
+
+    input_source_set_state(src, INPUT_SOURCE_CLOSED);
+}
+
+static void input_reactor_evdev_ready(reactor_handler_t *const handler, uint32_t events) {
+    input_source_t *const src = (input_source_t*)handler->user_data;
+
+    // the fd is non-blocking: a short read means the device has nothing more, otherwise read again
+    int rc;
+    do {
+        rc = input_ev_read_frames(&src->ctx, &src->msg, src->has_syn);
+    } while (rc == INPUT_EV_READ_BATCH);
+
+    if (((rc < 0) && (rc != -EAGAIN) && (rc != -EINTR)) || (events & (EPOLLHUP | EPOLLERR))) {
+        fprintf(stderr, "Input device %s lost: %d\n", libevdev_get_name(src->ctx.dev), rc);
+        input_source_close(src);
+    }
+}
+
+static void input_reactor_iio_ready(reactor_handler_t *const handler, uint32_t events) {
+    input_source_t *const src = (input_source_t*)handler->user_data;
+    dev_iio_t *const iio = src->ctx.iio_dev;
+
+    const int buffered = dev_iio_is_buffered(iio);
+    if (!buffered) {
+        reactor_timer_ack(handler->fd);
+    }
+
+    // one read() of the buffer can fetch several scans: hand all of them over now
+    do {
+        message_t *const msg = input_ctx_acquire_message(&src->ctx);
+        if (msg == NULL) {
+            RING_LOG(RING_LOG_WARN, "iio: Events are stalled.\n");
+            return;
+        }
+
+        const int rc = dev_iio_read_imu(iio, &msg->data.imu);
+        if (rc != 0) {
+            message_pool_release(msg);
+        }
+
+        if (rc == -EAGAIN) {
+            metrics_count_eagain(MSG_TYPE_IMU);
+            return;
+        } else if (rc == -ENOMEM) {
+            RING_LOG(RING_LOG_ERROR, "Error: out-of-memory will skip the current frame.\n");
+            return;
+        } else if (rc != 0) {
+            fprintf(stderr, "Error: reading %s: %d\n", dev_iio_get_name(iio), rc);
+            input_source_close(src);
+            return;
+        }
+
+        msg->ts.read_ns = latency_now_ns();
+        trace_record(TRACE_EV_READ, MSG_TYPE_IMU, 0);
+        metrics_count_message(MSG_TYPE_IMU);
+
+        // clear out flags
+        msg->flags = 0x00000000U;
+
+        msg->ts.enqueue_ns = latency_now_ns();
+        logic_post_imu(src->ctx.logic, msg);
+    } while ((buffered) && (dev_iio_buffered_pending(iio) > 0));
+}
+
+static void input_reactor_hidraw_ready(reactor_handler_t *const handler, uint32_t events) {
+    input_source_t *const src = (input_source_t*)handler->user_data;
+
+    for (;;) {
+        message_t *const msg = input_ctx_acquire_message(&src->ctx);
+        if (msg == NULL) {
+            RING_LOG(RING_LOG_WARN, "hidraw: Events are stalled.\n");
+            return;
+        }
+
+        msg->data.hidraw.data_size = 0;
+        const int rc = dev_hidraw_read(handler->fd, &msg->data.hidraw);
+        if (rc == 99) { // Handle Legion L + R1 hold
+            RING_LOG(RING_LOG_WARN, "Lost device i/o error\n");
+            message_pool_release(msg);
+            input_source_close(src);
+            return;
+        } else if ((rc != 0) || (msg->data.hidraw.data_size <= 0)) {
+            // nothing more to read
+            if (rc == 0) {
+                metrics_count_eagain(MSG_TYPE_HIDRAW);
+            }
+            message_pool_release(msg);
+            return;
+        }
+
+        msg->ts.read_ns = latency_now_ns();
+        trace_record(TRACE_EV_READ, MSG_TYPE_HIDRAW, (uint64_t)msg->data.hidraw.data_size);
+        metrics_count_message(MSG_TYPE_HIDRAW);
+        msg->type = MSG_TYPE_HIDRAW;
+        msg->flags = 0; //Reset
+        msg->ts.enqueue_ns = latency_now_ns();
+        if (queue_push(src->ctx.queue, (void*)msg) != 0) {
+            RING_LOG(RING_LOG_ERROR, "Error pushing HIDRAW event\n");
+            metrics_count_drop(METRICS_DROP_QUEUE_FULL);
+            message_pool_release(msg);
+        }
+    }
+}
+
+// runs on the opener thread: the reactor does not look at src until it is INPUT_SOURCE_OPENED
+static int input_source_acquire(input_source_t *const src) {
+    input_dev_t *const in_dev = src->in_dev;
+
+    reactor_callback_t callback = NULL;
+    int fd = -1;
+
+    if (in_dev->dev_type == input_dev_type_uinput) {
+        if (input_udev_acquire(in_dev, &src->ctx, &src->open_sysfs_idx) != 0) {
+            return -EAGAIN;
+        }
+
+        fd = libevdev_get_fd(src->ctx.dev);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+        src->has_syn = libevdev_has_event_type(src->ctx.dev, EV_SYN);
+        src->has_ff = libevdev_has_event_type(src->ctx.dev, EV_FF);
+        src->current_effect = input_rumble_effect_template;
+        src->msg = NULL;
+        callback = input_reactor_evdev_ready;
+    } else if (in_dev->dev_type == input_dev_type_iio) {
+        if (input_iio_acquire(in_dev, &src->ctx, &src->open_sysfs_idx) != 0) {
+            return -EAGAIN;
+        }
+
+        // without a buffer the sysfs attributes are sampled on a timer, just like the threaded reader does
+        fd = dev_iio_is_buffered(src->ctx.iio_dev) ?
+            dev_iio_get_buffer_fd(src->ctx.iio_dev) :
+            reactor_timer_create(INPUT_REACTOR_IIO_POLL_MS);
+        if (fd < 0) {
+            dev_iio_destroy(src->ctx.iio_dev);
+            src->ctx.iio_dev = NULL;
+            return fd;
+        }
+
+        callback = input_reactor_iio_ready;
+    } else if (in_dev->dev_type == input_dev_type_hidraw) {
+        src->hidraw_path = find_matching_hidraw_device_once();
+        if (src->hidraw_path == NULL) {
+            return -EAGAIN;
+        }
+
+        fd = open(src->hidraw_path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) {
+            perror("Failed to open device");
+            free(src->hidraw_path);
+            src->hidraw_path = NULL;
+            return -EAGAIN;
+        }
+
+        callback = input_reactor_hidraw_ready;
+    }
+
+    src->opened_fd = fd;
+    src->opened_callback = callback;
+
+    return 0;
+}
+
+// runs on the reactor thread with the opener mutex held
+static void input_source_activate(input_source_t *const src) {
+    src->handler.fd = src->opened_fd;
+    src->handler.callback = src->opened_callback;
+    src->handler.user_data = (void*)src;
+
+    const int add_res = reactor_add(src->reactor, &src->handler, EPOLLIN);
+    if (add_res != 0) {
+        input_source_release(src, src->handler.fd);
+        src->handler.fd = -1;
+        src->state = INPUT_SOURCE_CLOSED;
+        return;
+    }
+
+    src->state = INPUT_SOURCE_ACTIVE;
+}
+
+// hand a closed source to the opener thread: the reactor never blocks on discovery
+static void input_source_request_open(input_source_t *const src) {
+    pthread_mutex_lock(&src->opener->mutex);
+    if (src->state == INPUT_SOURCE_CLOSED) {
+        src->state = INPUT_SOURCE_REQUESTED;
+        pthread_cond_signal(&src->opener->cond);
+    }
+    pthread_mutex_unlock(&src->opener->mutex);
+}
+
+static void* input_opener_thread_func(void *ptr) {
+    input_opener_t *const opener = (input_opener_t*)ptr;
+
+    rt_thread_setup(&opener->logic->controller_settings, RT_ROLE_BACKGROUND);
+    trace_register_thread("input opener");
+
+    pthread_mutex_lock(&opener->mutex);
+    while (!opener->stop) {
+        input_source_t *src = NULL;
+        for (size_t i = 0; i < opener->sources_count; ++i) {
+            if (opener->sources[i].state == INPUT_SOURCE_REQUESTED) {
+                src = &opener->sources[i];
+                break;
+            }
+        }
+
+        if (src == NULL) {
+            pthread_cond_wait(&opener->cond, &opener->mutex);
+            continue;
+        }
+
+        src->state = INPUT_SOURCE_OPENING;
+        pthread_mutex_unlock(&opener->mutex);
+
+        const int acquire_res = input_source_acquire(src);
+
+        pthread_mutex_lock(&opener->mutex);
+        src->state = (acquire_res == 0) ? INPUT_SOURCE_OPENED : INPUT_SOURCE_CLOSED;
+
+        if (acquire_res == 0) {
+            const uint64_t one = 1;
+            if (write(opener->opened_handler.fd, &one, sizeof(one)) != sizeof(one)) {
+                RING_LOG(RING_LOG_ERROR, "Unable to signal an opened input device: %d\n", errno);
+            }
+        }
+    }
+    pthread_mutex_unlock(&opener->mutex);
+
+    return NULL;
+}
+
+static void input_reactor_opened_ready(reactor_handler_t *const handler, uint32_t events) {
+    input_opener_t *const opener = (input_opener_t*)handler->user_data;
+
+    uint64_t count;
+    if (read(handler->fd, &count, sizeof(count)) != sizeof(count)) {
+        return;
+    }
+
+    pthread_mutex_lock(&opener->mutex);
+    for (size_t i = 0; i < opener->sources_count; ++i) {
+        if (opener->sources[i].state == INPUT_SOURCE_OPENED) {
+            input_source_activate(&opener->sources[i]);
+        }
+    }
+    pthread_mutex_unlock(&opener->mutex);
+}
+
+static void input_reactor_rumble_ready(reactor_handler_t *const handler, uint32_t events) {
+    input_reactor_devs_t *const reactor_devs = (input_reactor_devs_t*)handler->user_data;
+    input_source_t *const sources = (input_source_t*)reactor_devs->sources;
+
+    rumble_message_t rumble_req;
+    if (logic_take_rumble(reactor_devs->logic, &rumble_req) != 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < reactor_devs->devs_count; ++i) {
+        input_source_t *const src = &sources[i];
+        if ((src->in_dev->dev_type == input_dev_type_uinput) && (src->handler.fd >= 0) && (src->has_ff)) {
+            input_ff_play(src->handler.fd, &src->current_effect, &rumble_req);
+        }
+    }
+}
+
+static void input_reactor_rescan_ready(reactor_handler_t *const handler, uint32_t events) {
+    input_reactor_devs_t *const reactor_devs = (input_reactor_devs_t*)handler->user_data;
+    input_source_t *const sources = (input_source_t*)reactor_devs->sources;
+
+    reactor_timer_ack(handler->fd);
+
+    for (size_t i = 0; i < reactor_devs->devs_count; ++i) {
+        if (sources[i].handler.fd < 0) {
+            input_source_request_open(&sources[i]);
+        }
+    }
+}
+
+static hotplug_subsystem_t input_dev_subsystem(const input_dev_t *const in_dev) {
+    if (in_dev->dev_type == input_dev_type_iio) {
+        return HOTPLUG_SUBSYSTEM_IIO;
+    } else if (in_dev->dev_type == input_dev_type_hidraw) {
+        return HOTPLUG_SUBSYSTEM_HIDRAW;
+    }
+
+    return HOTPLUG_SUBSYSTEM_INPUT;
+}
+
+static void input_reactor_device_event(hotplug_subsystem_t subsystem, hotplug_action_t action, const char* devnode, void* user_data) {
+    input_reactor_devs_t *const reactor_devs = (input_reactor_devs_t*)user_data;
+    input_source_t *const sources = (input_source_t*)reactor_devs->sources;
+
+    // a removed device is noticed on its own fd (EPOLLHUP or ENODEV): only additions matter here
+    if (action != HOTPLUG_ACTION_ADD) {
+        return;
+    }
+
+    for (size_t i = 0; i < reactor_devs->devs_count; ++i) {
+        if ((sources[i].handler.fd < 0) && (input_dev_subsystem(sources[i].in_dev) == subsystem)) {
+            input_source_request_open(&sources[i]);
+        }
+    }
+}
+
+static void input_reactor_hotplug_ready(reactor_handler_t *const handler, uint32_t events) {
+    input_reactor_devs_t *const reactor_devs = (input_reactor_devs_t*)handler->user_data;
+
+    hotplug_dispatch(&reactor_devs->logic->hotplug);
+}
+
+void *input_reactor_thread_func(void *ptr) {
+    input_reactor_devs_t *const reactor_devs = (input_reactor_devs_t*)ptr;
+
+    rt_thread_setup(&reactor_devs->logic->controller_settings, RT_ROLE_INPUT);
+    trace_register_thread("input reactor");
+
+    reactor_t reactor;
+    if (reactor_init(&reactor) != 0) {
+        return NULL;
+    }
+
+    input_source_t *const sources = calloc(reactor_devs->devs_count, sizeof(input_source_t));
+    if (sources == NULL) {
+        fprintf(stderr, "Unable to allocate the input reactor sources\n");
+        goto input_reactor_thread_func_reactor_err;
+    }
+    reactor_devs->sources = (void*)sources;
+
+    input_opener_t opener = {
+        .stop = 0,
+        .opened_handler = {
+            .fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK),
+            .callback = input_reactor_opened_ready,
+            .user_data = (void*)&opener,
+        },
+        .logic = reactor_devs->logic,
+        .sources = sources,
+        .sources_count = reactor_devs->devs_count,
+    };
+    pthread_mutex_init(&opener.mutex, NULL);
+    pthread_cond_init(&opener.cond, NULL);
+
+    int prepare_res = 0;
+    for (size_t i = 0; i < reactor_devs->devs_count; ++i) {
+        sources[i].in_dev = reactor_devs->devs[i];
+        sources[i].reactor = &reactor;
+        sources[i].opener = &opener;
+        sources[i].state = INPUT_SOURCE_CLOSED;
+        sources[i].handler.fd = -1;
+        sources[i].opened_fd = -1;
+        sources[i].open_sysfs_idx = -1;
+        if (prepare_res == 0) {
+            prepare_res = input_ctx_prepare(sources[i].in_dev, &sources[i].ctx);
+        }
+    }
+
+    if (prepare_res != 0) {
+        fprintf(stderr, "Unable to prepare the input contexts: %d\n", prepare_res);
+        goto input_reactor_thread_func_ctx_err;
+    }
+
+    reactor_handler_t rumble_handler = {
+        .fd = reactor_devs->logic->rumble_event_fd,
+        .callback = input_reactor_rumble_ready,
+        .user_data = (void*)reactor_devs,
+    };
+
+    if ((rumble_handler.fd >= 0) && (reactor_add(&reactor, &rumble_handler, EPOLLIN) != 0)) {
+        fprintf(stderr, "Rumble requests will be ignored by the input reactor\n");
+    }
+
+    // devices that are missing (or that got lost) are opened as soon as udev reports them
+    hotplug_t *const hotplug = &reactor_devs->logic->hotplug;
+    reactor_handler_t hotplug_handler = {
+        .fd = hotplug_get_fd(hotplug),
+        .callback = input_reactor_hotplug_ready,
+        .user_data = (void*)reactor_devs,
+    };
+
+    hotplug_set_callback(hotplug, input_reactor_device_event, (void*)reactor_devs);
+    if ((hotplug_handler.fd >= 0) && (reactor_add(&reactor, &hotplug_handler, EPOLLIN) != 0)) {
+        hotplug_handler.fd = -1;
+    }
+
+    // ...or, without udev, looked for again on every tick of this timer
+    reactor_handler_t rescan_handler = {
+        .fd = -1,
+        .callback = input_reactor_rescan_ready,
+        .user_data = (void*)reactor_devs,
+    };
+
+    if (hotplug_handler.fd < 0) {
+        rescan_handler.fd = reactor_timer_create(INPUT_REACTOR_RESCAN_MS);
+        if ((rescan_handler.fd < 0) || (reactor_add(&reactor, &rescan_handler, EPOLLIN) != 0)) {
+            fprintf(stderr, "Unable to schedule input device discovery\n");
+            goto input_reactor_thread_func_sources_err;
+        }
+    }
+
+    if ((opener.opened_handler.fd < 0) || (reactor_add(&reactor, &opener.opened_handler, EPOLLIN) != 0)) {
+        fprintf(stderr, "Unable to receive the opened input devices\n");
+        goto input_reactor_thread_func_sources_err;
+    }
+
+    const int opener_creation = pthread_create(&opener.thread, NULL, input_opener_thread_func, (void*)&opener);
+    if (opener_creation != 0) {
+        fprintf(stderr, "Unable to start the input opener thread: %d\n", opener_creation);
+        goto input_reactor_thread_func_sources_err;
+    }
+
+    for (size_t i = 0; i < reactor_devs->devs_count; ++i) {
+        input_source_request_open(&sources[i]);
+    }
+
+    while (!logic_termination_requested(reactor_devs->logic)) {
+        const int run_res = reactor_run_once(&reactor, HOTPLUG_TERMINATION_CHECK_MS);
+        if (run_res < 0) {
+            fprintf(stderr, "Input reactor failed: %d\n", run_res);
+            break;
+        }
+    }
+
+    // a device being opened right now is waited for: it is released below
+    pthread_mutex_lock(&opener.mutex);
+    opener.stop = 1;
+    pthread_cond_signal(&opener.cond);
+    pthread_mutex_unlock(&opener.mutex);
+    pthread_join(opener.thread, NULL);
+
+    for (size_t i = 0; i < reactor_devs->devs_count; ++i) {
+        if (sources[i].state == INPUT_SOURCE_OPENED) {
+            input_source_release(&sources[i], sources[i].opened_fd);
+            sources[i].state = INPUT_SOURCE_CLOSED;
+        }
+
+        input_source_close(&sources[i]);
+    }
+
+    printf("Input reactor dispatched %lu events\n", (unsigned long)reactor.dispatched);
+
+input_reactor_thread_func_sources_err:
+    hotplug_set_callback(hotplug, NULL, NULL);
+
+    if (rescan_handler.fd >= 0) {
+        close(rescan_handler.fd);
+    }
+
+input_reactor_thread_func_ctx_err:
+    if (opener.opened_handler.fd >= 0) {
+        close(opener.opened_handler.fd);
+    }
+    pthread_cond_destroy(&opener.cond);
+    pthread_mutex_destroy(&opener.mutex);
+
+    // contexts never prepared are still zeroed: releasing them is a no-op
+    for (size_t i = 0; i < reactor_devs->devs_count; ++i) {
+        input_ctx_release(sources[i].in_dev, &sources[i].ctx);
+    }
+
+    reactor_devs->sources = NULL;
+    free(sources);
+
+input_reactor_thread_func_reactor_err:
+    reactor_destroy(&reactor);
+
     return NULL;
 }
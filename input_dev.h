@@ -39,8 +39,23 @@ typedef struct input_dev {
 
 } input_dev_t;
 
+/**
+ * Devices served by input_reactor_thread_func: a single epoll loop replaces one thread (or more) per device.
+ */
+typedef struct input_reactor_devs {
+    input_dev_t *const *devs;
+    size_t devs_count;
+
+    logic_t *logic;
+
+    // per-device state, owned by the reactor thread while it runs
+    void *sources;
+} input_reactor_devs_t;
+
 void *input_dev_thread_func(void *ptr);
 
+void *input_reactor_thread_func(void *ptr);
+
 int open_and_hide_input(void);
 
 uint32_t input_filter_imu_identity(struct input_event* events, size_t* size, uint32_t* count, uint32_t* flags);
@@ -0,0 +1,179 @@
+#include "input_map.h"
+
+#include <stddef.h>
+
+// RC71L keyboard device scan codes
+#define RC71L_SCAN_MODE_SWITCH  -13565784
+#define RC71L_SCAN_CC           -13565786
+#define RC71L_SCAN_GYRO_HOLD    -13565787
+#define RC71L_SCAN_AC           -13565896
+#define RC71L_SCAN_BACK_LEFT    458860
+#define RC71L_SCAN_BACK_RIGHT   458861
+
+#define HAT_ARG(keep, positive, negative) ((uint32_t)(keep) | ((uint32_t)(positive) << 8) | ((uint32_t)(negative) << 16))
+
+static input_map_entry_t store_u8(size_t offset) {
+    return (input_map_entry_t) { .op = INPUT_MAP_OP_STORE_U8, .offset = (uint16_t)offset, .arg = 0 };
+}
+
+static input_map_entry_t store_i32(size_t offset) {
+    return (input_map_entry_t) { .op = INPUT_MAP_OP_STORE_I32, .offset = (uint16_t)offset, .arg = 0 };
+}
+
+static input_map_entry_t set_flags(input_map_op_t op, uint32_t flags) {
+    return (input_map_entry_t) { .op = (uint8_t)op, .offset = 0, .arg = flags };
+}
+
+static input_map_entry_t hat(uint32_t arg) {
+    return (input_map_entry_t) { .op = INPUT_MAP_OP_HAT, .offset = 0, .arg = arg };
+}
+
+static int add_chord(
+    input_map_t *const map,
+    int32_t scan,
+    uint16_t code,
+    uint8_t any_length,
+    input_map_filter_t filter,
+    input_map_entry_t state
+) {
+    if (map->chords_count >= INPUT_MAP_MAX_CHORDS) {
+        fprintf(stderr, "Too many input map chords: the limit is %d\n", INPUT_MAP_MAX_CHORDS);
+        return -ENOMEM;
+    }
+
+    input_map_chord_t *const chord = &map->chords[map->chords_count++];
+    chord->scan = scan;
+    chord->code = code;
+    chord->any_length = any_length;
+    chord->filter = (uint8_t)filter;
+    chord->state = state;
+
+    // chains are searched in insertion order
+    chord->next = 0;
+    if (map->chord_index[code] == 0) {
+        map->chord_index[code] = (uint8_t)map->chords_count;
+    } else {
+        input_map_chord_t *last = &map->chords[map->chord_index[code] - 1];
+        while (last->next != 0) {
+            last = &map->chords[last->next - 1];
+        }
+        last->next = (uint8_t)map->chords_count;
+    }
+
+    return 0;
+}
+
+int input_map_compile(input_map_t *const map, const controller_settings_t *const settings) {
+    memset(map, 0, sizeof(input_map_t));
+
+    // face buttons: the nintendo layout swaps A/B and X/Y
+    const int nintendo = settings->nintendo_layout;
+    map->key[BTN_EAST] = store_u8(nintendo ? offsetof(gamepad_status_t, cross) : offsetof(gamepad_status_t, circle));
+    map->key[BTN_NORTH] = store_u8(nintendo ? offsetof(gamepad_status_t, triangle) : offsetof(gamepad_status_t, square));
+    map->key[BTN_SOUTH] = store_u8(nintendo ? offsetof(gamepad_status_t, circle) : offsetof(gamepad_status_t, cross));
+    map->key[BTN_WEST] = store_u8(nintendo ? offsetof(gamepad_status_t, square) : offsetof(gamepad_status_t, triangle));
+
+    map->key[BTN_TR] = store_u8(offsetof(gamepad_status_t, r1));
+    map->key[BTN_TL] = store_u8(offsetof(gamepad_status_t, l1));
+    map->key[BTN_THUMBR] = store_u8(offsetof(gamepad_status_t, r3));
+    map->key[BTN_THUMBL] = store_u8(offsetof(gamepad_status_t, l3));
+    map->key[BTN_MODE] = set_flags(INPUT_MAP_OP_SET_FLAGS, GAMEPAD_STATUS_FLAGS_PRESS_AND_REALEASE_CENTER);
+
+    map->abs[ABS_X] = store_i32(offsetof(gamepad_status_t, joystick_positions[0][0]));
+    map->abs[ABS_Y] = store_i32(offsetof(gamepad_status_t, joystick_positions[0][1]));
+    map->abs[ABS_RX] = store_i32(offsetof(gamepad_status_t, joystick_positions[1][0]));
+    map->abs[ABS_RY] = store_i32(offsetof(gamepad_status_t, joystick_positions[1][1]));
+    map->abs[ABS_Z] = store_u8(offsetof(gamepad_status_t, l2_trigger));
+    map->abs[ABS_RZ] = store_u8(offsetof(gamepad_status_t, r2_trigger));
+    map->abs[ABS_HAT0X] = hat(HAT_ARG(0xF0, 0x01, 0x02));
+    map->abs[ABS_HAT0Y] = hat(HAT_ARG(0x0F, 0x20, 0x10));
+
+    const input_map_entry_t no_state = { .op = INPUT_MAP_OP_NONE, .offset = 0, .arg = 0 };
+    const input_map_entry_t qam = settings->enable_qam ?
+        set_flags(INPUT_MAP_OP_SET_FLAGS_ON_PRESS, GAMEPAD_STATUS_FLAGS_OPEN_STEAM_QAM) : no_state;
+
+    int res = 0;
+    res = res ? res : add_chord(map, RC71L_SCAN_MODE_SWITCH, KEY_F18, 1, INPUT_MAP_FILTER_MODE_SWITCH, no_state);
+    res = res ? res : add_chord(map, RC71L_SCAN_MODE_SWITCH, INPUT_MAP_ANY_KEY, 1, INPUT_MAP_FILTER_DROP, no_state);
+    res = res ? res : add_chord(map, RC71L_SCAN_BACK_LEFT, KEY_F17, 0, INPUT_MAP_FILTER_GEAR_DOWN, store_u8(offsetof(gamepad_status_t, l4)));
+    res = res ? res : add_chord(map, RC71L_SCAN_BACK_RIGHT, KEY_F18, 0, INPUT_MAP_FILTER_GEAR_UP, store_u8(offsetof(gamepad_status_t, r4)));
+    res = res ? res : add_chord(map, RC71L_SCAN_CC, KEY_F16, 0, INPUT_MAP_FILTER_BTN_MODE,
+        set_flags(INPUT_MAP_OP_SET_FLAGS_ON_PRESS, GAMEPAD_STATUS_FLAGS_PRESS_AND_REALEASE_CENTER));
+    res = res ? res : add_chord(map, RC71L_SCAN_GYRO_HOLD, KEY_F15, 0, INPUT_MAP_FILTER_GYRO_HOLD, no_state);
+    res = res ? res : add_chord(map, RC71L_SCAN_AC, KEY_PROG1, 0, INPUT_MAP_FILTER_NONE, qam);
+
+    return res;
+}
+
+static const input_map_chord_t* find_in_chain(const input_map_t *const map, uint8_t index, const ev_message_t *const ev_msg) {
+    while (index != 0) {
+        const input_map_chord_t *const chord = &map->chords[index - 1];
+        if ((chord->scan == ev_msg->ev[0].value) && ((chord->any_length) || (ev_msg->ev_count == 2))) {
+            return chord;
+        }
+
+        index = chord->next;
+    }
+
+    return NULL;
+}
+
+const input_map_chord_t* input_map_find_chord(const input_map_t *const map, const ev_message_t *const ev_msg) {
+    if ((ev_msg->ev_count < 2) || (ev_msg->ev[0].type != EV_MSC) || (ev_msg->ev[0].code != MSC_SCAN)) {
+        return NULL;
+    }
+
+    if ((ev_msg->ev[1].type == EV_KEY) && (ev_msg->ev[1].code < KEY_CNT)) {
+        const input_map_chord_t *const chord = find_in_chain(map, map->chord_index[ev_msg->ev[1].code], ev_msg);
+        if (chord != NULL) {
+            return chord;
+        }
+    }
+
+    return find_in_chain(map, map->chord_index[INPUT_MAP_ANY_KEY], ev_msg);
+}
+
+static inline void apply_entry(const input_map_entry_t *const entry, gamepad_status_t *const gs, int32_t value) {
+    uint8_t *const base = (uint8_t*)gs;
+
+    switch (entry->op) {
+        case INPUT_MAP_OP_STORE_U8:
+            base[entry->offset] = (uint8_t)value;
+            break;
+        case INPUT_MAP_OP_STORE_I32:
+            memcpy(&base[entry->offset], &value, sizeof(int32_t));
+            break;
+        case INPUT_MAP_OP_HAT: {
+            const uint8_t bits = (value == 1) ? (uint8_t)(entry->arg >> 8) : ((value == -1) ? (uint8_t)(entry->arg >> 16) : 0);
+            gs->dpad = (gs->dpad & (uint8_t)entry->arg) | bits;
+            break;
+        }
+        case INPUT_MAP_OP_SET_FLAGS:
+            gs->flags |= entry->arg;
+            break;
+        case INPUT_MAP_OP_SET_FLAGS_ON_PRESS:
+            if (value == 1) {
+                gs->flags |= entry->arg;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void input_map_apply(const input_map_t *const map, gamepad_status_t *const gs, const ev_message_t *const ev_msg) {
+    const input_map_chord_t *const chord = input_map_find_chord(map, ev_msg);
+    if (chord != NULL) {
+        apply_entry(&chord->state, gs, ev_msg->ev[1].value);
+    }
+
+    for (uint32_t i = 0; i < ev_msg->ev_count; ++i) {
+        const struct input_event *const ev = &ev_msg->ev[i];
+
+        if ((ev->type == EV_KEY) && (ev->code < KEY_CNT)) {
+            apply_entry(&map->key[ev->code], gs, ev->value);
+        } else if ((ev->type == EV_ABS) && (ev->code < ABS_CNT)) {
+            apply_entry(&map->abs[ev->code], gs, ev->value);
+        }
+    }
+}
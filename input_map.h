@@ -0,0 +1,85 @@
+#pragma once
+
+#include "logic.h"
+#include "message.h"
+#include "settings.h"
+
+/*
+ * Evdev -> gamepad_status_t mapping compiled from the settings into dense tables: every event is
+ * dispatched with one load indexed by its code, and layout options (i.e. nintendo_layout) are
+ * resolved while compiling instead of being tested for every event.
+ */
+
+typedef enum input_map_op {
+    INPUT_MAP_OP_NONE = 0,
+    INPUT_MAP_OP_STORE_U8,          // uint8_t field at offset = value
+    INPUT_MAP_OP_STORE_I32,         // int32_t field at offset = value
+    INPUT_MAP_OP_HAT,               // dpad nibble: arg = keep mask | positive bits << 8 | negative bits << 16
+    INPUT_MAP_OP_SET_FLAGS,         // flags |= arg on any value
+    INPUT_MAP_OP_SET_FLAGS_ON_PRESS,// flags |= arg when value is 1
+} input_map_op_t;
+
+typedef struct input_map_entry {
+    uint8_t op;
+    uint16_t offset;
+    uint32_t arg;
+} input_map_entry_t;
+
+// what the output thread does with a MSC_SCAN + EV_KEY frame before it is applied and emitted
+typedef enum input_map_filter {
+    INPUT_MAP_FILTER_NONE = 0,
+    INPUT_MAP_FILTER_DROP,          // never emitted
+    INPUT_MAP_FILTER_MODE_SWITCH,   // cycle the platform mode on press, never emitted
+    INPUT_MAP_FILTER_GEAR_DOWN,     // BTN_GEAR_DOWN in mouse mode, gyro-to-mouse hold in gamepad mode
+    INPUT_MAP_FILTER_GEAR_UP,       // BTN_GEAR_UP in mouse mode, gyro-to-mouse hold in gamepad mode
+    INPUT_MAP_FILTER_BTN_MODE,      // rewritten as a BTN_MODE press/release
+    INPUT_MAP_FILTER_GYRO_HOLD,     // gyro mode while held, never emitted
+} input_map_filter_t;
+
+/*
+ * Some RC71L keys are only told apart by the MSC_SCAN value preceding them: a chord is
+ * (scan, key code) and the key code indexes its chain, at most a couple of entries long.
+ */
+typedef struct input_map_chord {
+    int32_t scan;
+    uint16_t code;
+
+    // 0: frames of exactly two events (scan + key) only, 1: the scan may be followed by more events
+    uint8_t any_length;
+
+    uint8_t filter;
+
+    input_map_entry_t state;
+
+    // 1-based index of the next chord sharing the key code, 0 ends the chain
+    uint8_t next;
+} input_map_chord_t;
+
+#define INPUT_MAP_MAX_CHORDS    16
+
+// chain used when no chord matches the key code: the scan alone decides
+#define INPUT_MAP_ANY_KEY       KEY_CNT
+
+typedef struct input_map {
+    input_map_entry_t key[KEY_CNT];
+    input_map_entry_t abs[ABS_CNT];
+
+    uint8_t chord_index[KEY_CNT + 1];
+    input_map_chord_t chords[INPUT_MAP_MAX_CHORDS];
+    size_t chords_count;
+} input_map_t;
+
+/**
+ * Build the tables for the given settings: call again whenever the settings change.
+ */
+int input_map_compile(input_map_t *const map, const controller_settings_t *const settings);
+
+/**
+ * Find the chord matching a frame starting with MSC_SCAN, NULL if the frame is not a known chord.
+ */
+const input_map_chord_t* input_map_find_chord(const input_map_t *const map, const ev_message_t *const ev_msg);
+
+/**
+ * Apply every event of an evdev frame to the gamepad status.
+ */
+void input_map_apply(const input_map_t *const map, gamepad_status_t *const gs, const ev_message_t *const ev_msg);
@@ -0,0 +1,166 @@
+#include "latency.h"
+
+static latency_histogram_t source_histograms[LATENCY_SOURCE_COUNT][LATENCY_STAGE_COUNT];
+static latency_histogram_t output_histograms[LATENCY_OUTPUT_COUNT][LATENCY_INPUT_KIND_COUNT];
+
+static atomic_int dump_requested = 0;
+
+static const char *const source_names[LATENCY_SOURCE_COUNT] = {
+    [MSG_TYPE_EV] = "evdev",
+    [MSG_TYPE_IMU] = "imu",
+    [MSG_TYPE_HIDRAW] = "hidraw",
+};
+
+static const char *const stage_names[LATENCY_STAGE_COUNT] = {
+    [LATENCY_STAGE_READ_TO_ENQUEUE] = "read->enqueue",
+    [LATENCY_STAGE_ENQUEUE_TO_DEQUEUE] = "enqueue->dequeue",
+    [LATENCY_STAGE_DEQUEUE_TO_APPLY] = "dequeue->apply",
+    [LATENCY_STAGE_READ_TO_APPLY] = "read->apply",
+};
+
+static const char *const output_names[LATENCY_OUTPUT_COUNT] = {
+    [LATENCY_OUTPUT_EVDEV] = "evdev",
+    [LATENCY_OUTPUT_DS4] = "ds4",
+    [LATENCY_OUTPUT_DS5] = "ds5",
+};
+
+static const char *const input_kind_names[LATENCY_INPUT_KIND_COUNT] = {
+    [LATENCY_INPUT_BUTTONS] = "buttons",
+    [LATENCY_INPUT_IMU] = "imu",
+};
+
+static size_t bucket_index(uint64_t value_ns) {
+    if (value_ns > LATENCY_MAX_VALUE_NS) {
+        value_ns = LATENCY_MAX_VALUE_NS;
+    }
+
+    if (value_ns < LATENCY_SUB_BUCKETS) {
+        return (size_t)value_ns;
+    }
+
+    // group g >= 1 covers [2^(g + bits - 1), 2^(g + bits)) with LATENCY_SUB_BUCKETS buckets
+    const unsigned int msb = 63U - (unsigned int)__builtin_clzll(value_ns);
+    const unsigned int group = msb - LATENCY_SUB_BUCKET_BITS + 1;
+    const size_t sub = (size_t)(value_ns >> (group - 1)) & (LATENCY_SUB_BUCKETS - 1);
+
+    return ((size_t)group * LATENCY_SUB_BUCKETS) + sub;
+}
+
+static uint64_t bucket_upper_bound(size_t index) {
+    const size_t group = index / LATENCY_SUB_BUCKETS;
+    const uint64_t sub = index % LATENCY_SUB_BUCKETS;
+
+    if (group == 0) {
+        return sub;
+    }
+
+    const uint64_t lower = (LATENCY_SUB_BUCKETS + sub) << (group - 1);
+    return lower + (1ULL << (group - 1)) - 1;
+}
+
+void latency_histogram_record(latency_histogram_t *const hist, uint64_t value_ns) {
+    atomic_fetch_add_explicit(&hist->counts[bucket_index(value_ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&hist->total, 1, memory_order_relaxed);
+
+    uint_fast64_t max_ns = atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+    while ((value_ns > max_ns) && (!atomic_compare_exchange_weak_explicit(&hist->max_ns, &max_ns, value_ns, memory_order_relaxed, memory_order_relaxed))) {
+        // max_ns has been reloaded: try again
+    }
+}
+
+uint64_t latency_histogram_percentile(const latency_histogram_t *const hist, double fraction) {
+    const uint64_t total = atomic_load_explicit(&hist->total, memory_order_relaxed);
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t target = (uint64_t)ceil(fraction * (double)total);
+    if (target == 0) {
+        target = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += atomic_load_explicit(&hist->counts[i], memory_order_relaxed);
+        if (seen >= target) {
+            return bucket_upper_bound(i);
+        }
+    }
+
+    // counters are read while being updated: fall back to the largest value seen
+    return atomic_load_explicit(&hist->max_ns, memory_order_relaxed);
+}
+
+static uint64_t elapsed_ns(uint64_t from_ns, uint64_t to_ns) {
+    return (to_ns > from_ns) ? to_ns - from_ns : 0;
+}
+
+void latency_record_message(const message_t *const msg) {
+    if ((msg->type < 0) || (msg->type >= LATENCY_SOURCE_COUNT) || (msg->ts.read_ns == 0)) {
+        return;
+    }
+
+    latency_histogram_t *const hist = source_histograms[msg->type];
+
+    latency_histogram_record(&hist[LATENCY_STAGE_READ_TO_ENQUEUE], elapsed_ns(msg->ts.read_ns, msg->ts.enqueue_ns));
+    latency_histogram_record(&hist[LATENCY_STAGE_ENQUEUE_TO_DEQUEUE], elapsed_ns(msg->ts.enqueue_ns, msg->ts.dequeue_ns));
+    latency_histogram_record(&hist[LATENCY_STAGE_DEQUEUE_TO_APPLY], elapsed_ns(msg->ts.dequeue_ns, msg->ts.apply_ns));
+    latency_histogram_record(&hist[LATENCY_STAGE_READ_TO_APPLY], elapsed_ns(msg->ts.read_ns, msg->ts.apply_ns));
+}
+
+void latency_record_output(latency_output_t output, latency_input_kind_t kind, uint64_t read_ns) {
+    if (read_ns == 0) {
+        return;
+    }
+
+    latency_histogram_record(&output_histograms[output][kind], elapsed_ns(read_ns, latency_now_ns()));
+}
+
+static void dump_histogram(FILE *const out, const char *const name, const char *const stage, const latency_histogram_t *const hist) {
+    const uint64_t total = atomic_load_explicit(&hist->total, memory_order_relaxed);
+    if (total == 0) {
+        return;
+    }
+
+    fprintf(
+        out,
+        "%-8s %-18s %10" PRIu64 " samples  p50 %8.1fus  p99 %8.1fus  p99.9 %8.1fus  max %8.1fus\n",
+        name,
+        stage,
+        total,
+        (double)latency_histogram_percentile(hist, 0.5) / 1000.0,
+        (double)latency_histogram_percentile(hist, 0.99) / 1000.0,
+        (double)latency_histogram_percentile(hist, 0.999) / 1000.0,
+        (double)atomic_load_explicit(&hist->max_ns, memory_order_relaxed) / 1000.0
+    );
+}
+
+void latency_dump(FILE *const out) {
+    fprintf(out, "---------------- latency ----------------\n");
+
+    for (int s = 0; s < LATENCY_SOURCE_COUNT; ++s) {
+        for (int st = 0; st < LATENCY_STAGE_COUNT; ++st) {
+            dump_histogram(out, source_names[s], stage_names[st], &source_histograms[s][st]);
+        }
+    }
+
+    char stage[32];
+    for (int o = 0; o < LATENCY_OUTPUT_COUNT; ++o) {
+        for (int k = 0; k < LATENCY_INPUT_KIND_COUNT; ++k) {
+            snprintf(stage, sizeof(stage), "%s->report", input_kind_names[k]);
+            dump_histogram(out, output_names[o], stage, &output_histograms[o][k]);
+        }
+    }
+
+    fflush(out);
+}
+
+void latency_request_dump(void) {
+    atomic_store_explicit(&dump_requested, 1, memory_order_relaxed);
+}
+
+void latency_dump_if_requested(FILE *const out) {
+    if (atomic_exchange_explicit(&dump_requested, 0, memory_order_relaxed) != 0) {
+        latency_dump(out);
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "rogue_enemy.h"
+#include "message.h"
+
+/*
+ * Log-linear ("HDR") histogram: values below 2^LATENCY_SUB_BUCKET_BITS ns get their own bucket,
+ * every following power of two is split into 2^LATENCY_SUB_BUCKET_BITS equal buckets so that the
+ * relative error stays below ~3% from nanoseconds up to LATENCY_MAX_VALUE_NS.
+ */
+#define LATENCY_SUB_BUCKET_BITS     5
+#define LATENCY_SUB_BUCKETS         (1U << LATENCY_SUB_BUCKET_BITS)
+#define LATENCY_MAX_VALUE_BITS      36 // ~68s
+#define LATENCY_MAX_VALUE_NS        ((1ULL << LATENCY_MAX_VALUE_BITS) - 1)
+#define LATENCY_BUCKETS             ((LATENCY_MAX_VALUE_BITS - LATENCY_SUB_BUCKET_BITS + 1) * LATENCY_SUB_BUCKETS)
+
+typedef struct latency_histogram {
+    atomic_uint_fast64_t counts[LATENCY_BUCKETS];
+    atomic_uint_fast64_t total;
+    atomic_uint_fast64_t max_ns;
+} latency_histogram_t;
+
+// latency stages of a message, measured from the CLOCK_MONOTONIC stamps in message_t
+typedef enum latency_stage {
+    LATENCY_STAGE_READ_TO_ENQUEUE = 0,
+    LATENCY_STAGE_ENQUEUE_TO_DEQUEUE,
+    LATENCY_STAGE_DEQUEUE_TO_APPLY,
+    LATENCY_STAGE_READ_TO_APPLY,
+    LATENCY_STAGE_COUNT,
+} latency_stage_t;
+
+#define LATENCY_SOURCE_COUNT    (MSG_TYPE_HIDRAW + 1)
+
+// end-to-end latency from the read of an input to the first report (or evdev frame) carrying it
+typedef enum latency_output {
+    LATENCY_OUTPUT_EVDEV = 0,
+    LATENCY_OUTPUT_DS4,
+    LATENCY_OUTPUT_DS5,
+    LATENCY_OUTPUT_COUNT,
+} latency_output_t;
+
+typedef enum latency_input_kind {
+    LATENCY_INPUT_BUTTONS = 0,
+    LATENCY_INPUT_IMU,
+    LATENCY_INPUT_KIND_COUNT,
+} latency_input_kind_t;
+
+static inline uint64_t latency_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+void latency_histogram_record(latency_histogram_t *const hist, uint64_t value_ns);
+
+/**
+ * Value (upper bound of its bucket) below which the given fraction (0..1) of the samples fall, 0 if there are none.
+ */
+uint64_t latency_histogram_percentile(const latency_histogram_t *const hist, double fraction);
+
+/**
+ * Record every stage of a message that has just been applied to the gamepad status.
+ */
+void latency_record_message(const message_t *const msg);
+
+/**
+ * Record the time elapsed from read_ns to now for a report written to the given output.
+ */
+void latency_record_output(latency_output_t output, latency_input_kind_t kind, uint64_t read_ns);
+
+void latency_dump(FILE *const out);
+
+/**
+ * Async-signal-safe: ask for a dump, performed by latency_dump_if_requested on a regular thread.
+ */
+void latency_request_dump(void);
+
+void latency_dump_if_requested(FILE *const out);
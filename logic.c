@@ -3,8 +3,14 @@
 #include "queue.h"
 #include "virt_ds4.h"
 #include "virt_ds5.h"
+#include "message_pool.h"
+#include "ring_log.h"
+#include "trace.h"
+#include "metrics.h"
 
-static const char* configuration_file = "/etc/ROGueENEMY/config.cfg";
+#include <sys/eventfd.h>
+
+static const char* configuration_file = CONFIGURATION_DIR "/" CONFIGURATION_FILE_NAME;
 
 int logic_create(logic_t *const logic) {
     logic->flags = 0x00000000U;
@@ -29,18 +35,50 @@ int logic_create(logic_t *const logic) {
     logic->gamepad.l4 = 0;
     logic->gamepad.r5 = 0;
     logic->gamepad.l5 = 0;
-    logic->gamepad.rumble_events_count = 0;
     memset(logic->gamepad.gyro, 0, sizeof(logic->gamepad.gyro));
     memset(logic->gamepad.accel, 0, sizeof(logic->gamepad.accel));
+    logic->gamepad.orientation[0] = 1.0;
+    memset(&logic->gamepad.orientation[1], 0, sizeof(double[3]));
+    memset(logic->gamepad.gravity, 0, sizeof(logic->gamepad.gravity));
     logic->gamepad.flags = 0;
+    logic->gamepad.last_input_read_ns = 0;
+    logic->gamepad.last_imu_read_ns = 0;
+
+    atomic_init(&logic->gamepad_seq, 0);
 
-    const int mutex_creation_res = pthread_mutex_init(&logic->gamepad_mutex, NULL);
+    const int mutex_creation_res = pthread_mutex_init(&logic->gamepad_write_mutex, NULL);
     if (mutex_creation_res != 0) {
         fprintf(stderr, "Unable to create mutex: %d\n", mutex_creation_res);
         return mutex_creation_res;
     }
 
+    // configuration has to be ready before any thread reading it is started
+    init_config(&logic->controller_settings);
+    const int fill_config_res = fill_config(&logic->controller_settings, configuration_file);
+    if (fill_config_res != 0) {
+        fprintf(stderr, "Unable to fill configuration from file %s\n", configuration_file);
+    }
+
+    ring_log_set_level((ring_log_level_t)logic->controller_settings.log_level);
+    trace_set_enabled(logic->controller_settings.flight_recorder);
+
     const int queue_init_res = queue_init(&logic->input_queue, 128);
+
+    atomic_init(&logic->report_idle, 0);
+    logic->gamepad_update_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (logic->gamepad_update_fd < 0) {
+        fprintf(stderr, "Unable to create the gamepad update eventfd: %d. Reports will be periodic.\n", errno);
+        logic->controller_settings.report_on_change = 0;
+    }
+
+    // the virtual controllers request rumble as soon as their threads start
+    atomic_init(&logic->rumble_request, 0);
+    logic->rumble_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (logic->rumble_event_fd < 0) {
+        fprintf(stderr, "Unable to create the rumble eventfd: %d -- rumble will not work.\n", errno);
+    }
+
+    atomic_init(&logic->settings, &logic->controller_settings);
     
     const int virt_ds4_thread_creation = pthread_create(&logic->virt_ds4_thread, NULL, virt_ds4_thread_func, (void*)(logic));
 	if (virt_ds4_thread_creation != 0) {
@@ -87,13 +125,10 @@ int logic_create(logic_t *const logic) {
         fprintf(stderr, "Unable to initialize Asus RC71L MCU: %d\n", init_platform_res);
     }
 
-    queue_init(&logic->rumble_events_queue, 1);
+    atomic_init(&logic->imu_mailbox, NULL);
 
-    init_config(&logic->controller_settings);
-    const int fill_config_res = fill_config(&logic->controller_settings, configuration_file);
-    if (fill_config_res != 0) {
-        fprintf(stderr, "Unable to fill configuration from file %s\n", configuration_file);
-    }
+    // without udev the readers keep working, they just look for their devices periodically
+    hotplug_init(&logic->hotplug);
 
     return 0;
 }
@@ -102,10 +137,49 @@ int is_rc71l_ready(const logic_t *const logic) {
     return logic->flags & LOGIC_FLAGS_PLATFORM_ENABLE;
 }
 
+void logic_read_gamepad_status(logic_t *const logic, gamepad_status_t *const out) {
+    for (;;) {
+        for (int attempt = 0; attempt < LOGIC_GAMEPAD_READ_RETRIES; ++attempt) {
+            const unsigned int seq_begin = atomic_load_explicit(&logic->gamepad_seq, memory_order_acquire);
+            if (seq_begin & 1U) {
+                // a writer is half-way through: it is never blocked on us, so give it the CPU and retry
+                sched_yield();
+                continue;
+            }
+
+            memcpy(out, (const void*)&logic->gamepad, sizeof(gamepad_status_t));
+
+            atomic_thread_fence(memory_order_acquire);
+            if (atomic_load_explicit(&logic->gamepad_seq, memory_order_relaxed) == seq_begin) {
+                return;
+            }
+        }
+
+        // sched_yield() never hands the CPU to a lower SCHED_FIFO priority writer on this core: sleep on the
+        // writers' mutex instead, the status cannot change while it is held
+        if (pthread_mutex_lock(&logic->gamepad_write_mutex) == 0) {
+            memcpy(out, (const void*)&logic->gamepad, sizeof(gamepad_status_t));
+            pthread_mutex_unlock(&logic->gamepad_write_mutex);
+            return;
+        }
+
+        // the mutex is unusable: a short sleep still lets the writer run
+        usleep(100);
+    }
+}
+
 int logic_copy_gamepad_status(logic_t *const logic, gamepad_status_t *const out) {
     int res = 0;
 
-    res = pthread_mutex_lock(&logic->gamepad_mutex);
+    logic_read_gamepad_status(logic, out);
+
+    // the common case: no button macro is in progress and the snapshot can be used as-is
+    if ((out->flags & (GAMEPAD_STATUS_FLAGS_PRESS_AND_REALEASE_CENTER | GAMEPAD_STATUS_FLAGS_OPEN_STEAM_QAM)) == 0) {
+        return res;
+    }
+
+    // a macro advances the shared status over time: do that as a regular writer
+    res = logic_begin_status_update(logic);
     if (res != 0) {
         goto logic_copy_gamepad_status_err;
     }
@@ -166,9 +240,10 @@ int logic_copy_gamepad_status(logic_t *const logic, gamepad_status_t *const out)
         }
     }
 
-    *out = logic->gamepad;
+    // no other writer can run while we hold the write lock
+    memcpy(out, (const void*)&logic->gamepad, sizeof(gamepad_status_t));
 
-    pthread_mutex_unlock(&logic->gamepad_mutex);
+    logic_end_status_update(logic);
 
 logic_copy_gamepad_status_err:
     return res;
@@ -178,17 +253,102 @@ logic_copy_gamepad_status_err:
 int logic_begin_status_update(logic_t *const logic) {
     int res = 0;
 
-    res = pthread_mutex_lock(&logic->gamepad_mutex);
+    res = pthread_mutex_lock(&logic->gamepad_write_mutex);
     if (res != 0) {
         goto logic_begin_status_update_err;
     }
 
+    // make the sequence odd before touching the status so readers discard what they copy meanwhile
+    const unsigned int seq = atomic_load_explicit(&logic->gamepad_seq, memory_order_relaxed);
+    atomic_store_explicit(&logic->gamepad_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
 logic_begin_status_update_err:
     return res;
 }
 
 void logic_end_status_update(logic_t *const logic) {
-    pthread_mutex_unlock(&logic->gamepad_mutex);
+    const unsigned int seq = atomic_load_explicit(&logic->gamepad_seq, memory_order_relaxed);
+    atomic_store_explicit(&logic->gamepad_seq, seq + 1, memory_order_release);
+
+    pthread_mutex_unlock(&logic->gamepad_write_mutex);
+}
+
+void logic_notify_gamepad_update(logic_t *const logic) {
+    if (logic->gamepad_update_fd < 0) {
+        return;
+    }
+
+    // the counter accumulates: any number of notifications collapse into a single wakeup
+    const uint64_t one = 1;
+    if (write(logic->gamepad_update_fd, &one, sizeof(one)) != sizeof(one)) {
+        if (errno != EAGAIN) {
+            RING_LOG(RING_LOG_ERROR, "Unable to signal a gamepad update: %d\n", errno);
+        }
+    }
+}
+
+void logic_ack_gamepad_update(logic_t *const logic) {
+    uint64_t count;
+    if (read(logic->gamepad_update_fd, &count, sizeof(count)) != sizeof(count)) {
+        if (errno != EAGAIN) {
+            RING_LOG(RING_LOG_ERROR, "Unable to consume a gamepad update: %d\n", errno);
+        }
+    }
+}
+
+void logic_set_report_idle(logic_t *const logic, int idle) {
+    atomic_store_explicit(&logic->report_idle, idle, memory_order_relaxed);
+}
+
+int logic_report_idle(logic_t *const logic) {
+    return atomic_load_explicit(&logic->report_idle, memory_order_relaxed);
+}
+
+void logic_request_rumble(logic_t *const logic, uint16_t strong_magnitude, uint16_t weak_magnitude) {
+    atomic_store_explicit(&logic->rumble_request, ((uint32_t)strong_magnitude << 16) | (uint32_t)weak_magnitude, memory_order_release);
+
+    if (logic->rumble_event_fd < 0) {
+        return;
+    }
+
+    const uint64_t one = 1;
+    if (write(logic->rumble_event_fd, &one, sizeof(one)) != sizeof(one)) {
+        if (errno != EAGAIN) {
+            RING_LOG(RING_LOG_ERROR, "Unable to signal a rumble request: %d\n", errno);
+        }
+    }
+}
+
+int logic_take_rumble(logic_t *const logic, rumble_message_t *const out) {
+    // reading the eventfd resets it: every request signalled so far collapses into the latest value
+    uint64_t count;
+    if (read(logic->rumble_event_fd, &count, sizeof(count)) != sizeof(count)) {
+        return -1;
+    }
+
+    const uint32_t request = atomic_load_explicit(&logic->rumble_request, memory_order_acquire);
+    out->strong_magnitude = (uint16_t)(request >> 16);
+    out->weak_magnitude = (uint16_t)(request & 0xFFFF);
+
+    return 0;
+}
+
+void logic_post_imu(logic_t *const logic, message_t *const msg) {
+    message_t *const stale = atomic_exchange_explicit(&logic->imu_mailbox, msg, memory_order_acq_rel);
+    if (stale != NULL) {
+        // never seen by the output thread: superseded by the newer sample
+        metrics_count_drop(METRICS_DROP_IMU_REPLACED);
+        message_pool_release(stale);
+        return;
+    }
+
+    // the mailbox was empty: the output thread could be sleeping on the buttons lane
+    queue_wake_consumers(&logic->input_queue);
+}
+
+message_t* logic_take_imu(logic_t *const logic) {
+    return atomic_exchange_explicit(&logic->imu_mailbox, NULL, memory_order_acq_rel);
 }
 
 void logic_request_termination(logic_t *const logic) {
@@ -197,4 +357,32 @@ void logic_request_termination(logic_t *const logic) {
 
 int logic_termination_requested(logic_t *const logic) {
     return (logic->flags & LOGIC_FLAGS_TERMINATION_REQUESTED) != 0;
-}
\ No newline at end of file
+}
+const controller_settings_t* logic_get_settings(logic_t *const logic) {
+    return atomic_load_explicit(&logic->settings, memory_order_acquire);
+}
+
+int logic_reload_settings(logic_t *const logic) {
+    controller_settings_t *const next = malloc(sizeof(controller_settings_t));
+    if (next == NULL) {
+        return -ENOMEM;
+    }
+
+    init_config(next);
+    const int fill_config_res = fill_config(next, configuration_file);
+    if (fill_config_res != 0) {
+        fprintf(stderr, "Unable to reload configuration from file %s: keeping the running one\n", configuration_file);
+        free(next);
+        return fill_config_res;
+    }
+
+    copy_startup_only_config(next, logic_get_settings(logic));
+
+    // fully built before being published: a reader sees either the old snapshot or the complete new one
+    atomic_store_explicit(&logic->settings, next, memory_order_release);
+
+    ring_log_set_level((ring_log_level_t)next->log_level);
+    trace_set_enabled(next->flight_recorder);
+
+    return 0;
+}
@@ -3,12 +3,17 @@
 #include "platform.h"
 #include "queue.h"
 #include "settings.h"
+#include "message.h"
+#include "hotplug.h"
 
 #define PRESS_AND_RELEASE_DURATION_FOR_CENTER_BUTTON_MS     80
 #define PRESS_TIME_BEFORE_CROSS_BUTTON_MS                   250
 #define PRESS_TIME_CROSS_BUTTON_MS                          80
 #define PRESS_TIME_AFTER_CROSS_BUTTON_MS                    180
 
+// lock-free attempts at reading the gamepad status before waiting on the writers' mutex
+#define LOGIC_GAMEPAD_READ_RETRIES                          64
+
 #define GAMEPAD_STATUS_FLAGS_PRESS_AND_REALEASE_CENTER  0x00000001U
 #define GAMEPAD_STATUS_FLAGS_OPEN_STEAM_QAM             0x00000002U
 
@@ -55,8 +60,14 @@ typedef struct gamepad_status {
     int16_t raw_gyro[3];
     int16_t raw_accel[3];
 
-    uint64_t rumble_events_count;
-    uint8_t motors_intensity[2]; // 0 = left, 1 = right
+    // only updated when the IMU fusion is enabled: w, x, y, z from the device to the earth frame and the
+    // unit vector pointing up, in the gyro/accel frame
+    double orientation[4];
+    double gravity[3];
+
+    // CLOCK_MONOTONIC read time (ns) of the last buttons/axes and IMU messages applied, for latency tracking
+    uint64_t last_input_read_ns;
+    uint64_t last_imu_read_ns;
 
     volatile uint32_t flags;
 
@@ -82,11 +93,28 @@ typedef struct logic {
 
     rc71l_platform_t platform;
 
-    pthread_mutex_t gamepad_mutex;
+    // seqlock: odd while a writer is updating gamepad, readers retry instead of locking
+    atomic_uint gamepad_seq;
+
+    // only serializes writers (input decoding, rumble requests): readers never take it
+    pthread_mutex_t gamepad_write_mutex;
     gamepad_status_t gamepad;
 
+    // buttons/axes lane: every evdev and hidraw frame, in order, none is ever dropped
     queue_t input_queue;
 
+    // IMU lane: only the latest sample is kept, a newer one replaces (and releases) the one not handled yet
+    _Atomic(message_t*) imu_mailbox;
+
+    // device add/remove notifications: input readers wait on it instead of polling for their device
+    hotplug_t hotplug;
+
+    // eventfd signalled by the output thread when buttons/axes changed (used when report_on_change is set)
+    int gamepad_update_fd;
+
+    // set while the active reporter is idle (timer at the keepalive rate): IMU samples then signal gamepad_update_fd too
+    atomic_int report_idle;
+
     pthread_t virt_ds4_thread;
 
     pthread_t virt_ds5_thread;
@@ -97,10 +125,19 @@ typedef struct logic {
     //pthread_mutex_t gamepad_output_mutex;
     gamepad_output_t gamepad_output;
 
-    queue_t rumble_events_queue;
+    // latest rumble request packed as (strong << 16) | weak: a newer request overwrites one not played yet
+    atomic_uint_fast32_t rumble_request;
+
+    // eventfd signalled on every rumble request, the force-feedback writer sleeps on it
+    int rumble_event_fd;
 
+    // settings as loaded at startup: what is only read once (devices, threads, files) comes from here
     controller_settings_t controller_settings;
 
+    // current immutable settings snapshot, replaced as a whole by a reload: readers take no lock, and a replaced
+    // snapshot is never freed as they hold no reference to it (reloads are rare, user-initiated events)
+    _Atomic(const controller_settings_t*) settings;
+
 } logic_t;
 
 int logic_create(logic_t *const logic);
@@ -109,10 +146,35 @@ int is_rc71l_ready(const logic_t *const logic);
 
 int logic_copy_gamepad_status(logic_t *const logic, gamepad_status_t *const out);
 
+void logic_read_gamepad_status(logic_t *const logic, gamepad_status_t *const out);
+
 int logic_begin_status_update(logic_t *const logic);
 
 void logic_end_status_update(logic_t *const logic);
 
+void logic_notify_gamepad_update(logic_t *const logic);
+
+void logic_ack_gamepad_update(logic_t *const logic);
+
+void logic_set_report_idle(logic_t *const logic, int idle);
+
+int logic_report_idle(logic_t *const logic);
+
+void logic_request_rumble(logic_t *const logic, uint16_t strong_magnitude, uint16_t weak_magnitude);
+
+int logic_take_rumble(logic_t *const logic, rumble_message_t *const out);
+
+void logic_post_imu(logic_t *const logic, message_t *const msg);
+
+message_t* logic_take_imu(logic_t *const logic);
+
+const controller_settings_t* logic_get_settings(logic_t *const logic);
+
+/**
+ * Parse the configuration file again and publish the result: on a parse error the running settings are kept.
+ */
+int logic_reload_settings(logic_t *const logic);
+
 void logic_request_termination(logic_t *const logic);
 
 int logic_termination_requested(logic_t *const logic);
\ No newline at end of file
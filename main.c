@@ -4,6 +4,14 @@
 #include "input_dev.h"
 #include "output_dev.h"
 #include "logic.h"
+#include "latency.h"
+#include "replay.h"
+#include "rt_profile.h"
+#include "settings_watch.h"
+#include "ring_log.h"
+#include "trace.h"
+#include "metrics.h"
+#include "gyro_calib.h"
 
 logic_t global_logic;
 
@@ -73,36 +81,79 @@ static input_dev_t in_xbox_dev = {
   .ev_input_filter_fn = input_filter_identity,
 };
 
+static input_dev_t *const reactor_devs[] = {
+  &in_xbox_dev,
+  &in_iio_dev,
+  &in_hidraw_dev,
+};
+
+static input_reactor_devs_t in_reactor_devs = {
+  .devs = reactor_devs,
+  .devs_count = sizeof(reactor_devs) / sizeof(reactor_devs[0]),
+  .logic = &global_logic,
+  .sources = NULL,
+};
+
+static replay_t in_replay = {
+  .path = NULL,
+  .max_speed = 0,
+  .logic = &global_logic,
+};
+
 void sig_handler(int signo)
 {
   if (signo == SIGINT) {
     logic_request_termination(&global_logic);
     printf("received SIGINT\n");
+  } else if (signo == SIGUSR2) {
+    // printed by the output thread: nothing else is safe to do from here
+    latency_request_dump();
+  } else if (signo == SIGUSR1) {
+    // written by the flight recorder thread
+    trace_request_dump(TRACE_DUMP_SIGNAL);
   }
 }
 
 int main(int argc, char ** argv) {
+  // --replay <file> feeds a recorded input log (see record_file) instead of the real devices
+  for (int i = 1; i < argc; ++i) {
+    if ((strcmp(argv[i], "--replay") == 0) && (i + 1 < argc)) {
+      in_replay.path = argv[++i];
+    } else if (strcmp(argv[i], "--replay-max-speed") == 0) {
+      in_replay.max_speed = 1;
+    } else {
+      fprintf(stderr, "Usage: %s [--replay <input log> [--replay-max-speed]]\n", argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
   const int logic_creation_res = logic_create(&global_logic);
   if (logic_creation_res < 0) {
     fprintf(stderr, "Unable to create logic: %d", logic_creation_res);
     return EXIT_FAILURE;
   }
 
+  // before any thread is created and before the hot paths touch their memory
+  rt_process_setup(&global_logic.controller_settings);
+
+  // a replay can run without uinput: the messages are still decoded, only the evdev output is skipped
+  const int replaying = (in_replay.path != NULL);
+
   int imu_fd = create_output_dev("/dev/uinput", output_dev_imu);
-  if (imu_fd < 0) {
+  if ((imu_fd < 0) && (!replaying)) {
     fprintf(stderr, "Unable to create IMU virtual device\n");
     return EXIT_FAILURE;
   }
 
   int gamepad_fd = create_output_dev("/dev/uinput", output_dev_gamepad);
-  if (gamepad_fd < 0) {
+  if ((gamepad_fd < 0) && (!replaying)) {
     close(imu_fd);
     fprintf(stderr, "Unable to create gamepad virtual device\n");
     return EXIT_FAILURE;
   }
 
   int mouse_fd = create_output_dev("/dev/uinput", output_dev_mouse);
-  if (mouse_fd < 0) {
+  if ((mouse_fd < 0) && (!replaying)) {
     close(gamepad_fd);
     close(imu_fd);
     fprintf(stderr, "Unable to create mouse virtual device\n");
@@ -121,14 +172,40 @@ int main(int argc, char ** argv) {
   }
 */
 
+  // kill -USR2 dumps the latency histograms
+  if (signal(SIGUSR2, sig_handler) == SIG_ERR) {
+    fprintf(stderr, "Error registering SIGUSR2 handler: latency statistics will not be available\n");
+  }
+
+  // kill -USR1 dumps the flight recorder
+  if (signal(SIGUSR1, sig_handler) == SIG_ERR) {
+    fprintf(stderr, "Error registering SIGUSR1 handler: the flight recorder will only be dumped on stalls\n");
+  }
+
+  // from now on the input, output and report threads log through the ring instead of writing to stderr
+  ring_log_start();
+
   int ret = 0;
 
+  int hotplug_thread_started = 0;
+  pthread_t hotplug_thread;
+
+  int settings_watch_thread_started = 0;
+  pthread_t settings_watch_thread;
+
+  int trace_dump_thread_started = 0;
+  pthread_t trace_dump_thread;
+
+  int gyro_calib_saver_thread_started = 0;
+  pthread_t gyro_calib_saver_thread;
+
+  int metrics_thread_started = 0;
+  pthread_t metrics_thread;
+
   pthread_t gamepad_thread;
   pthread_t xbox_thread, asus_kb_1_thread, asus_kb_2_thread, asus_kb_3_thread, iio_thread, hidraw_thread;
   
   
-  //Added 1ms intial "input delay" to match hardware controller delay. Updated to 1.5ms, seems good so far. 
-  //Reduced cpu usage by ~12%
   const int gamepad_thread_creation = pthread_create(&gamepad_thread, NULL, output_dev_thread_func, (void*)(&out_gamepadd_dev));
   if (gamepad_thread_creation != 0) {
     fprintf(stderr, "Error creating gamepad output thread: %d\n", gamepad_thread_creation);
@@ -136,6 +213,77 @@ int main(int argc, char ** argv) {
     logic_request_termination(&global_logic);
     goto gamepad_thread_err;
   }
+
+  // configuration edits are applied live: restarting would recreate the virtual devices under the games' feet
+  const int settings_watch_thread_creation = pthread_create(&settings_watch_thread, NULL, settings_watch_thread_func, (void*)(&global_logic));
+  if (settings_watch_thread_creation != 0) {
+    fprintf(stderr, "Error creating configuration watch thread: %d. Configuration changes will need a restart.\n", settings_watch_thread_creation);
+  } else {
+    settings_watch_thread_started = 1;
+  }
+
+  const int trace_dump_thread_creation = pthread_create(&trace_dump_thread, NULL, trace_dump_thread_func, (void*)(&global_logic));
+  if (trace_dump_thread_creation != 0) {
+    fprintf(stderr, "Error creating flight recorder thread: %d. Traces will not be dumped.\n", trace_dump_thread_creation);
+  } else {
+    trace_dump_thread_started = 1;
+  }
+
+  // not real-time: the IMU readers only hand their calibration snapshots over to it
+  const int gyro_calib_saver_thread_creation = pthread_create(&gyro_calib_saver_thread, NULL, gyro_calib_saver_thread_func, (void*)(&global_logic));
+  if (gyro_calib_saver_thread_creation != 0) {
+    fprintf(stderr, "Error creating gyro calibration saver thread: %d. Calibrations will be saved on exit only.\n", gyro_calib_saver_thread_creation);
+  } else {
+    gyro_calib_saver_thread_started = 1;
+  }
+
+  const int metrics_thread_creation = pthread_create(&metrics_thread, NULL, metrics_thread_func, (void*)(&global_logic));
+  if (metrics_thread_creation != 0) {
+    fprintf(stderr, "Error creating metrics thread: %d. Metrics will not be available.\n", metrics_thread_creation);
+  } else {
+    metrics_thread_started = 1;
+  }
+
+  if (replaying) {
+    pthread_t replay_thread;
+    const int replay_thread_creation = pthread_create(&replay_thread, NULL, replay_thread_func, (void*)(&in_replay));
+    if (replay_thread_creation != 0) {
+      fprintf(stderr, "Error creating replay thread: %d\n", replay_thread_creation);
+      ret = -1;
+      logic_request_termination(&global_logic);
+    } else {
+      pthread_join(replay_thread, NULL);
+    }
+
+    pthread_join(gamepad_thread, NULL);
+    latency_dump(stdout);
+    goto gamepad_thread_err;
+  }
+
+  if (global_logic.controller_settings.input_reactor) {
+    // one thread multiplexes every input device instead of the thread-per-device setup below
+    pthread_t reactor_thread;
+    const int reactor_thread_creation = pthread_create(&reactor_thread, NULL, input_reactor_thread_func, (void*)(&in_reactor_devs));
+    if (reactor_thread_creation != 0) {
+      fprintf(stderr, "Error creating input reactor thread: %d\n", reactor_thread_creation);
+      ret = -1;
+      logic_request_termination(&global_logic);
+    } else {
+      pthread_join(reactor_thread, NULL);
+    }
+
+    goto xbox_drv_thread_err;
+  }
+
+  // readers sleep until udev reports their device: a single thread receives the notifications for all of them
+  const int hotplug_thread_creation = pthread_create(&hotplug_thread, NULL, hotplug_thread_func, (void*)(&global_logic));
+  if (hotplug_thread_creation != 0) {
+    fprintf(stderr, "Error creating hotplug thread: %d. Devices will be searched periodically.\n", hotplug_thread_creation);
+    hotplug_stop(&global_logic.hotplug);
+  } else {
+    hotplug_thread_started = 1;
+  }
+
   //Using 30% cpu usage for some reason
   //Updated sleep to 5K -> reduced cpu usage by ~20%
   const int xbox_thread_creation = pthread_create(&xbox_thread, NULL, input_dev_thread_func, (void*)(&in_xbox_dev));
@@ -205,14 +353,38 @@ asus_kb_1_thread_err:
   pthread_join(xbox_thread, NULL);
 
 xbox_drv_thread_err:
+  if (hotplug_thread_started) {
+    pthread_join(hotplug_thread, NULL);
+  }
+
   pthread_join(gamepad_thread, NULL);
 
 gamepad_thread_err:
-  ioctl(gamepad_fd, UI_DEV_DESTROY);
-  close(gamepad_fd);
+  if (settings_watch_thread_started) {
+    pthread_join(settings_watch_thread, NULL);
+  }
+
+  if (trace_dump_thread_started) {
+    pthread_join(trace_dump_thread, NULL);
+  }
+
+  if (gyro_calib_saver_thread_started) {
+    pthread_join(gyro_calib_saver_thread, NULL);
+  }
+
+  if (metrics_thread_started) {
+    pthread_join(metrics_thread, NULL);
+  }
+
+  if (gamepad_fd >= 0) {
+    ioctl(gamepad_fd, UI_DEV_DESTROY);
+    close(gamepad_fd);
+  }
   
   // TODO: free(imu_dev.events_list);
   // TODO: free(gamepadd_dev.events_list);
 
+  ring_log_stop();
+
   return ret == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
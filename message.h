@@ -2,7 +2,6 @@
 
 #include "imu_message.h"
 
-#define MESSAGE_FLAGS_HANDLE_DONE         0x00000001U
 #define EV_MESSAGE_FLAGS_PRESERVE_TIME    0x00000002U
 #define EV_MESSAGE_FLAGS_IMU              0x00000004U
 #define EV_MESSAGE_FLAGS_MOUSE            0x00000008U
@@ -32,14 +31,29 @@ typedef enum message_type {
 #define INPUT_FILTER_FLAGS_NONE             0x00000000U
 #define INPUT_FILTER_FLAGS_DO_NOT_EMIT      0x00000001U
 
+// CLOCK_MONOTONIC stamps (in ns) taken along the path of a message, 0 when not taken
+typedef struct message_timestamps {
+    uint64_t read_ns;
+    uint64_t enqueue_ns;
+    uint64_t dequeue_ns;
+    uint64_t apply_ns;
+} message_timestamps_t;
+
+struct message_pool;
+
 typedef struct message {
     message_type_t type;
 
+    // the pool this message is released to once handled (see message_pool.h)
+    struct message_pool* pool;
+
+    message_timestamps_t ts;
+
     union {
         imu_message_t imu;
         ev_message_t event;
         hidraw_message_t hidraw;
     } data;
 
-    volatile uint32_t flags;
+    uint32_t flags;
 } message_t;
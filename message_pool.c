@@ -0,0 +1,78 @@
+#include "message_pool.h"
+
+int message_pool_init(message_pool_t *const pool, size_t count) {
+    atomic_init(&pool->in_use, 0);
+    pool->count = count;
+
+    pool->messages = calloc(count, sizeof(message_t));
+    if (pool->messages == NULL) {
+        fprintf(stderr, "Unable to allocate %zu messages\n", count);
+        return -ENOMEM;
+    }
+
+    const int queue_init_res = queue_init(&pool->free_list, count);
+    if (queue_init_res != 0) {
+        fprintf(stderr, "Unable to create the message free-list: %d\n", queue_init_res);
+        free(pool->messages);
+        pool->messages = NULL;
+        return queue_init_res;
+    }
+
+    for (size_t i = 0; i < count; ++i) {
+        pool->messages[i].pool = pool;
+        queue_try_push(&pool->free_list, (void*)&pool->messages[i]);
+    }
+
+    return 0;
+}
+
+void message_pool_destroy(message_pool_t *const pool) {
+    if (pool->messages == NULL) {
+        return;
+    }
+
+    queue_destroy(&pool->free_list);
+    free(pool->messages);
+    pool->messages = NULL;
+    pool->count = 0;
+}
+
+message_t* message_pool_try_acquire(message_pool_t *const pool) {
+    void *msg;
+    if (queue_try_pop(&pool->free_list, &msg) != 0) {
+        return NULL;
+    }
+
+    atomic_fetch_add_explicit(&pool->in_use, 1, memory_order_relaxed);
+    return (message_t*)msg;
+}
+
+message_t* message_pool_acquire_timeout(message_pool_t *const pool, int timeout_ms) {
+    void *msg;
+    if (queue_pop_timeout(&pool->free_list, &msg, timeout_ms) != 0) {
+        return NULL;
+    }
+
+    atomic_fetch_add_explicit(&pool->in_use, 1, memory_order_relaxed);
+    return (message_t*)msg;
+}
+
+void message_pool_release(message_t *const msg) {
+    message_pool_t *const pool = msg->pool;
+
+    // the free-list has room for every message of the pool: this can never fail
+    queue_try_push(&pool->free_list, (void*)msg);
+    atomic_fetch_sub_explicit(&pool->in_use, 1, memory_order_release);
+}
+
+int message_pool_quiesce(message_pool_t *const pool, int timeout_ms) {
+    for (int waited_ms = 0; atomic_load_explicit(&pool->in_use, memory_order_acquire) != 0; ++waited_ms) {
+        if (waited_ms >= timeout_ms) {
+            return -ETIMEDOUT;
+        }
+
+        usleep(1000);
+    }
+
+    return 0;
+}
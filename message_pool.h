@@ -0,0 +1,40 @@
+#pragma once
+
+#include "rogue_enemy.h"
+#include "message.h"
+#include "queue.h"
+
+/**
+ * Fixed set of messages handed between an input reader and the output thread.
+ *
+ * Free messages sit in a queue_t used as a free-list: acquire and release are a single CAS in the
+ * common case and an exhausted pool puts the reader to sleep until the output thread releases one.
+ */
+typedef struct message_pool {
+    message_t *messages;
+    size_t count;
+
+    queue_t free_list;
+
+    // messages acquired and not released yet
+    atomic_size_t in_use;
+} message_pool_t;
+
+int message_pool_init(message_pool_t *const pool, size_t count);
+
+void message_pool_destroy(message_pool_t *const pool);
+
+// returns NULL immediately if every message is in flight
+message_t* message_pool_try_acquire(message_pool_t *const pool);
+
+// returns NULL if no message was released within timeout_ms
+message_t* message_pool_acquire_timeout(message_pool_t *const pool, int timeout_ms);
+
+// hand msg back to the pool it was acquired from: msg must not be used afterwards
+void message_pool_release(message_t *const msg);
+
+/**
+ * Wait until every message has been released: 0 on success, -ETIMEDOUT otherwise
+ * (i.e. the output thread terminated with messages still queued).
+ */
+int message_pool_quiesce(message_pool_t *const pool, int timeout_ms);
@@ -0,0 +1,474 @@
+#include "metrics.h"
+#include "logic.h"
+#include "trace.h"
+
+#include <stdarg.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define METRICS_SOURCE_COUNT    (MSG_TYPE_HIDRAW + 1)
+
+static atomic_uint_fast64_t messages[METRICS_SOURCE_COUNT];
+static atomic_uint_fast64_t eagains[METRICS_SOURCE_COUNT];
+static atomic_uint_fast64_t drops[METRICS_DROP_COUNT];
+static atomic_uint_fast64_t reports[LATENCY_OUTPUT_COUNT];
+static atomic_uint_fast64_t uhid_errors[LATENCY_OUTPUT_COUNT];
+static atomic_uint_fast64_t missed_deadlines[LATENCY_OUTPUT_COUNT];
+static atomic_uint report_targets_hz[LATENCY_OUTPUT_COUNT];
+static atomic_uint_fast64_t rumbles = 0;
+static atomic_uint_fast64_t queue_depth_high_water = 0;
+
+static const char *const source_names[METRICS_SOURCE_COUNT] = {
+    [MSG_TYPE_EV] = "evdev",
+    [MSG_TYPE_IMU] = "imu",
+    [MSG_TYPE_HIDRAW] = "hidraw",
+};
+
+static const char *const drop_names[METRICS_DROP_COUNT] = {
+    [METRICS_DROP_IMU_REPLACED] = "imu_replaced",
+    [METRICS_DROP_QUEUE_FULL] = "queue_full",
+    [METRICS_DROP_KERNEL] = "kernel",
+    [METRICS_DROP_STALL] = "stall",
+    [METRICS_DROP_NO_MESSAGE] = "no_message",
+};
+
+static const char *const output_names[LATENCY_OUTPUT_COUNT] = {
+    [LATENCY_OUTPUT_EVDEV] = "evdev",
+    [LATENCY_OUTPUT_DS4] = "ds4",
+    [LATENCY_OUTPUT_DS5] = "ds5",
+};
+
+void metrics_count_message(message_type_t type) {
+    if ((type >= 0) && (type < METRICS_SOURCE_COUNT)) {
+        atomic_fetch_add_explicit(&messages[type], 1, memory_order_relaxed);
+    }
+}
+
+void metrics_count_eagain(message_type_t type) {
+    if ((type >= 0) && (type < METRICS_SOURCE_COUNT)) {
+        atomic_fetch_add_explicit(&eagains[type], 1, memory_order_relaxed);
+    }
+}
+
+void metrics_count_drop(metrics_drop_t reason) {
+    atomic_fetch_add_explicit(&drops[reason], 1, memory_order_relaxed);
+}
+
+void metrics_count_drops(metrics_drop_t reason, uint64_t count) {
+    atomic_fetch_add_explicit(&drops[reason], count, memory_order_relaxed);
+}
+
+void metrics_count_report(latency_output_t output) {
+    atomic_fetch_add_explicit(&reports[output], 1, memory_order_relaxed);
+}
+
+void metrics_count_uhid_error(latency_output_t output) {
+    atomic_fetch_add_explicit(&uhid_errors[output], 1, memory_order_relaxed);
+}
+
+void metrics_count_missed_deadlines(latency_output_t output, uint64_t missed) {
+    atomic_fetch_add_explicit(&missed_deadlines[output], missed, memory_order_relaxed);
+}
+
+void metrics_set_report_target(latency_output_t output, unsigned int rate_hz) {
+    atomic_store_explicit(&report_targets_hz[output], rate_hz, memory_order_relaxed);
+}
+
+void metrics_count_rumble(void) {
+    atomic_fetch_add_explicit(&rumbles, 1, memory_order_relaxed);
+}
+
+void metrics_queue_depth(size_t depth) {
+    uint_fast64_t high_water = atomic_load_explicit(&queue_depth_high_water, memory_order_relaxed);
+    while ((depth > high_water) && (!atomic_compare_exchange_weak_explicit(&queue_depth_high_water, &high_water, depth, memory_order_relaxed, memory_order_relaxed))) {
+        // high_water has been reloaded: try again
+    }
+}
+
+/*
+ * Rates over the last METRICS_RATE_INTERVAL_MS: only touched by the metrics thread.
+ */
+typedef struct metrics_rates {
+    uint64_t sample_ns;
+
+    uint64_t messages[METRICS_SOURCE_COUNT];
+    uint64_t reports[LATENCY_OUTPUT_COUNT];
+    uint64_t thread_cpu_ns[TRACE_MAX_THREADS];
+
+    double messages_per_s[METRICS_SOURCE_COUNT];
+    double reports_per_s[LATENCY_OUTPUT_COUNT];
+    double thread_cpu_usage[TRACE_MAX_THREADS]; // fraction of one CPU
+} metrics_rates_t;
+
+static int thread_cpu_ns(clockid_t clock, uint64_t *const out) {
+    struct timespec cpu;
+    if (clock_gettime(clock, &cpu) != 0) {
+        return -errno;
+    }
+
+    *out = (uint64_t)cpu.tv_sec * 1000000000ULL + (uint64_t)cpu.tv_nsec;
+    return 0;
+}
+
+static void rates_sample(metrics_rates_t *const rates) {
+    const uint64_t now_ns = latency_now_ns();
+    const double elapsed_s = (rates->sample_ns != 0) ? (double)(now_ns - rates->sample_ns) / 1000000000.0 : 0.0;
+
+    for (int s = 0; s < METRICS_SOURCE_COUNT; ++s) {
+        const uint64_t count = atomic_load_explicit(&messages[s], memory_order_relaxed);
+        rates->messages_per_s[s] = (elapsed_s > 0.0) ? (double)(count - rates->messages[s]) / elapsed_s : 0.0;
+        rates->messages[s] = count;
+    }
+
+    for (int o = 0; o < LATENCY_OUTPUT_COUNT; ++o) {
+        const uint64_t count = atomic_load_explicit(&reports[o], memory_order_relaxed);
+        rates->reports_per_s[o] = (elapsed_s > 0.0) ? (double)(count - rates->reports[o]) / elapsed_s : 0.0;
+        rates->reports[o] = count;
+    }
+
+    for (unsigned int t = 0; t < TRACE_MAX_THREADS; ++t) {
+        const char *name;
+        uint32_t tid;
+        clockid_t clock;
+        uint64_t cpu_ns = 0;
+
+        const int info_res = trace_thread_info(t, &name, &tid, &clock);
+        if (info_res == -ENOENT) {
+            break;
+        } else if ((info_res != 0) || (thread_cpu_ns(clock, &cpu_ns) != 0)) {
+            rates->thread_cpu_usage[t] = 0.0;
+            continue;
+        }
+
+        rates->thread_cpu_usage[t] = ((elapsed_s > 0.0) && (rates->thread_cpu_ns[t] != 0)) ?
+            (double)(cpu_ns - rates->thread_cpu_ns[t]) / 1000000000.0 / elapsed_s : 0.0;
+        rates->thread_cpu_ns[t] = cpu_ns;
+    }
+
+    rates->sample_ns = now_ns;
+}
+
+typedef struct metrics_out {
+    char buf[METRICS_RESPONSE_MAX];
+    size_t len;
+} metrics_out_t;
+
+static void out_printf(metrics_out_t *const out, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void out_printf(metrics_out_t *const out, const char *fmt, ...) {
+    if (out->len >= sizeof(out->buf) - 1) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    const int written = vsnprintf(&out->buf[out->len], sizeof(out->buf) - out->len, fmt, args);
+    va_end(args);
+
+    if (written > 0) {
+        out->len += ((size_t)written < sizeof(out->buf) - out->len) ? (size_t)written : sizeof(out->buf) - out->len - 1;
+    }
+}
+
+static void write_prometheus(metrics_out_t *const out, const metrics_rates_t *const rates) {
+    out_printf(out, "# HELP rogue_enemy_messages_total Input messages read, per source.\n# TYPE rogue_enemy_messages_total counter\n");
+    for (int s = 0; s < METRICS_SOURCE_COUNT; ++s) {
+        out_printf(out, "rogue_enemy_messages_total{source=\"%s\"} %" PRIu64 "\n", source_names[s], (uint64_t)atomic_load_explicit(&messages[s], memory_order_relaxed));
+    }
+
+    out_printf(out, "# HELP rogue_enemy_messages_per_second Input messages read over the last second, per source.\n# TYPE rogue_enemy_messages_per_second gauge\n");
+    for (int s = 0; s < METRICS_SOURCE_COUNT; ++s) {
+        out_printf(out, "rogue_enemy_messages_per_second{source=\"%s\"} %.1f\n", source_names[s], rates->messages_per_s[s]);
+    }
+
+    out_printf(out, "# HELP rogue_enemy_eagain_total Reads that found nothing to read, per source.\n# TYPE rogue_enemy_eagain_total counter\n");
+    for (int s = 0; s < METRICS_SOURCE_COUNT; ++s) {
+        out_printf(out, "rogue_enemy_eagain_total{source=\"%s\"} %" PRIu64 "\n", source_names[s], (uint64_t)atomic_load_explicit(&eagains[s], memory_order_relaxed));
+    }
+
+    out_printf(out, "# HELP rogue_enemy_queue_depth_high_water Largest number of messages seen waiting in the input queue.\n# TYPE rogue_enemy_queue_depth_high_water gauge\n");
+    out_printf(out, "rogue_enemy_queue_depth_high_water %" PRIu64 "\n", (uint64_t)atomic_load_explicit(&queue_depth_high_water, memory_order_relaxed));
+
+    out_printf(out, "# HELP rogue_enemy_dropped_frames_total Input frames lost, per reason.\n# TYPE rogue_enemy_dropped_frames_total counter\n");
+    for (int d = 0; d < METRICS_DROP_COUNT; ++d) {
+        out_printf(out, "rogue_enemy_dropped_frames_total{reason=\"%s\"} %" PRIu64 "\n", drop_names[d], (uint64_t)atomic_load_explicit(&drops[d], memory_order_relaxed));
+    }
+
+    out_printf(out, "# HELP rogue_enemy_reports_total Reports (uhid) or frames (evdev) written, per output.\n# TYPE rogue_enemy_reports_total counter\n");
+    for (int o = 0; o < LATENCY_OUTPUT_COUNT; ++o) {
+        out_printf(out, "rogue_enemy_reports_total{output=\"%s\"} %" PRIu64 "\n", output_names[o], (uint64_t)atomic_load_explicit(&reports[o], memory_order_relaxed));
+    }
+
+    out_printf(out, "# HELP rogue_enemy_reports_per_second Reports written over the last second, per output.\n# TYPE rogue_enemy_reports_per_second gauge\n");
+    for (int o = 0; o < LATENCY_OUTPUT_COUNT; ++o) {
+        out_printf(out, "rogue_enemy_reports_per_second{output=\"%s\"} %.1f\n", output_names[o], rates->reports_per_s[o]);
+    }
+
+    out_printf(out, "# HELP rogue_enemy_report_rate_target_hz Configured report rate of the running virtual controllers.\n# TYPE rogue_enemy_report_rate_target_hz gauge\n");
+    for (int o = 0; o < LATENCY_OUTPUT_COUNT; ++o) {
+        const unsigned int target_hz = atomic_load_explicit(&report_targets_hz[o], memory_order_relaxed);
+        if (target_hz > 0) {
+            out_printf(out, "rogue_enemy_report_rate_target_hz{output=\"%s\"} %u\n", output_names[o], target_hz);
+        }
+    }
+
+    out_printf(out, "# HELP rogue_enemy_report_deadlines_missed_total Report periods skipped by the scheduler, per output.\n# TYPE rogue_enemy_report_deadlines_missed_total counter\n");
+    for (int o = 0; o < LATENCY_OUTPUT_COUNT; ++o) {
+        out_printf(out, "rogue_enemy_report_deadlines_missed_total{output=\"%s\"} %" PRIu64 "\n", output_names[o], (uint64_t)atomic_load_explicit(&missed_deadlines[o], memory_order_relaxed));
+    }
+
+    out_printf(out, "# HELP rogue_enemy_uhid_write_errors_total Failed writes to uhid, per output.\n# TYPE rogue_enemy_uhid_write_errors_total counter\n");
+    for (int o = LATENCY_OUTPUT_DS4; o < LATENCY_OUTPUT_COUNT; ++o) {
+        out_printf(out, "rogue_enemy_uhid_write_errors_total{output=\"%s\"} %" PRIu64 "\n", output_names[o], (uint64_t)atomic_load_explicit(&uhid_errors[o], memory_order_relaxed));
+    }
+
+    out_printf(out, "# HELP rogue_enemy_rumble_events_total Rumble effects played on the physical controller.\n# TYPE rogue_enemy_rumble_events_total counter\n");
+    out_printf(out, "rogue_enemy_rumble_events_total %" PRIu64 "\n", (uint64_t)atomic_load_explicit(&rumbles, memory_order_relaxed));
+
+    out_printf(out, "# HELP rogue_enemy_thread_cpu_seconds_total CPU time used, per thread.\n# TYPE rogue_enemy_thread_cpu_seconds_total counter\n");
+    for (unsigned int t = 0; t < TRACE_MAX_THREADS; ++t) {
+        const char *name;
+        uint32_t tid;
+        clockid_t clock;
+        uint64_t cpu_ns = 0;
+
+        const int info_res = trace_thread_info(t, &name, &tid, &clock);
+        if (info_res == -ENOENT) {
+            break;
+        } else if ((info_res == 0) && (thread_cpu_ns(clock, &cpu_ns) == 0)) {
+            out_printf(out, "rogue_enemy_thread_cpu_seconds_total{thread=\"%s\",tid=\"%u\"} %.6f\n", name, tid, (double)cpu_ns / 1000000000.0);
+        }
+    }
+
+    out_printf(out, "# HELP rogue_enemy_thread_cpu_usage_ratio CPU used over the last second as a fraction of one CPU, per thread.\n# TYPE rogue_enemy_thread_cpu_usage_ratio gauge\n");
+    for (unsigned int t = 0; t < TRACE_MAX_THREADS; ++t) {
+        const char *name;
+        uint32_t tid;
+        clockid_t clock;
+
+        const int info_res = trace_thread_info(t, &name, &tid, &clock);
+        if (info_res == -ENOENT) {
+            break;
+        } else if (info_res == 0) {
+            out_printf(out, "rogue_enemy_thread_cpu_usage_ratio{thread=\"%s\",tid=\"%u\"} %.4f\n", name, tid, rates->thread_cpu_usage[t]);
+        }
+    }
+}
+
+static void write_json(metrics_out_t *const out, const metrics_rates_t *const rates) {
+    out_printf(out, "{\"messages\":{");
+    for (int s = 0; s < METRICS_SOURCE_COUNT; ++s) {
+        out_printf(
+            out,
+            "%s\"%s\":{\"total\":%" PRIu64 ",\"per_second\":%.1f,\"eagain\":%" PRIu64 "}",
+            (s > 0) ? "," : "",
+            source_names[s],
+            (uint64_t)atomic_load_explicit(&messages[s], memory_order_relaxed),
+            rates->messages_per_s[s],
+            (uint64_t)atomic_load_explicit(&eagains[s], memory_order_relaxed)
+        );
+    }
+
+    out_printf(out, "},\"queue_depth_high_water\":%" PRIu64 ",\"dropped_frames\":{", (uint64_t)atomic_load_explicit(&queue_depth_high_water, memory_order_relaxed));
+    for (int d = 0; d < METRICS_DROP_COUNT; ++d) {
+        out_printf(out, "%s\"%s\":%" PRIu64, (d > 0) ? "," : "", drop_names[d], (uint64_t)atomic_load_explicit(&drops[d], memory_order_relaxed));
+    }
+
+    out_printf(out, "},\"reports\":{");
+    for (int o = 0; o < LATENCY_OUTPUT_COUNT; ++o) {
+        out_printf(
+            out,
+            "%s\"%s\":{\"total\":%" PRIu64 ",\"per_second\":%.1f,\"target_hz\":%u,\"deadlines_missed\":%" PRIu64 ",\"uhid_write_errors\":%" PRIu64 "}",
+            (o > 0) ? "," : "",
+            output_names[o],
+            (uint64_t)atomic_load_explicit(&reports[o], memory_order_relaxed),
+            rates->reports_per_s[o],
+            atomic_load_explicit(&report_targets_hz[o], memory_order_relaxed),
+            (uint64_t)atomic_load_explicit(&missed_deadlines[o], memory_order_relaxed),
+            (uint64_t)atomic_load_explicit(&uhid_errors[o], memory_order_relaxed)
+        );
+    }
+
+    out_printf(out, "},\"rumble_events\":%" PRIu64 ",\"threads\":[", (uint64_t)atomic_load_explicit(&rumbles, memory_order_relaxed));
+    int first = 1;
+    for (unsigned int t = 0; t < TRACE_MAX_THREADS; ++t) {
+        const char *name;
+        uint32_t tid;
+        clockid_t clock;
+        uint64_t cpu_ns = 0;
+
+        const int info_res = trace_thread_info(t, &name, &tid, &clock);
+        if (info_res == -ENOENT) {
+            break;
+        } else if ((info_res == 0) && (thread_cpu_ns(clock, &cpu_ns) == 0)) {
+            out_printf(
+                out,
+                "%s{\"name\":\"%s\",\"tid\":%u,\"cpu_seconds\":%.6f,\"cpu_usage\":%.4f}",
+                first ? "" : ",",
+                name,
+                tid,
+                (double)cpu_ns / 1000000000.0,
+                rates->thread_cpu_usage[t]
+            );
+            first = 0;
+        }
+    }
+
+    out_printf(out, "]}\n");
+}
+
+static void serve_client(int fd, const metrics_rates_t *const rates) {
+    // the request is one line at most: a client sending nothing gets the Prometheus format
+    char request[256] = {0};
+    size_t request_len = 0;
+
+    struct pollfd pfd = {
+        .fd = fd,
+        .events = POLLIN,
+    };
+
+    while ((request_len < sizeof(request) - 1) && (memchr(request, '\n', request_len) == NULL)) {
+        if (poll(&pfd, 1, METRICS_REQUEST_TIMEOUT_MS) <= 0) {
+            break;
+        }
+
+        const ssize_t read_res = read(fd, &request[request_len], sizeof(request) - 1 - request_len);
+        if (read_res <= 0) {
+            break;
+        }
+
+        request_len += (size_t)read_res;
+    }
+
+    const int http = strncmp(request, "GET ", 4) == 0;
+    const int json = http ? (strstr(request, ".json") != NULL) : (strncmp(request, "json", 4) == 0);
+
+    metrics_out_t *const out = malloc(sizeof(metrics_out_t));
+    if (out == NULL) {
+        return;
+    }
+    out->len = 0;
+
+    if (json) {
+        write_json(out, rates);
+    } else {
+        write_prometheus(out, rates);
+    }
+
+    if (http) {
+        char header[160];
+        const int header_len = snprintf(
+            header,
+            sizeof(header),
+            "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+            json ? "application/json" : "text/plain; version=0.0.4",
+            out->len
+        );
+        send(fd, header, (size_t)header_len, MSG_NOSIGNAL);
+    }
+
+    for (size_t sent = 0; sent < out->len; ) {
+        const ssize_t send_res = send(fd, &out->buf[sent], out->len - sent, MSG_NOSIGNAL);
+        if (send_res <= 0) {
+            break;
+        }
+
+        sent += (size_t)send_res;
+    }
+
+    free(out);
+}
+
+void *metrics_thread_func(void *ptr) {
+    logic_t *const logic = (logic_t*)ptr;
+    const char *const path = logic->controller_settings.metrics_socket;
+
+    if (path[0] == '\0') {
+        return NULL;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "metrics_socket %s is too long: metrics will not be available\n", path);
+        return NULL;
+    }
+    strcpy(addr.sun_path, path);
+
+    // a socket left behind by a previous run would make bind() fail, but one another instance answers on is kept
+    const int probe_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe_fd >= 0) {
+        const int in_use = connect(probe_fd, (const struct sockaddr*)&addr, sizeof(addr)) == 0;
+        const int stale = (!in_use) && (errno == ECONNREFUSED);
+        close(probe_fd);
+
+        if (in_use) {
+            fprintf(stderr, "metrics_socket %s is in use by another instance: metrics will not be available\n", path);
+            return NULL;
+        } else if (stale) {
+            unlink(path);
+        }
+    }
+
+    const int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        fprintf(stderr, "Unable to create the metrics socket: %d\n", errno);
+        return NULL;
+    }
+
+    if (bind(listen_fd, (const struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        fprintf(stderr, "Unable to bind the metrics socket %s: %d\n", path, errno);
+        goto metrics_thread_func_err;
+    }
+
+    // nobody can connect before listen(): the file never gets the umask-derived mode while in use
+    if (chmod(path, METRICS_SOCKET_MODE) != 0) {
+        fprintf(stderr, "Unable to set the mode of the metrics socket %s: %d\n", path, errno);
+        goto metrics_thread_func_unlink;
+    }
+
+    if (listen(listen_fd, 4) != 0) {
+        fprintf(stderr, "Unable to listen on the metrics socket %s: %d\n", path, errno);
+        goto metrics_thread_func_unlink;
+    }
+
+    printf("Metrics available on %s\n", path);
+
+    metrics_rates_t rates;
+    memset(&rates, 0, sizeof(rates));
+    rates_sample(&rates);
+
+    struct pollfd pfd = {
+        .fd = listen_fd,
+        .events = POLLIN,
+    };
+
+    while (!logic_termination_requested(logic)) {
+        const int poll_res = poll(&pfd, 1, METRICS_RATE_INTERVAL_MS);
+
+        if ((latency_now_ns() - rates.sample_ns) >= (METRICS_RATE_INTERVAL_MS * 1000000ULL)) {
+            rates_sample(&rates);
+        }
+
+        if (poll_res > 0) {
+            const int client_fd = accept(listen_fd, NULL, NULL);
+            if (client_fd >= 0) {
+                serve_client(client_fd, &rates);
+                close(client_fd);
+            }
+        } else if ((poll_res < 0) && (errno != EINTR)) {
+            fprintf(stderr, "Error waiting for metrics clients: %d\n", errno);
+            break;
+        }
+    }
+
+metrics_thread_func_unlink:
+    unlink(path);
+
+metrics_thread_func_err:
+    close(listen_fd);
+
+    return NULL;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "rogue_enemy.h"
+#include "message.h"
+#include "latency.h"
+
+/*
+ * Pipeline counters and gauges, updated with relaxed atomics from any thread and served on a local
+ * UNIX socket (metrics_socket) by metrics_thread_func.
+ *
+ * A client connects and sends one line: "json" gets a JSON document, anything else the Prometheus text
+ * format. An HTTP request line ("GET /metrics ..." or "GET /metrics.json ...") gets an HTTP response, so
+ * curl --unix-socket works too.
+ */
+#define METRICS_RATE_INTERVAL_MS    1000
+#define METRICS_REQUEST_TIMEOUT_MS  100
+#define METRICS_RESPONSE_MAX        32768
+#define METRICS_SOCKET_MODE         0660 // whatever the umask: the counters are not for every local user
+
+typedef enum metrics_drop {
+    METRICS_DROP_IMU_REPLACED = 0,  // IMU sample superseded in the mailbox before the output thread took it
+    METRICS_DROP_QUEUE_FULL,        // frame discarded because the input queue was full
+    METRICS_DROP_KERNEL,            // events dropped by the kernel (SYN_DROPPED) and resynchronized
+    METRICS_DROP_STALL,             // reader left without a message for MESSAGE_ACQUIRE_TIMEOUT_MS
+    METRICS_DROP_NO_MESSAGE,        // evdev frames read in a batch with no message left to carry them, resynchronized
+    METRICS_DROP_COUNT,
+} metrics_drop_t;
+
+void metrics_count_message(message_type_t type);
+
+void metrics_count_eagain(message_type_t type);
+
+void metrics_count_drop(metrics_drop_t reason);
+
+void metrics_count_drops(metrics_drop_t reason, uint64_t count);
+
+void metrics_count_report(latency_output_t output);
+
+void metrics_count_uhid_error(latency_output_t output);
+
+void metrics_count_missed_deadlines(latency_output_t output, uint64_t missed);
+
+void metrics_set_report_target(latency_output_t output, unsigned int rate_hz);
+
+void metrics_count_rumble(void);
+
+/**
+ * Input queue depth seen by the output thread: keeps the high-water mark.
+ */
+void metrics_queue_depth(size_t depth);
+
+/**
+ * Serve the metrics on the metrics_socket of the startup settings until termination is requested.
+ */
+void *metrics_thread_func(void *ptr);
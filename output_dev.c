@@ -5,6 +5,13 @@
 #include "message.h"
 #include "settings.h"
 #include "virt_ds4.h"
+#include "latency.h"
+#include "replay.h"
+#include "message_pool.h"
+#include "rt_profile.h"
+#include "ring_log.h"
+#include "trace.h"
+#include "metrics.h"
 
 int create_output_dev(const char* uinput_path, output_dev_type_t type) {
     int fd = open(uinput_path, O_WRONLY | O_NONBLOCK);
@@ -454,6 +461,20 @@ create_output_dev_err:
     return fd;
 }
 
+// events written by emit_ev in one go, including the trailing MSC_TIMESTAMP and SYN_REPORT
+#define EMIT_EV_FRAME_MAX_EVENTS 64
+
+static void emit_ev_frame(int fd, const struct input_event *const frame, size_t count) {
+	const ssize_t expected = (ssize_t)(sizeof(struct input_event) * count);
+	const ssize_t written = write(fd, (const void*)frame, (size_t)expected);
+	if (written == expected) {
+		trace_record(TRACE_EV_REPORT, LATENCY_OUTPUT_EVDEV, (uint64_t)count);
+		metrics_count_report(LATENCY_OUTPUT_EVDEV);
+	} else {
+		RING_LOG(RING_LOG_ERROR, "Error writing %zu events: written %ld bytes out of %ld\n", count, written, expected);
+	}
+}
+
 static void emit_ev(output_dev_t *const out_dev, const message_t *const msg) {
 	// if events are flagged as do not emit... Do NOT emit!
 	if (msg->flags & INPUT_FILTER_FLAGS_DO_NOT_EMIT) {
@@ -470,72 +491,83 @@ static void emit_ev(output_dev_t *const out_dev, const message_t *const msg) {
 		fd = out_dev->gamepad_fd;
 	}
 
-	for (uint32_t i = 0; i < msg->data.event.ev_count; ++i) {	
-		struct input_event ev = {
-			.code = msg->data.event.ev[i].code,
-			.type = msg->data.event.ev[i].type,
-			.value = msg->data.event.ev[i].value,
-			.time = msg->data.event.ev[i].time,
-		};
+	// the virtual device may be missing (i.e. when replaying an input log without uinput)
+	if (fd < 0) {
+		return;
+	}
 
-		if ((msg_flags & EV_MESSAGE_FLAGS_PRESERVE_TIME) == 0) {
-			gettimeofday(&ev.time, NULL);
-		}
+	// the whole frame, SYN_REPORT included, goes to uinput with a single write() sharing one timestamp
+	struct input_event frame[EMIT_EV_FRAME_MAX_EVENTS];
+	size_t frame_count = 0;
+
+	struct timeval now = {0};
+	gettimeofday(&now, NULL);
+
+	for (uint32_t i = 0; i < msg->data.event.ev_count; ++i) {
+		struct input_event *const ev = &frame[frame_count++];
+		ev->code = msg->data.event.ev[i].code;
+		ev->type = msg->data.event.ev[i].type;
+		ev->value = msg->data.event.ev[i].value;
+		ev->time = ((msg_flags & EV_MESSAGE_FLAGS_PRESERVE_TIME) == 0) ? now : msg->data.event.ev[i].time;
 
 #if defined(INCLUDE_OUTPUT_DEBUG)
-		printf(
+		RING_LOG(
+			RING_LOG_DEBUG,
 			"Output: Received event %s (%s): %d\n",
-			libevdev_event_type_get_name(ev.type),
-			libevdev_event_code_get_name(ev.type, ev.code),
-			ev.value
+			libevdev_event_type_get_name(ev->type),
+			libevdev_event_code_get_name(ev->type, ev->code),
+			ev->value
 		);
 #endif
 
-		const ssize_t written = write(fd, (void*)&ev, sizeof(ev));
-		if (written != sizeof(ev)) {
-			fprintf(
-				stderr,
-				"Error writing event %s %s %d: written %ld bytes out of %ld\n",
-				libevdev_event_type_get_name(ev.type),
-				libevdev_event_code_get_name(ev.type, ev.code),
-				ev.value,
-				written,
-				sizeof(ev)
-			);
+		// an unusually long frame is sent in chunks: the SYN_REPORT still comes last
+		if (frame_count == EMIT_EV_FRAME_MAX_EVENTS - 2) {
+			emit_ev_frame(fd, frame, frame_count);
+			frame_count = 0;
 		}
 	}
 
 #if defined(INCLUDE_TIMESTAMP)
-	gettimeofday(&now, NULL);
-	const struct input_event timestamp_ev = {
+	frame[frame_count++] = (struct input_event) {
 		.code = MSC_TIMESTAMP,
 		.type = EV_MSC,
 		.value = (now.tv_sec - secAtInit)*1000000 + (now.tv_usec - usecAtInit),
 		.time = now,
 	};
-	const ssize_t timestamp_written = write(fd, (void*)&timestamp_ev, sizeof(timestamp_ev));
-	if (timestamp_written != sizeof(timestamp_ev)) {
-		fprintf(stderr, "Error in sync: written %ld bytes out of %ld\n", timestamp_written, sizeof(timestamp_ev));
-	}
 #endif
 
-	struct timeval now = {0};
-	gettimeofday(&now, NULL);
-	const struct input_event syn_ev = {
+	frame[frame_count++] = (struct input_event) {
 		.code = SYN_REPORT,
 		.type = EV_SYN,
 		.value = 0,
 		.time = now,
 	};
-	const ssize_t sync_written = write(fd, (void*)&syn_ev, sizeof(syn_ev));
-	if (sync_written != sizeof(syn_ev)) {
-		fprintf(stderr, "Error in sync: written %ld bytes out of %ld\n", sync_written, sizeof(syn_ev));
+
+	emit_ev_frame(fd, frame, frame_count);
+}
+
+static void emit_gyro_mouse(output_dev_t *const out_dev, int32_t dx, int32_t dy) {
+	struct input_event frame[3];
+	size_t frame_count = 0;
+
+	struct timeval now = {0};
+	gettimeofday(&now, NULL);
+
+	if (dx != 0) {
+		frame[frame_count++] = (struct input_event) { .time = now, .type = EV_REL, .code = REL_X, .value = dx };
+	}
+
+	if (dy != 0) {
+		frame[frame_count++] = (struct input_event) { .time = now, .type = EV_REL, .code = REL_Y, .value = dy };
 	}
+
+	frame[frame_count++] = (struct input_event) { .time = now, .type = EV_SYN, .code = SYN_REPORT, .value = 0 };
+
+	emit_ev_frame(out_dev->mouse_fd, frame, frame_count);
 }
 
 static void decode_ev(output_dev_t *const out_dev, message_t *const msg) {
-	static int F15_status = 0;
-	static int gyroscope_mouse_translation = 0;
+	gyro_mouse_t *const gyro_mouse = &out_dev->gyro_mouse;
 
 	// scan for mouse mode and emit events in the virtual mouse if required
 	if ((is_rc71l_ready(out_dev->logic)) && (is_mouse_mode(&out_dev->logic->platform))) {
@@ -553,139 +585,123 @@ static void decode_ev(output_dev_t *const out_dev, message_t *const msg) {
 		}
 	}
 
-    if (msg->data.event.ev[0].type == EV_REL) {
-        msg->data.event.ev_flags |= EV_MESSAGE_FLAGS_MOUSE;
-    } else if ((msg->data.event.ev_count >= 2) && (msg->data.event.ev[0].type == EV_MSC) && (msg->data.event.ev[0].code == MSC_SCAN)) {
-        if ((msg->data.event.ev[0].value == -13565784) && (msg->data.event.ev[1].type == EV_KEY) && (msg->data.event.ev[1].code == KEY_F18)) {
-            if (msg->data.event.ev[1].value == 1) {
-                printf("Detected mode switch command, switching mode...\n");
+	if (msg->data.event.ev[0].type == EV_REL) {
+		msg->data.event.ev_flags |= EV_MESSAGE_FLAGS_MOUSE;
+		return;
+	}
+
+	const input_map_chord_t *const chord = input_map_find_chord(&out_dev->input_map, &msg->data.event);
+	if (chord == NULL) {
+		return;
+	}
+
+	const int32_t key_value = msg->data.event.ev[1].value;
+	switch (chord->filter) {
+		case INPUT_MAP_FILTER_MODE_SWITCH:
+			if (key_value == 1) {
+				RING_LOG(RING_LOG_INFO, "Detected mode switch command, switching mode...\n");
 
 				const int new_mode = cycle_mode(&out_dev->logic->platform);
 
 				if (new_mode < 0) {
-					fprintf(stderr, "Error in mode switching: %d\n", new_mode);
+					RING_LOG(RING_LOG_ERROR, "Error in mode switching: %d\n", new_mode);
 				} else {
-					printf("Mode correctly switched to %d\n", new_mode);
+					RING_LOG(RING_LOG_INFO, "Mode correctly switched to %d\n", new_mode);
+					trace_record(TRACE_EV_MODE_SWITCH, (uint16_t)new_mode, 0);
 
 					if (new_mode == 0) {
-						printf("Mode switched to virtual DualSense for game mode.\n");
+						RING_LOG(RING_LOG_INFO, "Mode switched to virtual DualSense for game mode.\n");
 						out_dev->logic->gamepad_output = (out_dev->logic->flags & LOGIC_FLAGS_VIRT_DS5_ENABLE) ? GAMEPAD_OUTPUT_DS5 : ((out_dev->logic->flags & LOGIC_FLAGS_VIRT_DS4_ENABLE) ? GAMEPAD_OUTPUT_DS4: GAMEPAD_OUTPUT_EVDEV);
 					} else if (new_mode == 1) {
-						printf("Mode switched to virtual evdev for lizard mode.\n");
+						RING_LOG(RING_LOG_INFO, "Mode switched to virtual evdev for lizard mode.\n");
 						out_dev->logic->gamepad_output = GAMEPAD_OUTPUT_EVDEV;
 					} else if (new_mode == 2) {
-						printf("Mode switched to virtual DualShock for macro mode.\n");
+						RING_LOG(RING_LOG_INFO, "Mode switched to virtual DualShock for macro mode.\n");
 						out_dev->logic->gamepad_output = (out_dev->logic->flags & LOGIC_FLAGS_VIRT_DS4_ENABLE) ? GAMEPAD_OUTPUT_DS4 : GAMEPAD_OUTPUT_EVDEV;
 					}
 				}
-            } else {
-                // Do nothing effectively discarding the input
-            }
-
-            msg->flags |= INPUT_FILTER_FLAGS_DO_NOT_EMIT;
-        } else if (msg->data.event.ev[0].value == -13565784) {
-            msg->flags |= INPUT_FILTER_FLAGS_DO_NOT_EMIT;
-        } else if ((msg->data.event.ev_count == 2) && (msg->data.event.ev[0].value == 458860) && (msg->data.event.ev[1].type == EV_KEY) && (msg->data.event.ev[1].code == KEY_F17)) {
-            if (is_rc71l_ready(out_dev->logic)) {
+			} else {
+				// Do nothing effectively discarding the input
+			}
+
+			msg->flags |= INPUT_FILTER_FLAGS_DO_NOT_EMIT;
+			break;
+		case INPUT_MAP_FILTER_DROP:
+			msg->flags |= INPUT_FILTER_FLAGS_DO_NOT_EMIT;
+			break;
+		case INPUT_MAP_FILTER_GEAR_DOWN:
+			if (is_rc71l_ready(out_dev->logic)) {
 				if (is_mouse_mode(&out_dev->logic->platform)) {
-					if (msg->data.event.ev[1].value < 2) {
+					if (key_value < 2) {
 						msg->data.event.ev_count = 1;
 						msg->data.event.ev[0].type = EV_KEY;
 						msg->data.event.ev[0].code = BTN_GEAR_DOWN;
-						msg->data.event.ev[0].value = msg->data.event.ev[1].value;
+						msg->data.event.ev[0].value = key_value;
 						return;
 					}
 				} else if (is_gamepad_mode(&out_dev->logic->platform)) {
-					if (msg->data.event.ev[1].value == 0) {
-						--gyroscope_mouse_translation;
-					} else if (msg->data.event.ev[1].value == 1) {
-						++gyroscope_mouse_translation;
+					if ((key_value == 0) && (gyro_mouse->hold_buttons > 0)) {
+						--gyro_mouse->hold_buttons;
+					} else if (key_value == 1) {
+						++gyro_mouse->hold_buttons;
 					}
 				}
 
 				msg->flags |= INPUT_FILTER_FLAGS_DO_NOT_EMIT;
 			}
-        } else if ((msg->data.event.ev_count == 2) && (msg->data.event.ev[0].value == 458861) && (msg->data.event.ev[1].type == EV_KEY) && (msg->data.event.ev[1].code == KEY_F18)) {
-            if (is_rc71l_ready(out_dev->logic)) {
+			break;
+		case INPUT_MAP_FILTER_GEAR_UP:
+			if (is_rc71l_ready(out_dev->logic)) {
 				if (is_mouse_mode(&out_dev->logic->platform)) {
-					if (msg->data.event.ev[1].value < 2) {
+					if (key_value < 2) {
 						msg->data.event.ev_count = 1;
 						msg->data.event.ev[0].type = EV_KEY;
 						msg->data.event.ev[0].code = BTN_GEAR_UP;
-						msg->data.event.ev[0].value = msg->data.event.ev[1].value;
+						msg->data.event.ev[0].value = key_value;
 					}
 				} else if (is_gamepad_mode(&out_dev->logic->platform)) {
-					if (msg->data.event.ev[1].value == 0) {
-						--gyroscope_mouse_translation;
-					} else if (msg->data.event.ev[1].value == 1) {
-						++gyroscope_mouse_translation;
+					if ((key_value == 0) && (gyro_mouse->hold_buttons > 0)) {
+						--gyro_mouse->hold_buttons;
+					} else if (key_value == 1) {
+						++gyro_mouse->hold_buttons;
 					}
 
 					msg->flags |= INPUT_FILTER_FLAGS_DO_NOT_EMIT;
 				}
 			}
-        } else if ((msg->data.event.ev_count == 2) && (msg->data.event.ev[0].value == -13565786) && (msg->data.event.ev[1].type == EV_KEY) && (msg->data.event.ev[1].code == KEY_F16)) {
-            printf("Converted AC short-press button to BTN_MODE\n");
+			break;
+		case INPUT_MAP_FILTER_BTN_MODE:
+			RING_LOG(RING_LOG_INFO, "Converted AC short-press button to BTN_MODE\n");
 			msg->data.event.ev_count = 1;
-            msg->data.event.ev[0].type = EV_KEY;
-            msg->data.event.ev[0].code = BTN_MODE;
-            msg->data.event.ev[0].value = msg->data.event.ev[1].value;
-        } else if ((msg->data.event.ev_count == 2) && (msg->data.event.ev[0].value == -13565787) && (msg->data.event.ev[1].type == EV_KEY) && (msg->data.event.ev[1].code == KEY_F15)) {
-            if (msg->data.event.ev[1].value == 0) {
-                if (F15_status > 0) {
-                    --F15_status;
-                }
-
-                if (F15_status == 0) {
-                    printf("Exiting gyro mode.\n");
-                }
-            } else if (msg->data.event.ev[1].value == 1) {
-                if (F15_status <= 2) {
-                    ++F15_status;
-                }
-
-                if (F15_status == 1) {
-                    printf("Entering gyro mode.\n");
-                }
-            }
-
-            msg->flags |= INPUT_FILTER_FLAGS_DO_NOT_EMIT;
-        } else if (
-			(msg->data.event.ev_count == 2) &&
-			(msg->data.event.ev_size >= 3) &&
-			(msg->data.event.ev[0].value == -13565896) &&
-			(msg->data.event.ev[1].type == EV_KEY) &&
-			(msg->data.event.ev[1].code == KEY_PROG1)
-		) {
-			// do nothing to match the DS4 joystick
-			/*
-            msg->data.event.ev_count = 3;
-
-            const int32_t val = msg->data.event.ev[1].value;
-            //struct timeval time = msg->data.event.ev[1].time;
-
-            msg->data.event.ev[0].type = EV_KEY;
-            msg->data.event.ev[0].code = BTN_MODE;
-            msg->data.event.ev[0].value = val;
-
-            msg->data.event.ev[1].type = SYN_REPORT;
-            msg->data.event.ev[1].code = EV_SYN;
-            msg->data.event.ev[1].value = 0;
-
-            msg->data.event.ev[2].type = EV_KEY;
-            msg->data.event.ev[2].code = BTN_SOUTH;
-            msg->data.event.ev[2].value = val;
-
-            events[3].type = SYN_REPORT;
-            events[3].code = EV_SYN;
-            events[3].value = 0;
-
-            events[4].type = EV_KEY;
-            events[4].code = BTN_SOUTH;
-            events[4].value = 0;
-			*/
-        }
-    }
+			msg->data.event.ev[0].type = EV_KEY;
+			msg->data.event.ev[0].code = BTN_MODE;
+			msg->data.event.ev[0].value = key_value;
+			break;
+		case INPUT_MAP_FILTER_GYRO_HOLD:
+			if (key_value == 0) {
+				if (gyro_mouse->gyro_mode > 0) {
+					--gyro_mouse->gyro_mode;
+				}
+
+				if (gyro_mouse->gyro_mode == 0) {
+					RING_LOG(RING_LOG_INFO, "Exiting gyro mode.\n");
+				}
+			} else if (key_value == 1) {
+				if (gyro_mouse->gyro_mode <= 2) {
+					++gyro_mouse->gyro_mode;
+				}
+
+				if (gyro_mouse->gyro_mode == 1) {
+					RING_LOG(RING_LOG_INFO, "Entering gyro mode.\n");
+				}
+			}
+
+			msg->flags |= INPUT_FILTER_FLAGS_DO_NOT_EMIT;
+			break;
+		default:
+			// i.e. the AC button: emitted as-is to match the DS4 joystick
+			break;
+	}
 }
 int swapLegionButtons = 0;
 int crossButtonDelayCounter = 0;
@@ -790,131 +806,19 @@ void update_gs_from_hidraw(gamepad_status_t *gs, const message_t *msg) {
     // Handle other special cases or additional logic as needed
     // ...
 }
-static void update_gs_from_ev(gamepad_status_t *const gs, message_t *const msg, controller_settings_t *const settings) {
-	if ( // this is what happens at release of the left-screen button of the ROG Ally
-		(msg->data.event.ev_count == 2) &&
-		(msg->data.event.ev[0].type == EV_MSC) &&
-		(msg->data.event.ev[0].code == MSC_SCAN) &&
-		(msg->data.event.ev[0].value == -13565786) &&
-		(msg->data.event.ev[1].type == EV_KEY) &&
-		(msg->data.event.ev[1].code == KEY_F16) &&
-		(msg->data.event.ev[1].value == 1)
-	) {
-#if defined(INCLUDE_OUTPUT_DEBUG)
-		printf("RC71L CC button short-press detected\n");
-#endif
-		gs->flags |= GAMEPAD_STATUS_FLAGS_PRESS_AND_REALEASE_CENTER;
-	} else if ( // this is what happens at release of the right-screen button of the ROG Ally
-		(msg->data.event.ev_count == 2) &&
-		(msg->data.event.ev[0].type == EV_MSC) &&
-		(msg->data.event.ev[0].code == MSC_SCAN) &&
-		(msg->data.event.ev[0].value == -13565896) &&
-		(msg->data.event.ev[1].type == EV_KEY) &&
-		(msg->data.event.ev[1].code == KEY_PROG1) &&
-		(msg->data.event.ev[1].value == 1)
-	) {
-#if defined(INCLUDE_OUTPUT_DEBUG)
-		printf("RC71L AC button short-press detected\n");
-#endif
-		if (settings->enable_qam) {
-			gs->flags |= GAMEPAD_STATUS_FLAGS_OPEN_STEAM_QAM;
-		}
-	} else if (
-		(msg->data.event.ev_count == 2) &&
-		(msg->data.event.ev[0].type == EV_MSC) &&
-		(msg->data.event.ev[0].code == MSC_SCAN) &&
-		(msg->data.event.ev[0].value == 458860) &&
-		(msg->data.event.ev[1].type == EV_KEY) &&
-		(msg->data.event.ev[1].code == KEY_F17)
-	) {
-		gs->l4 = msg->data.event.ev[1].value;
-    } else if (
-		(msg->data.event.ev_count == 2) &&
-		(msg->data.event.ev[0].type == EV_MSC) &&
-		(msg->data.event.ev[0].code == MSC_SCAN) &&
-		(msg->data.event.ev[0].value == 458861) &&
-		(msg->data.event.ev[1].type == EV_KEY) &&
-		(msg->data.event.ev[1].code == KEY_F18)
-	) {
-		gs->r4 = msg->data.event.ev[1].value;
-	}
-
-	for (uint32_t i = 0; i < msg->data.event.ev_count; ++i) {
-		if (msg->data.event.ev[i].type == EV_KEY) {
-			if (msg->data.event.ev[i].code == BTN_EAST) {
-				if (settings->nintendo_layout) {
-					gs->cross = msg->data.event.ev[i].value;
-				} else {
-					gs->circle = msg->data.event.ev[i].value;
-				}
-			} else if (msg->data.event.ev[i].code == BTN_NORTH) {
-				if (settings->nintendo_layout) {
-					gs->triangle = msg->data.event.ev[i].value;
-				} else {
-					gs->square = msg->data.event.ev[i].value;
-				}
-			} else if (msg->data.event.ev[i].code == BTN_SOUTH) {
-				if (settings->nintendo_layout) {
-					gs->circle = msg->data.event.ev[i].value;
-				} else {
-					gs->cross = msg->data.event.ev[i].value;
-				}
-			} else if (msg->data.event.ev[i].code == BTN_WEST) {
-				if (settings->nintendo_layout) {
-					gs->square = msg->data.event.ev[i].value;
-				} else {
-					gs->triangle = msg->data.event.ev[i].value;
-				}
-			// } else if (msg->data.event.ev[i].code == BTN_SELECT) {
-			// 	gs->option = msg->data.event.ev[i].value;
-			// } else if (msg->data.event.ev[i].code == BTN_START) {
-			// 	gs->share = msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == BTN_TR) {
-				gs->r1 = msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == BTN_TL) {
-				gs->l1 = msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == BTN_THUMBR) {
-				gs->r3 = msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == BTN_THUMBL) {
-				gs->l3 = msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == BTN_MODE) {
-				gs->flags |= GAMEPAD_STATUS_FLAGS_PRESS_AND_REALEASE_CENTER;
-			}
-		} else if (msg->data.event.ev[i].type == EV_ABS) {
-			if (msg->data.event.ev[i].code == ABS_X) {
-				gs->joystick_positions[0][0] = (int32_t)msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == ABS_Y) {
-				gs->joystick_positions[0][1] = (int32_t)msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == ABS_RX) {
-				gs->joystick_positions[1][0] = (int32_t)msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == ABS_RY) {
-				gs->joystick_positions[1][1] = (int32_t)msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == ABS_Z) {
-				gs->l2_trigger = (int32_t)msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == ABS_RZ) {
-				gs->r2_trigger = (int32_t)msg->data.event.ev[i].value;
-			} else if (msg->data.event.ev[i].code == ABS_HAT0X) {
-				const int v = msg->data.event.ev[i].value;
-				gs->dpad &= 0xF0;
-				if (v == 0) {
-					gs->dpad |= 0x00;
-				} else if (v == 1) {
-					gs->dpad |= 0x01;
-				} else if (v == -1) {
-					gs->dpad |= 0x02;
-				}
-			} else if (msg->data.event.ev[i].code == ABS_HAT0Y) {
-				const int v = msg->data.event.ev[i].value;
-				gs->dpad &= 0x0F;
-				if (v == 0) {
-					gs->dpad |= 0x00;
-				} else if (v == 1) {
-					gs->dpad |= 0x20;
-				} else if (v == -1) {
-					gs->dpad |= 0x10;
-				}
-			}
-		}
+// raw_gyro/raw_accel hold the sensor counts scaled by this factor, as the virtual controllers expect them
+#define IMU_REPORT_SCALE_FACTOR 20
+
+/*
+ * Sensor counts for a vector in the imu_message_t frame: the inverse of what dev_iio does with the preferred
+ * scale (lsb), with y and z flipped back as the virtual controllers flip them again.
+ */
+static void imu_report_from_si(int16_t out[3], const double v[3], double lsb) {
+	static const double axis_sign[3] = { 1.0, -1.0, -1.0 };
+
+	for (int i = 0; i < 3; ++i) {
+		const double counts = IMU_REPORT_SCALE_FACTOR * axis_sign[i] * (v[i] / lsb);
+		out[i] = (counts > (double)INT16_MAX) ? INT16_MAX : ((counts < (double)INT16_MIN) ? INT16_MIN : (int16_t)counts);
 	}
 }
 
@@ -926,47 +830,102 @@ static void handle_msg(output_dev_t *const out_dev, message_t *const msg) {
 		
 		const int upd_beg_res = logic_begin_status_update(out_dev->logic);
 		if (upd_beg_res == 0) {
-			update_gs_from_ev(&out_dev->logic->gamepad, msg, &out_dev->logic->controller_settings);
+			input_map_apply(&out_dev->input_map, &out_dev->logic->gamepad, &msg->data.event);
+			out_dev->logic->gamepad.last_input_read_ns = msg->ts.read_ns;
 
 			logic_end_status_update(out_dev->logic);
 		} else {
-			fprintf(stderr, "[ev] Unable to begin the gamepad status update: %d\n", upd_beg_res);
+			RING_LOG(RING_LOG_ERROR, "[ev] Unable to begin the gamepad status update: %d\n", upd_beg_res);
 		}
 
 		if (out_dev->logic->gamepad_output == GAMEPAD_OUTPUT_EVDEV) {
 			emit_ev(out_dev, msg);
+			latency_record_output(LATENCY_OUTPUT_EVDEV, LATENCY_INPUT_BUTTONS, msg->ts.read_ns);
 		}
 	} else if (msg->type == MSG_TYPE_IMU) {
+		imu_fusion_t *const fusion = &out_dev->imu_fusion;
+
+		// accel_m2s is not read from the accelerometer: only a real one can correct the drift and find gravity
+		if ((imu_fusion_enabled(fusion)) && (msg->data.imu.flags & IMU_MESSAGE_FLAGS_ACCEL_SENSOR)) {
+			imu_fusion_update_accel(fusion, msg->data.imu.accel_sensor_m2s);
+		}
+
+		const int fused = imu_fusion_enabled(fusion) && fusion->has_accel;
+		if ((imu_fusion_enabled(fusion)) && (!fusion->has_accel) && (!fusion->no_accel_logged)) {
+			RING_LOG(RING_LOG_WARN, "[imu] No accelerometer reading yet: sensor fusion, gravity and world space stay disabled\n");
+			fusion->no_accel_logged = 1;
+		}
+
+		// the filter runs at the full IMU rate, outside of the status update
+		double gyro[3], accel[3];
+		if (fused) {
+			if (msg->data.imu.flags & IMU_MESSAGE_FLAGS_ANGLVEL) {
+				imu_fusion_update_gyro(fusion, msg->data.imu.gyro_rad_s, &msg->data.imu.gyro_read_time);
+			}
+
+			imu_fusion_motion(fusion, msg->data.imu.gyro_rad_s, fusion->accel, gyro, accel);
+		}
+
+		// the pointer moves as soon as the sample is taken, one frame per sample
+		if (msg->data.imu.flags & IMU_MESSAGE_FLAGS_ANGLVEL) {
+			int32_t dx = 0, dy = 0;
+			const double *const mouse_gyro = fused ? gyro : msg->data.imu.gyro_rad_s;
+			if ((gyro_mouse_update(&out_dev->gyro_mouse, mouse_gyro, &msg->data.imu.gyro_read_time, &dx, &dy)) && (out_dev->mouse_fd >= 0)) {
+				emit_gyro_mouse(out_dev, dx, dy);
+				latency_record_output(LATENCY_OUTPUT_EVDEV, LATENCY_INPUT_IMU, msg->ts.read_ns);
+			}
+		}
+
 		const int upd_beg_res = logic_begin_status_update(out_dev->logic);
-		const scaleFactor = 20;
 		if (upd_beg_res == 0) {
+			gamepad_status_t *const gs = &out_dev->logic->gamepad;
+
 			if (msg->data.imu.flags & IMU_MESSAGE_FLAGS_ANGLVEL) {
-				out_dev->logic->gamepad.last_gyro_motion_time = msg->data.imu.gyro_read_time;
+				gs->last_gyro_motion_time = msg->data.imu.gyro_read_time;
 
-				memcpy(out_dev->logic->gamepad.gyro, msg->data.imu.gyro_rad_s, sizeof(double[3]));
+				if (fused) {
+					memcpy(gs->gyro, gyro, sizeof(double[3]));
+					imu_report_from_si(gs->raw_gyro, gyro, LSB_PER_RAD_S_2000_DEG_S);
+				} else {
+					memcpy(gs->gyro, msg->data.imu.gyro_rad_s, sizeof(double[3]));
 
-				out_dev->logic->gamepad.raw_gyro[0] = scaleFactor * msg->data.imu.gyro_x_raw;
-				out_dev->logic->gamepad.raw_gyro[1] = scaleFactor * msg->data.imu.gyro_y_raw;
-				out_dev->logic->gamepad.raw_gyro[2] = scaleFactor * msg->data.imu.gyro_z_raw;
+					gs->raw_gyro[0] = IMU_REPORT_SCALE_FACTOR * msg->data.imu.gyro_x_raw;
+					gs->raw_gyro[1] = IMU_REPORT_SCALE_FACTOR * msg->data.imu.gyro_y_raw;
+					gs->raw_gyro[2] = IMU_REPORT_SCALE_FACTOR * msg->data.imu.gyro_z_raw;
+				}
 			}
-			
-			if (msg->data.imu.flags & IMU_MESSAGE_FLAGS_ACCEL) {
-				out_dev->logic->gamepad.last_accel_motion_time = msg->data.imu.accel_read_time;
 
-				memcpy(out_dev->logic->gamepad.accel, msg->data.imu.accel_m2s, sizeof(double[3]));
+			// a reported gravity vector changes with every gyro sample, not only with accel ones
+			if ((msg->data.imu.flags & IMU_MESSAGE_FLAGS_ACCEL) || ((fused) && (fusion->report_gravity))) {
+				gs->last_accel_motion_time = (msg->data.imu.flags & IMU_MESSAGE_FLAGS_ACCEL) ?
+					msg->data.imu.accel_read_time : msg->data.imu.gyro_read_time;
+
+				if (fused) {
+					memcpy(gs->accel, accel, sizeof(double[3]));
+					imu_report_from_si(gs->raw_accel, accel, LSB_PER_16G);
+				} else {
+					memcpy(gs->accel, msg->data.imu.accel_m2s, sizeof(double[3]));
 
-				out_dev->logic->gamepad.raw_accel[0] = scaleFactor * msg->data.imu.accel_x_raw;
-				out_dev->logic->gamepad.raw_accel[1] = scaleFactor * msg->data.imu.accel_y_raw;
-				out_dev->logic->gamepad.raw_accel[2] = scaleFactor * msg->data.imu.accel_z_raw;
+					gs->raw_accel[0] = IMU_REPORT_SCALE_FACTOR * msg->data.imu.accel_x_raw;
+					gs->raw_accel[1] = IMU_REPORT_SCALE_FACTOR * msg->data.imu.accel_y_raw;
+					gs->raw_accel[2] = IMU_REPORT_SCALE_FACTOR * msg->data.imu.accel_z_raw;
+				}
+			}
 
-				logic_end_status_update(out_dev->logic);
+			if (fused) {
+				memcpy(gs->orientation, fusion->q, sizeof(double[4]));
+				imu_fusion_gravity(fusion, gs->gravity);
 			}
 
+			gs->last_imu_read_ns = msg->ts.read_ns;
+
+			logic_end_status_update(out_dev->logic);
+
 #if defined(INCLUDE_OUTPUT_DEBUG)
 			// printf("gyro_x: %d\t\t| gyro_y: %d\t\t| gyro_z: %d\t\t\n", (int)out_dev->logic->gamepad.raw_gyro[0], (int)out_dev->logic->gamepad.raw_gyro[1], (int)out_dev->logic->gamepad.raw_gyro[2]);
 #endif
 		} else {
-			fprintf(stderr, "[imu] Unable to begin the gamepad status update: %d\n", upd_beg_res);
+			RING_LOG(RING_LOG_ERROR, "[imu] Unable to begin the gamepad status update: %d\n", upd_beg_res);
 		}
 	} else if (msg->type == MSG_TYPE_HIDRAW) {
 
@@ -977,127 +936,169 @@ static void handle_msg(output_dev_t *const out_dev, message_t *const msg) {
 		// printf("\n");
 		
 
-		decode_hidraw_to_gamepad(&out_dev->logic->gamepad, msg);
-		//Begin updating gamepad status
+		//Begin updating gamepad status (update_gs_from_hidraw decodes the report itself)
 		const int upd_hidraw_res = logic_begin_status_update(out_dev->logic);
 		if(upd_hidraw_res == 0){
 			update_gs_from_hidraw(&out_dev->logic->gamepad,msg);
+			out_dev->logic->gamepad.last_input_read_ns = msg->ts.read_ns;
 
 			logic_end_status_update(out_dev->logic);
 		} else {
-			fprintf(stderr, "[hidraw] Unable to begin the gamepad status update: %d\n", upd_hidraw_res);
+			RING_LOG(RING_LOG_ERROR, "[hidraw] Unable to begin the gamepad status update: %d\n", upd_hidraw_res);
 		}
 		if (out_dev->logic->gamepad_output == GAMEPAD_OUTPUT_EVDEV) {
 			emit_ev(out_dev, msg);
+			latency_record_output(LATENCY_OUTPUT_EVDEV, LATENCY_INPUT_BUTTONS, msg->ts.read_ns);
 		}
 		
 	}
 }
 
-void *output_dev_rumble_thread_func(void* ptr) {
-	output_dev_t *const out_dev = (output_dev_t*)ptr;
-
-	struct timeval now = {0};
-
-#if defined(INCLUDE_TIMESTAMP)
-	gettimeofday(&now, NULL);
-	__time_t secAtInit = now.tv_sec;
-	__time_t usecAtInit = now.tv_usec;
-#endif
-
-	pthread_mutex_lock(&out_dev->logic->gamepad_mutex);
-	uint64_t rumble_events_count = out_dev->logic->gamepad.rumble_events_count;
-	pthread_mutex_unlock(&out_dev->logic->gamepad_mutex);
+/**
+ * Handle a message taken from either lane and hand it back to its pool.
+ */
+static void output_dev_dispatch(output_dev_t *const out_dev, message_t *const msg, replay_recorder_t *const recorder) {
+	msg->ts.dequeue_ns = latency_now_ns();
+	if (recorder->file != NULL) {
+		replay_recorder_write(recorder, msg);
+	}
+	handle_msg(out_dev, msg);
+	msg->ts.apply_ns = latency_now_ns();
+	latency_record_message(msg);
+	trace_record(TRACE_EV_APPLY, (uint16_t)msg->type, (msg->ts.read_ns != 0) ? msg->ts.apply_ns - msg->ts.read_ns : 0);
 
-	// maximum number of ms that the gamepad can remain in a blocked status
-	const int timeout_ms = 40;
+	// from now on it's forbidden to use this memory
+	message_pool_release(msg);
+}
 
-    for (;;) {
-		// sleep for about 4ms: this is an aggressive polling for rumble.
-		usleep(16000);
-
-		// here transmit the rumble request to the input-device-handling components
-		pthread_mutex_lock(&out_dev->logic->gamepad_mutex);
-		uint64_t tmp_ev_count = out_dev->logic->gamepad.rumble_events_count;
-		uint8_t right_motor = out_dev->logic->gamepad.motors_intensity[0];
-		uint8_t left_motor = out_dev->logic->gamepad.motors_intensity[1];
-		pthread_mutex_unlock(&out_dev->logic->gamepad_mutex);
-
-		// check if the gamepad has notified the presence of a rumble event
-		if (tmp_ev_count != rumble_events_count) {
-			rumble_message_t *const rumble_msg = malloc(sizeof(rumble_message_t));
-			if(rumble_msg != NULL) {
-				rumble_msg->strong_magnitude = (uint16_t)left_motor << (uint16_t)8;
-				rumble_msg->weak_magnitude = (uint16_t)right_motor << (uint16_t)8;
-
-				const int rumble_emit_res = queue_push_timeout(&out_dev->logic->rumble_events_queue, (void*)rumble_msg, timeout_ms);
-				if (rumble_emit_res == 0) {
-#if defined(INCLUDE_OUTPUT_DEBUG)
-					printf("Rumble request propagated\n");
-#endif
+static void output_dev_apply_settings(output_dev_t *const out_dev, const controller_settings_t *const settings) {
+	// the map is only replaced if the new one compiles: a failure keeps the previous layout
+	input_map_t *const map = malloc(sizeof(input_map_t));
+	if (map == NULL) {
+		fprintf(stderr, "Unable to allocate the input map: keeping the previous one\n");
+	} else if (input_map_compile(map, settings) != 0) {
+		fprintf(stderr, "Unable to compile the input map: keeping the previous one\n");
+	} else {
+		memcpy(&out_dev->input_map, map, sizeof(input_map_t));
+	}
+	free(map);
 
-					// update the rumble events counter: this rumble event was handled
-					rumble_events_count = tmp_ev_count;
-				} else {
-#if defined(INCLUDE_OUTPUT_DEBUG)
-					fprintf(stderr, "Error propating the rumble event: %d\n", rumble_emit_res);
-#endif
+	imu_fusion_configure(&out_dev->imu_fusion, settings);
+	gyro_mouse_configure(&out_dev->gyro_mouse, settings);
 
-					free(rumble_msg);
-				}
-			} else {
-				fprintf(stderr, "Error allocating resources to request a rumble\n");
-			}
-		}
-		
-		if (logic_termination_requested(out_dev->logic)) {
-            break;
-        }
-    }
-	
-    return NULL;
+	out_dev->settings = settings;
 }
 
 void *output_dev_thread_func(void *ptr) {
 	output_dev_t *const out_dev = (output_dev_t*)ptr;
 
+	rt_thread_setup(&out_dev->logic->controller_settings, RT_ROLE_OUTPUT);
+	trace_register_thread("output");
+
+	out_dev->settings = logic_get_settings(out_dev->logic);
+
+	const int input_map_res = input_map_compile(&out_dev->input_map, out_dev->settings);
+	if (input_map_res != 0) {
+		fprintf(stderr, "Unable to compile the input map: %d\n", input_map_res);
+		return NULL;
+	}
+
+	imu_fusion_init(&out_dev->imu_fusion, out_dev->settings);
+	gyro_mouse_init(&out_dev->gyro_mouse, out_dev->settings);
+
 	struct timeval now = {0};
 
+	// every message taken from the queue is appended to the input log, for offline replay
+	replay_recorder_t recorder = { .file = NULL, .records = 0 };
+	const char *const record_file = out_dev->logic->controller_settings.record_file;
+	if (record_file[0] != '\0') {
+		if (replay_recorder_open(&recorder, record_file) == 0) {
+			printf("Recording input messages to %s\n", record_file);
+		}
+	}
+
 #if defined(INCLUDE_TIMESTAMP)
 	gettimeofday(&now, NULL);
 	__time_t secAtInit = now.tv_sec;
 	__time_t usecAtInit = now.tv_usec;
 #endif
 
-	pthread_t rumble_thread;
-	const int rumble_thread_creation = pthread_create(&rumble_thread, NULL, output_dev_rumble_thread_func, ptr);
-	if (rumble_thread_creation != 0) {
-		fprintf(stderr, "Error creating the rumble thread: %d -- rumble will not work.\n", rumble_thread_creation);
-	}
+	size_t last_queue_depth = 0;
 
     for (;;) {
+		// a reloaded configuration is picked up between batches, never in the middle of one
+		const controller_settings_t *const settings = logic_get_settings(out_dev->logic);
+		if (settings != out_dev->settings) {
+			output_dev_apply_settings(out_dev, settings);
+		}
+
+		queue_t *const buttons_lane = &out_dev->logic->input_queue;
+		const int batch_size = settings->output_batch_size;
+
+		// recorded on change only: an idle queue does not fill the flight recorder
+		const size_t queue_depth_now = queue_depth(buttons_lane);
+		metrics_queue_depth(queue_depth_now);
+		if (queue_depth_now != last_queue_depth) {
+			trace_record(TRACE_EV_QUEUE_DEPTH, 0, (uint64_t)queue_depth_now);
+			last_queue_depth = queue_depth_now;
+		}
+
+		// taken before looking at the lanes: an IMU sample posted after this point interrupts the sleep below
+		const unsigned wake_seq = queue_wake_seq(buttons_lane);
+
+		// buttons and axes first: drain everything already pending (up to batch_size)
+		int handled = 0;
 		void *raw_ev;
-		const int pop_res = queue_pop_timeout(&out_dev->logic->input_queue, &raw_ev, 5000);
-		if (pop_res == 0) {
-			message_t *const msg = (message_t*)raw_ev;
-			handle_msg(out_dev, msg);
-
-			// from now on it's forbidden to use this memory
-			msg->flags |= MESSAGE_FLAGS_HANDLE_DONE;
-		} else if (pop_res == -1) {
-			// timed out read
-		} else {
-			fprintf(stderr, "Cannot read from input queue: %d\n", pop_res);
-			continue;
+		while ((handled < batch_size) && (queue_try_pop(buttons_lane, &raw_ev) == 0)) {
+			output_dev_dispatch(out_dev, (message_t*)raw_ev, &recorder);
+			++handled;
+		}
+
+		// then the freshest IMU sample: older ones have been dropped by the producer already
+		message_t *const imu_msg = logic_take_imu(out_dev->logic);
+		if (imu_msg != NULL) {
+			output_dev_dispatch(out_dev, imu_msg, &recorder);
+		}
+
+		if ((handled == 0) && (imu_msg == NULL)) {
+			// sleep only while there is nothing to do: a button frame or an IMU sample wakes us up
+			const int pop_res = queue_pop_wakeable(buttons_lane, &raw_ev, 5000, wake_seq);
+			if (pop_res == 0) {
+				output_dev_dispatch(out_dev, (message_t*)raw_ev, &recorder);
+				++handled;
+			} else if ((errno != ETIMEDOUT) && (errno != EINTR)) {
+				RING_LOG(RING_LOG_ERROR, "Cannot read from input queue: %d\n", errno);
+			}
 		}
 
+		// buttons and axes are pushed to the virtual controller right away, once per drained batch;
+		// IMU samples are left to the report timer so that they do not defeat coalescing, unless the
+		// reporter is idle: its timer then runs at the keepalive rate and would hold the sample back
+		const int wake_reporter = (handled > 0) || ((imu_msg != NULL) && (logic_report_idle(out_dev->logic)));
+		if ((wake_reporter) && (out_dev->logic->controller_settings.report_on_change)) {
+			logic_notify_gamepad_update(out_dev->logic);
+		}
+
+		latency_dump_if_requested(stdout);
+
 		if (logic_termination_requested(out_dev->logic)) {
             break;
         }
-		usleep(1500); //Usage 2.7%
     }
 
-	pthread_join(rumble_thread, NULL);
+	// an IMU sample left in the mailbox still belongs to its reader's pool
+	message_t *const pending_imu = logic_take_imu(out_dev->logic);
+	if (pending_imu != NULL) {
+		message_pool_release(pending_imu);
+	}
+
+	replay_recorder_close(&recorder);
 
     return NULL;
 }
+
+#if defined(ROGUE_ENEMY_BENCH)
+void output_dev_bench_decode_ev(output_dev_t *const out_dev, message_t *const msg) {
+	decode_ev(out_dev, msg);
+}
+#endif
@@ -2,6 +2,9 @@
 
 #include "queue.h"
 #include "logic.h"
+#include "input_map.h"
+#include "imu_fusion.h"
+#include "gyro_mouse.h"
 
 // // Emulates a "Generic" controller:
 // #define OUTPUT_DEV_NAME             "ROGueENEMY"
@@ -53,6 +56,7 @@
 #define GYRO_DEADZONE 1 // degrees/s to count as zero movement
 
 #undef INCLUDE_TIMESTAMP
+// every emitted event is logged at the debug level (log_level = "debug")
 #define INCLUDE_OUTPUT_DEBUG
 
 typedef enum output_dev_type {
@@ -66,9 +70,28 @@ typedef struct output_dev {
     int imu_fd;
     int mouse_fd;
 
+    // compiled by the output thread from logic->controller_settings
+    input_map_t input_map;
+
+    // orientation filter, only touched by the output thread
+    imu_fusion_t imu_fusion;
+
+    // gyro-to-mouse engine and the state of its activation buttons, only touched by the output thread
+    gyro_mouse_t gyro_mouse;
+
+    // settings snapshot the three above were built from
+    const controller_settings_t *settings;
+
     logic_t *logic;
 } output_dev_t;
 
 int create_output_dev(const char* uinput_path, output_dev_type_t type);
 
 void *output_dev_thread_func(void *ptr);
+
+void decode_hidraw_to_gamepad(gamepad_status_t *gamepad, const message_t *msg);
+
+#if defined(ROGUE_ENEMY_BENCH)
+// decode_ev for rogue-enemy-bench (bench.c)
+void output_dev_bench_decode_ev(output_dev_t *const out_dev, message_t *const msg);
+#endif
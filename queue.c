@@ -1,102 +1,332 @@
 #include "queue.h"
 
-int queue_init(queue_t* const q, size_t max_elements) {
-    q->front = q->rear = -1;
-    q->array_size = max_elements;
-    if (pthread_mutex_init(&q->mutex, NULL) != 0) {
-        perror("mutex");
+static size_t queue_capacity_for(size_t max_elements) {
+    // the sequence-number scheme needs at least two slots to tell "full" from "empty"
+    size_t capacity = 2;
+    while (capacity < max_elements) {
+        capacity <<= 1;
+    }
+
+    return capacity;
+}
+
+static int ring_push(queue_t* const q, void *in_item) {
+    size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    for (;;) {
+        queue_slot_t *const slot = &q->slots[pos & q->mask];
+        const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->tail, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                slot->item = in_item;
+                atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            // full
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+        }
+    }
+}
+
+static int ring_pop(queue_t* const q, void **out_item) {
+    size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+    for (;;) {
+        queue_slot_t *const slot = &q->slots[pos & q->mask];
+        const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        const intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->head, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *out_item = slot->item;
+                atomic_store_explicit(&slot->seq, pos + q->mask + 1, memory_order_release);
+                return 0;
+            }
+        } else if (diff < 0) {
+            // empty
+            return -1;
+        } else {
+            pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+        }
+    }
+}
+
+static void queue_wake(queue_t* const q, atomic_uint *const waiters, pthread_cond_t *const cond) {
+    // pairs with the fence in queue_wait: either the waiter sees the new element or we see the waiter
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiters, memory_order_relaxed) == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&q->wait_mutex);
+    pthread_cond_signal(cond);
+    pthread_mutex_unlock(&q->wait_mutex);
+}
+
+static int deadline_from_timeout(struct timespec *const deadline, int timeout_ms) {
+    if (clock_gettime(CLOCK_MONOTONIC, deadline) == -1) {
         return -1;
     }
 
-    q->array = calloc(sizeof(void*), max_elements);
-    if (q->array == NULL) {
+    deadline->tv_sec += timeout_ms / 1000;
+    deadline->tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec += 1;
+        deadline->tv_nsec -= 1000000000;
+    }
+
+    return 0;
+}
+
+/**
+ * Slow path: sleep on the condition variable until op succeeds or the deadline (if any) expires.
+ *
+ * Returns 0 on success or -1 with errno set to ETIMEDOUT, matching the old sem_timedwait behaviour.
+ * When wake_seq is given the wait also ends (-1, errno EINTR) as soon as q->wake_seq moves past it.
+ */
+static int queue_wait(
+    queue_t* const q,
+    int (*op)(queue_t* const, void*),
+    void *arg,
+    atomic_uint *const waiters,
+    pthread_cond_t *const cond,
+    const struct timespec *const deadline,
+    const unsigned *const wake_seq
+) {
+    int res = -1;
+
+    pthread_mutex_lock(&q->wait_mutex);
+    atomic_fetch_add_explicit(waiters, 1, memory_order_relaxed);
+
+    for (;;) {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (op(q, arg) == 0) {
+            res = 0;
+            break;
+        }
+
+        if ((wake_seq != NULL) && (atomic_load_explicit(&q->wake_seq, memory_order_relaxed) != *wake_seq)) {
+            errno = EINTR;
+            break;
+        }
+
+        const int wait_res = (deadline == NULL) ?
+            pthread_cond_wait(cond, &q->wait_mutex) :
+            pthread_cond_timedwait(cond, &q->wait_mutex, deadline);
+
+        if (wait_res == ETIMEDOUT) {
+            // one last attempt: the element could have arrived together with the timeout
+            if (op(q, arg) == 0) {
+                res = 0;
+            } else {
+                errno = ETIMEDOUT;
+            }
+            break;
+        }
+    }
+
+    atomic_fetch_sub_explicit(waiters, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&q->wait_mutex);
+
+    return res;
+}
+
+static int ring_push_op(queue_t* const q, void *arg) {
+    return ring_push(q, arg);
+}
+
+static int ring_pop_op(queue_t* const q, void *arg) {
+    return ring_pop(q, (void**)arg);
+}
+
+int queue_init(queue_t* const q, size_t max_elements) {
+    const size_t capacity = queue_capacity_for(max_elements);
+
+    q->mask = capacity - 1;
+    atomic_init(&q->head, 0);
+    atomic_init(&q->tail, 0);
+    atomic_init(&q->pop_waiters, 0);
+    atomic_init(&q->push_waiters, 0);
+    atomic_init(&q->wake_seq, 0);
+
+    q->slots = calloc(sizeof(queue_slot_t), capacity);
+    if (q->slots == NULL) {
         perror("calloc");
         return -1;
     }
 
-    sem_init(&q->empty, 0, q->array_size);
-    sem_init(&q->full, 0, 0);
+    for (size_t i = 0; i < capacity; ++i) {
+        atomic_init(&q->slots[i].seq, i);
+        q->slots[i].item = NULL;
+    }
+
+    if (pthread_mutex_init(&q->wait_mutex, NULL) != 0) {
+        perror("mutex");
+        goto queue_init_err;
+    }
+
+    // timeouts are computed on CLOCK_MONOTONIC so that wall-clock jumps do not affect them
+    pthread_condattr_t cond_attr;
+    pthread_condattr_init(&cond_attr);
+    pthread_condattr_setclock(&cond_attr, CLOCK_MONOTONIC);
+
+    const int not_empty_res = pthread_cond_init(&q->not_empty, &cond_attr);
+    const int not_full_res = pthread_cond_init(&q->not_full, &cond_attr);
+    pthread_condattr_destroy(&cond_attr);
+
+    if ((not_empty_res != 0) || (not_full_res != 0)) {
+        perror("cond");
+        pthread_mutex_destroy(&q->wait_mutex);
+        goto queue_init_err;
+    }
 
     return 0;
+
+queue_init_err:
+    free(q->slots);
+    q->slots = NULL;
+    return -1;
 }
 
 void queue_destroy(queue_t* q) {
-    free(q->array);
-    q->array = NULL;
+    pthread_cond_destroy(&q->not_full);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_mutex_destroy(&q->wait_mutex);
+
+    free(q->slots);
+    q->slots = NULL;
 }
 
 int queue_push(queue_t* const  q, void *in_item) {
-    sem_wait(&q->empty);
-    pthread_mutex_lock(&q->mutex);
-
-    q->rear = (q->rear + 1) % q->array_size;
-    q->array[q->rear] = in_item;
+    if (ring_push(q, in_item) != 0) {
+        queue_wait(q, ring_push_op, in_item, &q->push_waiters, &q->not_full, NULL, NULL);
+    }
 
-    pthread_mutex_unlock(&q->mutex);
-    sem_post(&q->full);
+    queue_wake(q, &q->pop_waiters, &q->not_empty);
 
     return 0;
 }
 
 int queue_pop(queue_t* const q, void **out_item) {
-    sem_wait(&q->full);
-    pthread_mutex_lock(&q->mutex);
+    if (ring_pop(q, out_item) != 0) {
+        queue_wait(q, ring_pop_op, (void*)out_item, &q->pop_waiters, &q->not_empty, NULL, NULL);
+    }
 
-    q->front = (q->front + 1) % q->array_size;
-    *out_item = q->array[q->front];
+    queue_wake(q, &q->push_waiters, &q->not_full);
 
-    pthread_mutex_unlock(&q->mutex);
-    sem_post(&q->empty);
-    
     return 0;
 }
 
 int queue_push_timeout(queue_t* const  q, void *in_item, int timeout_ms) {
-    struct timespec timeout;
-    if (clock_gettime(CLOCK_REALTIME, &timeout) == -1) {
-        // Handle clock_gettime error
-        return -1;
-    }
+    int result = ring_push(q, in_item);
 
-    timeout.tv_sec += timeout_ms / 1000;
-    timeout.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (result != 0) {
+        struct timespec deadline;
+        if (deadline_from_timeout(&deadline, timeout_ms) == -1) {
+            // Handle clock_gettime error
+            return -1;
+        }
 
-    int result = sem_timedwait(&q->empty, &timeout);
+        result = queue_wait(q, ring_push_op, in_item, &q->push_waiters, &q->not_full, &deadline, NULL);
+    }
 
     if (result == 0) {
-        pthread_mutex_lock(&q->mutex);
+        queue_wake(q, &q->pop_waiters, &q->not_empty);
+    }
+
+    return result;
+}
+
+int queue_pop_timeout(queue_t* const q, void **out_item, int timeout_ms) {
+    int result = ring_pop(q, out_item);
 
-        q->rear = (q->rear + 1) % q->array_size;
-        q->array[q->rear] = in_item;
+    if (result != 0) {
+        struct timespec deadline;
+        if (deadline_from_timeout(&deadline, timeout_ms) == -1) {
+            // Handle clock_gettime error
+            return -1;
+        }
 
-        pthread_mutex_unlock(&q->mutex);
-        sem_post(&q->full);
+        result = queue_wait(q, ring_pop_op, (void*)out_item, &q->pop_waiters, &q->not_empty, &deadline, NULL);
+    }
+
+    if (result == 0) {
+        queue_wake(q, &q->push_waiters, &q->not_full);
     }
 
     return result;
 }
 
-int queue_pop_timeout(queue_t* const q, void **out_item, int timeout_ms) {
-    struct timespec timeout;
-    if (clock_gettime(CLOCK_MONOTONIC, &timeout) == -1) {
-        // Handle clock_gettime error
-        return -1;
+size_t queue_depth(queue_t* const q) {
+    const size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    const size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+
+    // a pop racing with the two loads can make head overtake the tail read before it
+    return (tail > head) ? tail - head : 0;
+}
+
+unsigned queue_wake_seq(queue_t* const q) {
+    return atomic_load_explicit(&q->wake_seq, memory_order_acquire);
+}
+
+void queue_wake_consumers(queue_t* const q) {
+    atomic_fetch_add_explicit(&q->wake_seq, 1, memory_order_release);
+
+    // same handshake as a push: either the consumer sees the new sequence or we see the consumer
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&q->pop_waiters, memory_order_relaxed) == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&q->wait_mutex);
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->wait_mutex);
+}
+
+int queue_pop_wakeable(queue_t* const q, void **out_item, int timeout_ms, unsigned wake_seq) {
+    int result = ring_pop(q, out_item);
+
+    if (result != 0) {
+        if (atomic_load_explicit(&q->wake_seq, memory_order_acquire) != wake_seq) {
+            errno = EINTR;
+            return -1;
+        }
+
+        struct timespec deadline;
+        if (deadline_from_timeout(&deadline, timeout_ms) == -1) {
+            // Handle clock_gettime error
+            return -1;
+        }
+
+        result = queue_wait(q, ring_pop_op, (void*)out_item, &q->pop_waiters, &q->not_empty, &deadline, &wake_seq);
     }
 
-    timeout.tv_sec += timeout_ms / 1000;
-    timeout.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (result == 0) {
+        queue_wake(q, &q->push_waiters, &q->not_full);
+    }
 
-    int result = sem_timedwait(&q->full, &timeout);
+    return result;
+}
 
+int queue_try_push(queue_t* const q, void *in_item) {
+    const int result = ring_push(q, in_item);
     if (result == 0) {
-        pthread_mutex_lock(&q->mutex);
+        queue_wake(q, &q->pop_waiters, &q->not_empty);
+    }
 
-        q->front = (q->front + 1) % q->array_size;
-        *out_item = q->array[q->front];
+    return result;
+}
 
-        pthread_mutex_unlock(&q->mutex);
-        sem_post(&q->empty);
+int queue_try_pop(queue_t* const q, void **out_item) {
+    const int result = ring_pop(q, out_item);
+    if (result == 0) {
+        queue_wake(q, &q->push_waiters, &q->not_full);
     }
 
     return result;
-}
\ No newline at end of file
+}
@@ -2,15 +2,35 @@
 
 #include "rogue_enemy.h"
 
+#define QUEUE_CACHE_LINE_SIZE 64
+
+typedef struct queue_slot {
+    atomic_size_t seq;
+    void* item;
+} queue_slot_t;
+
+/**
+ * Bounded lock-free multi-producer ring (Vyukov-style, every slot carries a sequence number).
+ *
+ * Producers and consumers only touch the mutex/condvars when the ring is full or empty
+ * and somebody actually has to sleep: in the common case a push or a pop is a single CAS.
+ */
 typedef struct queue {
-    sem_t empty, full;
-    pthread_mutex_t mutex;
+    _Alignas(QUEUE_CACHE_LINE_SIZE) atomic_size_t head;
+    _Alignas(QUEUE_CACHE_LINE_SIZE) atomic_size_t tail;
+
+    _Alignas(QUEUE_CACHE_LINE_SIZE) size_t mask;
+    queue_slot_t* slots;
 
-    ssize_t front;
-    ssize_t rear;
+    // blocking-wait fallback
+    atomic_uint pop_waiters;
+    atomic_uint push_waiters;
 
-    size_t array_size;
-    void** array;
+    // bumped by queue_wake_consumers to interrupt queue_pop_wakeable
+    atomic_uint wake_seq;
+    pthread_mutex_t wait_mutex;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
 } queue_t;
 
 int queue_init(queue_t* queue, size_t max_elements);
@@ -24,3 +44,24 @@ int queue_push_timeout(queue_t* const  q, void *in_item, int timeout_ms);
 int queue_pop(queue_t* queue, void **out_item);
 
 int queue_pop_timeout(queue_t* const q, void **out_item, int timeout_ms);
+
+// non-blocking variants: return -1 immediately if the queue is full (push) or empty (pop)
+int queue_try_push(queue_t* const q, void *in_item);
+
+int queue_try_pop(queue_t* const q, void **out_item);
+
+/**
+ * Number of elements waiting: only a snapshot while producers or consumers are running.
+ */
+size_t queue_depth(queue_t* const q);
+
+/**
+ * Let the consumer wait on this queue and on another source at once: read the sequence with queue_wake_seq,
+ * check the other source, then call queue_pop_wakeable. Producers of the other source call
+ * queue_wake_consumers after publishing, which makes the pop return -1 with errno EINTR.
+ */
+unsigned queue_wake_seq(queue_t* const q);
+
+void queue_wake_consumers(queue_t* const q);
+
+int queue_pop_wakeable(queue_t* const q, void **out_item, int timeout_ms, unsigned wake_seq);
@@ -0,0 +1,108 @@
+#include "reactor.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+int reactor_init(reactor_t *const reactor) {
+    reactor->dispatched = 0;
+
+    reactor->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor->epoll_fd < 0) {
+        fprintf(stderr, "Unable to create the epoll instance: %d\n", errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+void reactor_destroy(reactor_t *const reactor) {
+    if (reactor->epoll_fd >= 0) {
+        close(reactor->epoll_fd);
+        reactor->epoll_fd = -1;
+    }
+}
+
+int reactor_add(reactor_t *const reactor, reactor_handler_t *const handler, uint32_t events) {
+    struct epoll_event ev = {
+        .events = events,
+        .data = {
+            .ptr = (void*)handler,
+        },
+    };
+
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_ADD, handler->fd, &ev) != 0) {
+        fprintf(stderr, "Unable to add fd %d to the reactor: %d\n", handler->fd, errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+int reactor_remove(reactor_t *const reactor, reactor_handler_t *const handler) {
+    if (epoll_ctl(reactor->epoll_fd, EPOLL_CTL_DEL, handler->fd, NULL) != 0) {
+        fprintf(stderr, "Unable to remove fd %d from the reactor: %d\n", handler->fd, errno);
+        return -errno;
+    }
+
+    return 0;
+}
+
+int reactor_run_once(reactor_t *const reactor, int timeout_ms) {
+    struct epoll_event events[REACTOR_MAX_EVENTS];
+
+    const int ready = epoll_wait(reactor->epoll_fd, events, REACTOR_MAX_EVENTS, timeout_ms);
+    if (ready < 0) {
+        return (errno == EINTR) ? 0 : -errno;
+    }
+
+    for (int i = 0; i < ready; ++i) {
+        reactor_handler_t *const handler = (reactor_handler_t*)events[i].data.ptr;
+
+        // a previous callback in this same batch may have closed this handler
+        if (handler->fd < 0) {
+            continue;
+        }
+
+        handler->callback(handler, events[i].events);
+    }
+
+    reactor->dispatched += (uint64_t)ready;
+
+    return ready;
+}
+
+int reactor_timer_create(int period_ms) {
+    const int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (timer_fd < 0) {
+        fprintf(stderr, "Unable to create a reactor timer: %d\n", errno);
+        return -errno;
+    }
+
+    const struct itimerspec spec = {
+        .it_value = {
+            .tv_sec = period_ms / 1000,
+            .tv_nsec = (long)(period_ms % 1000) * 1000000L,
+        },
+        .it_interval = {
+            .tv_sec = period_ms / 1000,
+            .tv_nsec = (long)(period_ms % 1000) * 1000000L,
+        },
+    };
+
+    if (timerfd_settime(timer_fd, 0, &spec, NULL) != 0) {
+        fprintf(stderr, "Unable to arm a reactor timer: %d\n", errno);
+        close(timer_fd);
+        return -errno;
+    }
+
+    return timer_fd;
+}
+
+void reactor_timer_ack(int timer_fd) {
+    uint64_t expirations;
+    if (read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+        if (errno != EAGAIN) {
+            fprintf(stderr, "Unable to read a reactor timer: %d\n", errno);
+        }
+    }
+}
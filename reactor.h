@@ -0,0 +1,55 @@
+#pragma once
+
+#include "rogue_enemy.h"
+
+#define REACTOR_MAX_EVENTS 16
+
+struct reactor_handler;
+
+typedef void (*reactor_callback_t)(struct reactor_handler *const handler, uint32_t events);
+
+/**
+ * A file descriptor registered in the reactor together with the callback run when it is ready.
+ *
+ * Handlers are owned by whoever registers them and must stay valid until they are removed.
+ */
+typedef struct reactor_handler {
+    int fd;
+    reactor_callback_t callback;
+    void *user_data;
+} reactor_handler_t;
+
+/**
+ * Single-threaded epoll loop: every registered fd is level-triggered and its callback
+ * runs on the thread calling reactor_run_once.
+ */
+typedef struct reactor {
+    int epoll_fd;
+
+    uint64_t dispatched;
+} reactor_t;
+
+int reactor_init(reactor_t *const reactor);
+
+void reactor_destroy(reactor_t *const reactor);
+
+int reactor_add(reactor_t *const reactor, reactor_handler_t *const handler, uint32_t events);
+
+int reactor_remove(reactor_t *const reactor, reactor_handler_t *const handler);
+
+/**
+ * Wait up to timeout_ms (-1 to wait forever) and dispatch every ready handler.
+ *
+ * Returns the number of callbacks run or a negative errno.
+ */
+int reactor_run_once(reactor_t *const reactor, int timeout_ms);
+
+/**
+ * Create a non-blocking CLOCK_MONOTONIC timerfd firing every period_ms, to be registered as a handler fd.
+ */
+int reactor_timer_create(int period_ms);
+
+/**
+ * Consume the expirations of a timerfd created with reactor_timer_create.
+ */
+void reactor_timer_ack(int timer_fd);
@@ -0,0 +1,381 @@
+#include "replay.h"
+#include "latency.h"
+#include "message_pool.h"
+#include "rt_profile.h"
+#include "trace.h"
+
+static int64_t timeval_to_us(const struct timeval *const tv) {
+    return (int64_t)tv->tv_sec * 1000000 + (int64_t)tv->tv_usec;
+}
+
+static struct timeval timeval_from_us(int64_t us) {
+    const struct timeval tv = {
+        .tv_sec = us / 1000000,
+        .tv_usec = us % 1000000,
+    };
+
+    return tv;
+}
+
+int replay_recorder_open(replay_recorder_t *const recorder, const char* path) {
+    recorder->records = 0;
+
+    recorder->file = fopen(path, "wb");
+    if (recorder->file == NULL) {
+        fprintf(stderr, "Unable to open the input log %s: %d\n", path, errno);
+        return -errno;
+    }
+
+    // the output thread writes here: keep write() calls rare
+    setvbuf(recorder->file, NULL, _IOFBF, 1 << 16);
+
+    replay_file_header_t header = {
+        .version = REPLAY_VERSION,
+        .reserved = 0,
+    };
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+
+    if (fwrite(&header, sizeof(header), 1, recorder->file) != 1) {
+        fprintf(stderr, "Unable to write the input log header\n");
+        fclose(recorder->file);
+        recorder->file = NULL;
+        return -EIO;
+    }
+
+    return 0;
+}
+
+void replay_recorder_close(replay_recorder_t *const recorder) {
+    if (recorder->file == NULL) {
+        return;
+    }
+
+    fclose(recorder->file);
+    recorder->file = NULL;
+
+    printf("Input log closed: %lu records\n", (unsigned long)recorder->records);
+}
+
+int replay_recorder_write(replay_recorder_t *const recorder, const message_t *const msg) {
+    if (recorder->file == NULL) {
+        return -EBADF;
+    }
+
+    replay_record_header_t header = {
+        .time_ns = (msg->ts.read_ns != 0) ? msg->ts.read_ns : latency_now_ns(),
+        .type = (uint8_t)msg->type,
+        .reserved = { 0, 0, 0 },
+        .size = 0,
+    };
+
+    int res = 0;
+    if (msg->type == MSG_TYPE_EV) {
+        const replay_ev_record_t ev_record = {
+            .ev_flags = msg->data.event.ev_flags,
+            .ev_count = msg->data.event.ev_count,
+        };
+
+        header.size = sizeof(ev_record) + ev_record.ev_count * sizeof(replay_ev_event_t);
+        if ((fwrite(&header, sizeof(header), 1, recorder->file) != 1) || (fwrite(&ev_record, sizeof(ev_record), 1, recorder->file) != 1)) {
+            res = -EIO;
+        }
+
+        for (uint32_t i = 0; (res == 0) && (i < ev_record.ev_count); ++i) {
+            const replay_ev_event_t ev = {
+                .time_us = timeval_to_us(&msg->data.event.ev[i].time),
+                .type = msg->data.event.ev[i].type,
+                .code = msg->data.event.ev[i].code,
+                .value = msg->data.event.ev[i].value,
+            };
+
+            if (fwrite(&ev, sizeof(ev), 1, recorder->file) != 1) {
+                res = -EIO;
+            }
+        }
+    } else if (msg->type == MSG_TYPE_IMU) {
+        const imu_message_t *const imu = &msg->data.imu;
+        replay_imu_record_t imu_record = {
+            .gyro_read_time_us = timeval_to_us(&imu->gyro_read_time),
+            .accel_read_time_us = timeval_to_us(&imu->accel_read_time),
+            .gyro_raw = { (int32_t)imu->gyro_x_raw, (int32_t)imu->gyro_y_raw, (int32_t)imu->gyro_z_raw },
+            .accel_raw = { (int32_t)imu->accel_x_raw, (int32_t)imu->accel_y_raw, (int32_t)imu->accel_z_raw },
+            .temp_in_k = imu->temp_in_k,
+            .temp_raw = imu->temp_raw,
+            .flags = imu->flags,
+        };
+        memcpy(imu_record.gyro_rad_s, imu->gyro_rad_s, sizeof(imu_record.gyro_rad_s));
+        memcpy(imu_record.accel_m2s, imu->accel_m2s, sizeof(imu_record.accel_m2s));
+        memcpy(imu_record.accel_sensor_m2s, imu->accel_sensor_m2s, sizeof(imu_record.accel_sensor_m2s));
+
+        header.size = sizeof(imu_record);
+        if ((fwrite(&header, sizeof(header), 1, recorder->file) != 1) || (fwrite(&imu_record, sizeof(imu_record), 1, recorder->file) != 1)) {
+            res = -EIO;
+        }
+    } else if (msg->type == MSG_TYPE_HIDRAW) {
+        const ssize_t data_size = msg->data.hidraw.data_size;
+        header.size = ((data_size > 0) && (data_size <= HIDRAW_DATA_SIZE)) ? (uint32_t)data_size : 0;
+        if ((fwrite(&header, sizeof(header), 1, recorder->file) != 1) || (fwrite(msg->data.hidraw.data, 1, header.size, recorder->file) != header.size)) {
+            res = -EIO;
+        }
+    } else {
+        return -EINVAL;
+    }
+
+    if (res != 0) {
+        fprintf(stderr, "Error writing the input log: recording stopped\n");
+        fclose(recorder->file);
+        recorder->file = NULL;
+        return res;
+    }
+
+    ++recorder->records;
+    return 0;
+}
+
+int replay_reader_open(replay_reader_t *const reader, const char* path) {
+    reader->payload = NULL;
+
+    reader->file = fopen(path, "rb");
+    if (reader->file == NULL) {
+        fprintf(stderr, "Unable to open the input log %s: %d\n", path, errno);
+        return -errno;
+    }
+
+    replay_file_header_t header;
+    if ((fread(&header, sizeof(header), 1, reader->file) != 1) || (memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0)) {
+        fprintf(stderr, "%s is not an input log\n", path);
+        goto replay_reader_open_err;
+    }
+
+    if (header.version != REPLAY_VERSION) {
+        fprintf(stderr, "Unsupported input log version %u (expected %d)\n", header.version, REPLAY_VERSION);
+        goto replay_reader_open_err;
+    }
+
+    reader->payload = malloc(REPLAY_MAX_RECORD_SIZE);
+    if (reader->payload == NULL) {
+        fprintf(stderr, "Unable to allocate the replay buffer\n");
+        goto replay_reader_open_err;
+    }
+
+    return 0;
+
+replay_reader_open_err:
+    fclose(reader->file);
+    reader->file = NULL;
+    return -EINVAL;
+}
+
+void replay_reader_close(replay_reader_t *const reader) {
+    if (reader->file != NULL) {
+        fclose(reader->file);
+        reader->file = NULL;
+    }
+
+    free(reader->payload);
+    reader->payload = NULL;
+}
+
+int replay_reader_next(replay_reader_t *const reader, message_t *const msg, uint64_t *const time_ns) {
+    replay_record_header_t header;
+    if (fread(&header, sizeof(header), 1, reader->file) != 1) {
+        return feof(reader->file) ? 1 : -EIO;
+    }
+
+    if ((header.size > REPLAY_MAX_RECORD_SIZE) || (fread(reader->payload, 1, header.size, reader->file) != header.size)) {
+        fprintf(stderr, "Truncated or corrupted input log record\n");
+        return -EINVAL;
+    }
+
+    *time_ns = header.time_ns;
+    msg->type = (message_type_t)header.type;
+
+    if (header.type == MSG_TYPE_EV) {
+        replay_ev_record_t ev_record;
+        if (header.size < sizeof(ev_record)) {
+            return -EINVAL;
+        }
+        memcpy(&ev_record, reader->payload, sizeof(ev_record));
+
+        if (header.size != sizeof(ev_record) + ev_record.ev_count * sizeof(replay_ev_event_t)) {
+            return -EINVAL;
+        }
+
+        if (msg->data.event.ev_size < ev_record.ev_count) {
+            struct input_event *const new_buf = realloc(msg->data.event.ev, sizeof(struct input_event) * ev_record.ev_count);
+            if (new_buf == NULL) {
+                return -ENOMEM;
+            }
+
+            msg->data.event.ev = new_buf;
+            msg->data.event.ev_size = ev_record.ev_count;
+        }
+
+        msg->data.event.ev_flags = ev_record.ev_flags;
+        msg->data.event.ev_count = ev_record.ev_count;
+
+        for (uint32_t i = 0; i < ev_record.ev_count; ++i) {
+            replay_ev_event_t ev;
+            memcpy(&ev, &reader->payload[sizeof(ev_record) + i * sizeof(ev)], sizeof(ev));
+
+            msg->data.event.ev[i].time = timeval_from_us(ev.time_us);
+            msg->data.event.ev[i].type = ev.type;
+            msg->data.event.ev[i].code = ev.code;
+            msg->data.event.ev[i].value = ev.value;
+        }
+    } else if (header.type == MSG_TYPE_IMU) {
+        replay_imu_record_t imu_record;
+        if (header.size != sizeof(imu_record)) {
+            return -EINVAL;
+        }
+        memcpy(&imu_record, reader->payload, sizeof(imu_record));
+
+        imu_message_t *const imu = &msg->data.imu;
+        imu->gyro_read_time = timeval_from_us(imu_record.gyro_read_time_us);
+        imu->accel_read_time = timeval_from_us(imu_record.accel_read_time_us);
+        imu->gyro_x_raw = imu_record.gyro_raw[0];
+        imu->gyro_y_raw = imu_record.gyro_raw[1];
+        imu->gyro_z_raw = imu_record.gyro_raw[2];
+        imu->accel_x_raw = imu_record.accel_raw[0];
+        imu->accel_y_raw = imu_record.accel_raw[1];
+        imu->accel_z_raw = imu_record.accel_raw[2];
+        memcpy(imu->gyro_rad_s, imu_record.gyro_rad_s, sizeof(imu->gyro_rad_s));
+        memcpy(imu->accel_m2s, imu_record.accel_m2s, sizeof(imu->accel_m2s));
+        memcpy(imu->accel_sensor_m2s, imu_record.accel_sensor_m2s, sizeof(imu->accel_sensor_m2s));
+        imu->temp_in_k = imu_record.temp_in_k;
+        imu->temp_raw = imu_record.temp_raw;
+        imu->flags = imu_record.flags;
+    } else if (header.type == MSG_TYPE_HIDRAW) {
+        if (header.size > HIDRAW_DATA_SIZE) {
+            return -EINVAL;
+        }
+
+        memcpy(msg->data.hidraw.data, reader->payload, header.size);
+        msg->data.hidraw.data_size = header.size;
+    } else {
+        fprintf(stderr, "Unknown input log record type %u\n", (unsigned)header.type);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static void sleep_until_ns(uint64_t deadline_ns) {
+    const struct timespec deadline = {
+        .tv_sec = (time_t)(deadline_ns / 1000000000ULL),
+        .tv_nsec = (long)(deadline_ns % 1000000000ULL),
+    };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+        // interrupted by a signal: keep waiting for the same deadline
+    }
+}
+
+void *replay_thread_func(void *ptr) {
+    replay_t *const replay = (replay_t*)ptr;
+
+    // the replay stands in for the device readers: same profile, so timings are comparable
+    rt_thread_setup(&replay->logic->controller_settings, RT_ROLE_INPUT);
+    trace_register_thread("replay");
+
+    replay_reader_t reader;
+    if (replay_reader_open(&reader, replay->path) != 0) {
+        logic_request_termination(replay->logic);
+        return NULL;
+    }
+
+    // evdev buffers are kept aside: a record of another type overwrites the union of a reused message
+    message_pool_t pool;
+    ev_message_t *const ev_buffers = calloc(REPLAY_MESSAGES_IN_FLIGHT, sizeof(ev_message_t));
+    if (ev_buffers == NULL) {
+        fprintf(stderr, "Unable to allocate replay buffers\n");
+        goto replay_thread_func_buffers_err;
+    }
+
+    if (message_pool_init(&pool, REPLAY_MESSAGES_IN_FLIGHT) != 0) {
+        goto replay_thread_func_pool_err;
+    }
+
+    printf("Replaying %s at %s speed\n", replay->path, replay->max_speed ? "maximum" : "original");
+
+    uint64_t first_time_ns = 0;
+    uint64_t start_ns = 0;
+    uint64_t replayed = 0;
+
+    while (!logic_termination_requested(replay->logic)) {
+        // wait for the output thread to hand a message back
+        message_t *const msg = message_pool_acquire_timeout(&pool, 100);
+        if (msg == NULL) {
+            continue;
+        }
+
+        const size_t h = (size_t)(msg - pool.messages);
+        msg->data.event = ev_buffers[h];
+
+        uint64_t time_ns;
+        const int next_res = replay_reader_next(&reader, msg, &time_ns);
+        if ((msg->type == MSG_TYPE_EV) && (msg->data.event.ev_size > ev_buffers[h].ev_size)) {
+            ev_buffers[h] = msg->data.event;
+        }
+
+        if (next_res != 0) {
+            if (next_res < 0) {
+                fprintf(stderr, "Replay stopped: %d\n", next_res);
+            }
+
+            message_pool_release(msg);
+            break;
+        }
+
+        if (replayed == 0) {
+            first_time_ns = time_ns;
+            start_ns = latency_now_ns();
+        } else if ((!replay->max_speed) && (time_ns > first_time_ns)) {
+            sleep_until_ns(start_ns + (time_ns - first_time_ns));
+        }
+
+        msg->ts.read_ns = latency_now_ns();
+        msg->ts.enqueue_ns = msg->ts.read_ns;
+        msg->ts.dequeue_ns = 0;
+        msg->ts.apply_ns = 0;
+        msg->flags = 0x00000000U;
+
+        if (msg->type == MSG_TYPE_IMU) {
+            logic_post_imu(replay->logic, msg);
+        } else if (queue_push(&replay->logic->input_queue, (void*)msg) != 0) {
+            fprintf(stderr, "Error pushing replayed message.\n");
+            message_pool_release(msg);
+        }
+
+        ++replayed;
+    }
+
+    const uint64_t elapsed_ns = (replayed > 0) ? latency_now_ns() - start_ns : 0;
+    printf("Replayed %lu messages in %.3f ms\n", (unsigned long)replayed, (double)elapsed_ns / 1000000.0);
+
+    // the output thread has to hand back every message before they are freed
+    int quiesce_res;
+    do {
+        quiesce_res = message_pool_quiesce(&pool, 100);
+    } while ((quiesce_res != 0) && (!logic_termination_requested(replay->logic)));
+
+    if (quiesce_res != 0) {
+        // the output thread is gone with messages still queued: leave their memory alone
+        goto replay_thread_func_end;
+    }
+
+    message_pool_destroy(&pool);
+
+replay_thread_func_pool_err:
+    for (int h = 0; h < REPLAY_MESSAGES_IN_FLIGHT; ++h) {
+        free(ev_buffers[h].ev);
+    }
+    free(ev_buffers);
+
+replay_thread_func_buffers_err:
+replay_thread_func_end:
+    replay_reader_close(&reader);
+    logic_request_termination(replay->logic);
+
+    return NULL;
+}
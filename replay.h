@@ -0,0 +1,102 @@
+#pragma once
+
+#include "rogue_enemy.h"
+#include "message.h"
+#include "queue.h"
+#include "logic.h"
+
+/*
+ * Input log: a replay_file_header_t followed by records, each one a replay_record_header_t and its payload:
+ *
+ *   MSG_TYPE_EV      replay_ev_record_t + ev_count * replay_ev_event_t
+ *   MSG_TYPE_IMU     replay_imu_record_t
+ *   MSG_TYPE_HIDRAW  the raw hidraw report (size bytes)
+ *
+ * Every field is little-endian as written by the (x86/arm64) host, the log is not meant to be portable further.
+ */
+#define REPLAY_MAGIC                "RGENLOG"
+#define REPLAY_VERSION              2
+#define REPLAY_MAX_RECORD_SIZE      65536
+#define REPLAY_MESSAGES_IN_FLIGHT   32
+
+typedef struct __attribute__((packed)) replay_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+} replay_file_header_t;
+
+typedef struct __attribute__((packed)) replay_record_header {
+    uint64_t time_ns; // CLOCK_MONOTONIC read time of the message
+    uint8_t type;
+    uint8_t reserved[3];
+    uint32_t size;
+} replay_record_header_t;
+
+typedef struct __attribute__((packed)) replay_ev_record {
+    uint32_t ev_flags;
+    uint32_t ev_count;
+} replay_ev_record_t;
+
+typedef struct __attribute__((packed)) replay_ev_event {
+    int64_t time_us;
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+} replay_ev_event_t;
+
+typedef struct __attribute__((packed)) replay_imu_record {
+    int64_t gyro_read_time_us;
+    int64_t accel_read_time_us;
+    int32_t gyro_raw[3];
+    int32_t accel_raw[3];
+    double gyro_rad_s[3];
+    double accel_m2s[3];
+    double accel_sensor_m2s[3];
+    double temp_in_k;
+    int16_t temp_raw;
+    uint32_t flags;
+} replay_imu_record_t;
+
+typedef struct replay_recorder {
+    FILE* file;
+    uint64_t records;
+} replay_recorder_t;
+
+typedef struct replay_reader {
+    FILE* file;
+    uint8_t* payload;
+} replay_reader_t;
+
+/**
+ * Arguments of replay_thread_func.
+ */
+typedef struct replay {
+    const char* path;
+
+    // 0 to reproduce the original timing, 1 to push messages as fast as the output thread takes them
+    int max_speed;
+
+    logic_t* logic;
+} replay_t;
+
+int replay_recorder_open(replay_recorder_t *const recorder, const char* path);
+
+void replay_recorder_close(replay_recorder_t *const recorder);
+
+int replay_recorder_write(replay_recorder_t *const recorder, const message_t *const msg);
+
+int replay_reader_open(replay_reader_t *const reader, const char* path);
+
+void replay_reader_close(replay_reader_t *const reader);
+
+/**
+ * Decode the next record into msg (whose evdev buffer is grown if needed).
+ *
+ * Returns 0 on success, 1 at the end of the log or a negative errno on a malformed log.
+ */
+int replay_reader_next(replay_reader_t *const reader, message_t *const msg, uint64_t *const time_ns);
+
+/**
+ * Feed the log in replay->path to the input queue in place of the input devices, then request termination.
+ */
+void *replay_thread_func(void *ptr);
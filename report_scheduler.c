@@ -0,0 +1,118 @@
+#include "report_scheduler.h"
+#include "ring_log.h"
+
+#include <poll.h>
+#include <sys/timerfd.h>
+
+static int report_scheduler_arm(report_scheduler_t *const sched, uint64_t period_ns) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    // first deadline is one period from now, every following one is a multiple of the period from that
+    const uint64_t first_ns = (uint64_t)now.tv_nsec + period_ns;
+    const struct itimerspec spec = {
+        .it_value = {
+            .tv_sec = now.tv_sec + (time_t)(first_ns / 1000000000ULL),
+            .tv_nsec = (long)(first_ns % 1000000000ULL),
+        },
+        .it_interval = {
+            .tv_sec = (time_t)(period_ns / 1000000000ULL),
+            .tv_nsec = (long)(period_ns % 1000000000ULL),
+        },
+    };
+
+    if (timerfd_settime(sched->timer_fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0) {
+        return -errno;
+    }
+
+    return 0;
+}
+
+int report_scheduler_init(report_scheduler_t *const sched, unsigned int rate_hz) {
+    sched->timer_fd = -1;
+    sched->ticks = 0;
+    sched->missed_deadlines = 0;
+    sched->idle = 0;
+
+    if ((rate_hz != REPORT_RATE_250_HZ) && (rate_hz != REPORT_RATE_500_HZ) && (rate_hz != REPORT_RATE_1000_HZ)) {
+        fprintf(stderr, "Unsupported report rate %u Hz: using %d Hz\n", rate_hz, REPORT_RATE_1000_HZ);
+        rate_hz = REPORT_RATE_1000_HZ;
+    }
+
+    sched->rate_hz = rate_hz;
+    sched->period_ns = 1000000000ULL / (uint64_t)rate_hz;
+
+    sched->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (sched->timer_fd < 0) {
+        fprintf(stderr, "Unable to create the report timer: %d\n", errno);
+        return -errno;
+    }
+
+    const int arm_res = report_scheduler_arm(sched, sched->period_ns);
+    if (arm_res != 0) {
+        fprintf(stderr, "Unable to arm the report timer: %d\n", arm_res);
+        close(sched->timer_fd);
+        sched->timer_fd = -1;
+        return arm_res;
+    }
+
+    return 0;
+}
+
+void report_scheduler_destroy(report_scheduler_t *const sched) {
+    if (sched->timer_fd >= 0) {
+        close(sched->timer_fd);
+        sched->timer_fd = -1;
+    }
+}
+
+int report_scheduler_get_fd(const report_scheduler_t *const sched) {
+    return sched->timer_fd;
+}
+
+int report_scheduler_set_idle(report_scheduler_t *const sched, int idle) {
+    idle = idle != 0;
+    if (sched->idle == idle) {
+        return 0;
+    }
+
+    const int arm_res = report_scheduler_arm(sched, idle ? (1000000000ULL / REPORT_KEEPALIVE_HZ) : sched->period_ns);
+    if (arm_res != 0) {
+        RING_LOG(RING_LOG_ERROR, "Unable to re-arm the report timer: %d\n", arm_res);
+        return arm_res;
+    }
+
+    // a tick of the previous period that is still pending is simply consumed by the next ack
+    sched->idle = idle;
+
+    return 0;
+}
+
+int report_scheduler_ack(report_scheduler_t *const sched) {
+    uint64_t expirations = 0;
+
+    for (;;) {
+        const ssize_t read_res = read(sched->timer_fd, &expirations, sizeof(expirations));
+        if (read_res == sizeof(expirations)) {
+            break;
+        } else if ((read_res < 0) && (errno == EAGAIN)) {
+            // not expired yet: wait for it
+            struct pollfd pfd = {
+                .fd = sched->timer_fd,
+                .events = POLLIN,
+            };
+            poll(&pfd, 1, -1);
+        } else if ((read_res < 0) && (errno == EINTR)) {
+            continue;
+        } else {
+            return (read_res < 0) ? -errno : -EIO;
+        }
+    }
+
+    ++sched->ticks;
+
+    const int missed = (int)(expirations - 1);
+    sched->missed_deadlines += missed;
+
+    return missed;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "rogue_enemy.h"
+
+#define REPORT_RATE_250_HZ      250
+#define REPORT_RATE_500_HZ      500
+#define REPORT_RATE_1000_HZ     1000
+
+// with report_on_change an unchanged report is still re-sent at this rate
+#define REPORT_KEEPALIVE_HZ     10
+
+/**
+ * Paces the virtual controllers' HID reports on a CLOCK_MONOTONIC timerfd armed with an absolute
+ * first deadline and a fixed period: the kernel keeps the cadence, so it does not drift with the
+ * time spent encoding and writing each report.
+ */
+typedef struct report_scheduler {
+    int timer_fd;
+
+    unsigned int rate_hz;
+    uint64_t period_ns;
+
+    // armed at REPORT_KEEPALIVE_HZ instead of rate_hz: see report_scheduler_set_idle
+    int idle;
+
+    uint64_t ticks;
+    uint64_t missed_deadlines;
+} report_scheduler_t;
+
+int report_scheduler_init(report_scheduler_t *const sched, unsigned int rate_hz);
+
+void report_scheduler_destroy(report_scheduler_t *const sched);
+
+int report_scheduler_get_fd(const report_scheduler_t *const sched);
+
+/**
+ * Re-arm the timer at REPORT_KEEPALIVE_HZ while the reports are not changing (idle) and back at the full rate
+ * when they do: a change-driven reporter then does not wake up at the full rate only to skip the write.
+ */
+int report_scheduler_set_idle(report_scheduler_t *const sched, int idle);
+
+/**
+ * Consume the pending expirations once the timer fd is readable (or block until it is).
+ *
+ * Returns the number of deadlines missed since the previous call, or a negative errno.
+ */
+int report_scheduler_ack(report_scheduler_t *const sched);
@@ -0,0 +1,276 @@
+#include "ring_log.h"
+
+#include <stdarg.h>
+
+// the longest line written out: priority prefix, message and the suppressed note
+#define RING_LOG_LINE_MAX   (RING_LOG_MESSAGE_MAX + 64)
+
+typedef struct ring_log_slot {
+    // Vyukov bounded queue: the slot is free for position p when seq == p and filled when seq == p + 1
+    atomic_size_t seq;
+
+    ring_log_level_t level;
+    uint32_t suppressed;
+    char text[RING_LOG_MESSAGE_MAX];
+} ring_log_slot_t;
+
+atomic_int ring_log_min_level = RING_LOG_INFO;
+
+static ring_log_slot_t slots[RING_LOG_SLOTS];
+static atomic_size_t enqueue_pos = 0;
+static size_t dequeue_pos = 0; // flusher thread only
+
+static atomic_uint_fast64_t dropped = 0;
+
+static atomic_int running = 0;
+// writers between their check of running and the publication of their slot: ring_log_stop waits for them
+static atomic_int in_flight = 0;
+static atomic_int stop_requested = 0;
+static pthread_t flusher_thread;
+
+// stderr is connected to journald: a "<N>" prefix sets the priority of each line
+static int journal = 0;
+
+static const char *const journal_prefixes[] = {
+    [RING_LOG_DEBUG] = "<7>",
+    [RING_LOG_INFO] = "<6>",
+    [RING_LOG_WARN] = "<4>",
+    [RING_LOG_ERROR] = "<3>",
+};
+
+void ring_log_set_level(ring_log_level_t level) {
+    atomic_store_explicit(&ring_log_min_level, (int)level, memory_order_relaxed);
+}
+
+static uint64_t coarse_now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+/**
+ * Returns 1 if the call site is within its budget, with the number of messages suppressed since the last one it logged.
+ */
+static int site_admit(ring_log_site_t *const site, uint32_t *const suppressed) {
+    const uint64_t now_ns = coarse_now_ns();
+
+    uint_fast64_t window_start_ns = atomic_load_explicit(&site->window_start_ns, memory_order_relaxed);
+    if ((now_ns - window_start_ns) >= RING_LOG_SITE_WINDOW_NS) {
+        // only one of the threads racing here opens the new window
+        if (atomic_compare_exchange_strong_explicit(&site->window_start_ns, &window_start_ns, now_ns, memory_order_relaxed, memory_order_relaxed)) {
+            atomic_store_explicit(&site->count, 0, memory_order_relaxed);
+        }
+    }
+
+    if (atomic_fetch_add_explicit(&site->count, 1, memory_order_relaxed) >= RING_LOG_SITE_BURST) {
+        atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+        return 0;
+    }
+
+    *suppressed = (uint32_t)atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+    return 1;
+}
+
+static ring_log_slot_t* slot_reserve(size_t *const pos_out) {
+    size_t pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+    for (;;) {
+        ring_log_slot_t *const slot = &slots[pos & (RING_LOG_SLOTS - 1)];
+        const size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+        const intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&enqueue_pos, &pos, pos + 1, memory_order_relaxed, memory_order_relaxed)) {
+                *pos_out = pos;
+                return slot;
+            }
+        } else if (diff < 0) {
+            // the flusher has not freed this slot yet: the ring is full
+            return NULL;
+        } else {
+            pos = atomic_load_explicit(&enqueue_pos, memory_order_relaxed);
+        }
+    }
+}
+
+void ring_log_write(ring_log_site_t *const site, ring_log_level_t level, const char *fmt, ...) {
+    uint32_t suppressed = 0;
+    if (!site_admit(site, &suppressed)) {
+        return;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+
+    // seq_cst pairs with ring_log_stop: either this sees running cleared or stop sees this writer in flight
+    atomic_fetch_add_explicit(&in_flight, 1, memory_order_seq_cst);
+    if (!atomic_load_explicit(&running, memory_order_seq_cst)) {
+        atomic_fetch_sub_explicit(&in_flight, 1, memory_order_release);
+        vfprintf(stderr, fmt, args);
+        if (suppressed > 0) {
+            fprintf(stderr, "(%u similar messages suppressed)\n", (unsigned)suppressed);
+        }
+        va_end(args);
+        return;
+    }
+
+    size_t pos;
+    ring_log_slot_t *const slot = slot_reserve(&pos);
+    if (slot == NULL) {
+        atomic_fetch_add_explicit(&dropped, 1 + suppressed, memory_order_relaxed);
+        atomic_fetch_sub_explicit(&in_flight, 1, memory_order_release);
+        va_end(args);
+        return;
+    }
+
+    vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+    va_end(args);
+
+    slot->level = level;
+    slot->suppressed = suppressed;
+
+    atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+    atomic_fetch_sub_explicit(&in_flight, 1, memory_order_release);
+}
+
+static void write_all(const char *buf, size_t len) {
+    while (len > 0) {
+        const ssize_t written = write(STDERR_FILENO, buf, len);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            // nowhere left to report it
+            return;
+        }
+
+        buf += written;
+        len -= (size_t)written;
+    }
+}
+
+static size_t format_line(char *const out, size_t size, ring_log_level_t level, const char *text, uint32_t suppressed) {
+    // every line gets exactly one newline, whatever the message ended with
+    int text_len = (int)strnlen(text, RING_LOG_MESSAGE_MAX);
+    while ((text_len > 0) && (text[text_len - 1] == '\n')) {
+        --text_len;
+    }
+
+    int len;
+    if (suppressed > 0) {
+        len = snprintf(out, size, "%s%.*s (%u similar messages suppressed)\n", journal ? journal_prefixes[level] : "", text_len, text, (unsigned)suppressed);
+    } else {
+        len = snprintf(out, size, "%s%.*s\n", journal ? journal_prefixes[level] : "", text_len, text);
+    }
+
+    if (len < 0) {
+        return 0;
+    }
+
+    return ((size_t)len < size) ? (size_t)len : size - 1;
+}
+
+static void drain(void) {
+    char out[8192];
+    size_t len = 0;
+
+    for (;;) {
+        ring_log_slot_t *const slot = &slots[dequeue_pos & (RING_LOG_SLOTS - 1)];
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != dequeue_pos + 1) {
+            break;
+        }
+
+        if ((sizeof(out) - len) < RING_LOG_LINE_MAX) {
+            write_all(out, len);
+            len = 0;
+        }
+
+        len += format_line(&out[len], sizeof(out) - len, slot->level, slot->text, slot->suppressed);
+
+        // hand the slot back to the producers one lap later
+        atomic_store_explicit(&slot->seq, dequeue_pos + RING_LOG_SLOTS, memory_order_release);
+        ++dequeue_pos;
+    }
+
+    const uint_fast64_t lost = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+    if (lost > 0) {
+        if ((sizeof(out) - len) < RING_LOG_LINE_MAX) {
+            write_all(out, len);
+            len = 0;
+        }
+
+        char note[96];
+        snprintf(note, sizeof(note), "%lu log messages dropped: the log ring was full", (unsigned long)lost);
+        len += format_line(&out[len], sizeof(out) - len, RING_LOG_WARN, note, 0);
+    }
+
+    write_all(out, len);
+}
+
+static void* flusher_thread_func(void* ptr) {
+    while (!atomic_load_explicit(&stop_requested, memory_order_acquire)) {
+        drain();
+        usleep(RING_LOG_FLUSH_INTERVAL_US);
+    }
+
+    drain();
+
+    return NULL;
+}
+
+// JOURNAL_STREAM holds the device and inode of the stream systemd connected to journald
+static int stderr_is_journal(void) {
+    const char *const journal_stream = getenv("JOURNAL_STREAM");
+    if (journal_stream == NULL) {
+        return 0;
+    }
+
+    unsigned long dev, ino;
+    if (sscanf(journal_stream, "%lu:%lu", &dev, &ino) != 2) {
+        return 0;
+    }
+
+    struct stat st;
+    if (fstat(STDERR_FILENO, &st) != 0) {
+        return 0;
+    }
+
+    return ((unsigned long)st.st_dev == dev) && ((unsigned long)st.st_ino == ino);
+}
+
+int ring_log_start(void) {
+    for (size_t i = 0; i < RING_LOG_SLOTS; ++i) {
+        atomic_init(&slots[i].seq, i);
+    }
+    atomic_store_explicit(&enqueue_pos, 0, memory_order_relaxed);
+    dequeue_pos = 0;
+
+    journal = stderr_is_journal();
+
+    atomic_store_explicit(&stop_requested, 0, memory_order_relaxed);
+    const int flusher_thread_creation = pthread_create(&flusher_thread, NULL, flusher_thread_func, NULL);
+    if (flusher_thread_creation != 0) {
+        fprintf(stderr, "Unable to start the log flusher thread: %d -- logging to stderr directly\n", flusher_thread_creation);
+        return -flusher_thread_creation;
+    }
+
+    atomic_store_explicit(&running, 1, memory_order_release);
+
+    return 0;
+}
+
+void ring_log_stop(void) {
+    if (!atomic_exchange_explicit(&running, 0, memory_order_seq_cst)) {
+        return;
+    }
+
+    atomic_store_explicit(&stop_requested, 1, memory_order_release);
+    pthread_join(flusher_thread, NULL);
+
+    // a writer that saw running set may still be formatting its message: wait for it, then flush what is left
+    while (atomic_load_explicit(&in_flight, memory_order_acquire) > 0) {
+        sched_yield();
+    }
+
+    drain();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "rogue_enemy.h"
+
+/*
+ * Bounded in-memory log ring written by any thread without locks and without ever blocking:
+ * messages are formatted by the caller into a free slot and written out by a background flusher
+ * thread. When the ring is full the message is dropped and counted instead.
+ *
+ * Before ring_log_start (and after ring_log_stop) messages go straight to stderr.
+ */
+#define RING_LOG_SLOTS              256     // must be a power of two
+#define RING_LOG_MESSAGE_MAX        256
+
+// every call site logs at most RING_LOG_SITE_BURST messages per RING_LOG_SITE_WINDOW_NS, the rest is counted
+#define RING_LOG_SITE_BURST         10
+#define RING_LOG_SITE_WINDOW_NS     1000000000ULL
+
+#define RING_LOG_FLUSH_INTERVAL_US  20000
+
+typedef enum ring_log_level {
+    RING_LOG_DEBUG = 0,
+    RING_LOG_INFO,
+    RING_LOG_WARN,
+    RING_LOG_ERROR,
+} ring_log_level_t;
+
+// rate limiting state of a single RING_LOG call site
+typedef struct ring_log_site {
+    atomic_uint_fast64_t window_start_ns;
+    atomic_uint_fast32_t count;
+    atomic_uint_fast32_t suppressed;
+} ring_log_site_t;
+
+extern atomic_int ring_log_min_level;
+
+void ring_log_set_level(ring_log_level_t level);
+
+static inline int ring_log_enabled(ring_log_level_t level) {
+    return (int)level >= atomic_load_explicit(&ring_log_min_level, memory_order_relaxed);
+}
+
+/**
+ * Format a message into the ring: use RING_LOG instead, that also skips the formatting of disabled levels.
+ */
+void ring_log_write(ring_log_site_t *const site, ring_log_level_t level, const char *fmt, ...) __attribute__((format(printf, 3, 4)));
+
+#define RING_LOG(level, ...) \
+    do { \
+        static ring_log_site_t ring_log_site_; \
+        if (ring_log_enabled(level)) { \
+            ring_log_write(&ring_log_site_, (level), __VA_ARGS__); \
+        } \
+    } while (0)
+
+/**
+ * Start the flusher thread: messages are written to stderr with a syslog priority prefix when stderr is
+ * connected to journald.
+ */
+int ring_log_start(void);
+
+/**
+ * Write out whatever is left in the ring and stop the flusher thread.
+ */
+void ring_log_stop(void);
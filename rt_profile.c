@@ -0,0 +1,132 @@
+#define _GNU_SOURCE
+
+#include "rt_profile.h"
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+static const char *const rt_role_names[] = {
+    [RT_ROLE_INPUT] = "input",
+    [RT_ROLE_OUTPUT] = "output",
+    [RT_ROLE_REPORT] = "report",
+    [RT_ROLE_BACKGROUND] = "background",
+};
+
+// report a missing privilege once, not once per thread
+static atomic_int rt_fifo_denied_reported = 0;
+
+void rt_process_setup(const controller_settings_t *const settings) {
+    if ((!settings->rt_profile) || (!settings->rt_mlockall)) {
+        return;
+    }
+
+    // page faults on the input path are exactly the kind of stall the profile is meant to avoid
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        fprintf(stderr, "rt: mlockall failed: %d (check RLIMIT_MEMLOCK) -- memory will not be locked\n", errno);
+    }
+}
+
+static void rt_thread_set_affinity(uint64_t cpus, rt_role_t role) {
+    if (cpus == 0) {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; cpu < 64; ++cpu) {
+        if ((cpus & ((uint64_t)1 << cpu)) != 0) {
+            CPU_SET(cpu, &set);
+        }
+    }
+
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        fprintf(stderr, "rt: unable to pin %s thread to cpus 0x%" PRIx64 ": %d\n", rt_role_names[role], cpus, errno);
+    }
+}
+
+static void rt_thread_set_priority(int priority, rt_role_t role) {
+    if (priority <= 0) {
+        return;
+    }
+
+    const int min_priority = sched_get_priority_min(SCHED_FIFO);
+    const int max_priority = sched_get_priority_max(SCHED_FIFO);
+
+    struct sched_param param = {
+        .sched_priority = (priority < min_priority) ? min_priority : ((priority > max_priority) ? max_priority : priority),
+    };
+
+    const int sched_res = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+    if (sched_res == 0) {
+        return;
+    }
+
+    if (atomic_exchange(&rt_fifo_denied_reported, 1) == 0) {
+        fprintf(stderr, "rt: SCHED_FIFO denied (%d): grant CAP_SYS_NICE or raise RLIMIT_RTPRIO -- falling back to nice %d\n", sched_res, RT_FALLBACK_NICE);
+    }
+
+    // setpriority on a thread id only affects that thread
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), RT_FALLBACK_NICE) != 0) {
+        fprintf(stderr, "rt: unable to renice %s thread: %d -- using the default scheduling\n", rt_role_names[role], errno);
+    }
+}
+
+static void rt_thread_set_background(rt_role_t role) {
+    const struct sched_param param = {
+        .sched_priority = 0,
+    };
+
+    const int sched_res = pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    if (sched_res != 0) {
+        fprintf(stderr, "rt: unable to leave the real-time policy in %s thread: %d\n", rt_role_names[role], sched_res);
+    }
+
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), RT_BACKGROUND_NICE) != 0) {
+        fprintf(stderr, "rt: unable to renice %s thread: %d\n", rt_role_names[role], errno);
+    }
+
+    // 0 restores the default slack
+    prctl(PR_SET_TIMERSLACK, 0UL, 0, 0, 0);
+}
+
+void rt_thread_setup(const controller_settings_t *const settings, rt_role_t role) {
+    // the creating thread may be real-time even with the profile disabled (i.e. started by chrt)
+    if (role == RT_ROLE_BACKGROUND) {
+        rt_thread_set_background(role);
+        return;
+    }
+
+    if (!settings->rt_profile) {
+        return;
+    }
+
+    // the default 50us slack delays every timed wakeup (report timers, poll timeouts)
+    if (settings->rt_timer_slack_ns > 0) {
+        if (prctl(PR_SET_TIMERSLACK, (unsigned long)settings->rt_timer_slack_ns, 0, 0, 0) != 0) {
+            fprintf(stderr, "rt: unable to set the timer slack of %s thread: %d\n", rt_role_names[role], errno);
+        }
+    }
+
+    switch (role) {
+        case RT_ROLE_INPUT:
+            rt_thread_set_affinity(settings->rt_input_cpus, role);
+            rt_thread_set_priority(settings->rt_input_priority, role);
+            break;
+
+        case RT_ROLE_OUTPUT:
+            rt_thread_set_affinity(settings->rt_output_cpus, role);
+            rt_thread_set_priority(settings->rt_output_priority, role);
+            break;
+
+        case RT_ROLE_REPORT:
+            rt_thread_set_affinity(settings->rt_report_cpus, role);
+            rt_thread_set_priority(settings->rt_report_priority, role);
+            break;
+
+        case RT_ROLE_BACKGROUND:
+            break;
+    }
+}
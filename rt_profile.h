@@ -0,0 +1,32 @@
+#pragma once
+
+#include "settings.h"
+
+// nice value tried when SCHED_FIFO is not allowed (no CAP_SYS_NICE and RLIMIT_RTPRIO is 0)
+#define RT_FALLBACK_NICE -10
+
+// nice value of RT_ROLE_BACKGROUND threads
+#define RT_BACKGROUND_NICE 19
+
+typedef enum rt_role {
+    RT_ROLE_INPUT = 0,  // device readers: short bursts right after the hardware produced data
+    RT_ROLE_OUTPUT,     // decoding and evdev output (output_dev)
+    RT_ROLE_REPORT,     // virtual DualShock/DualSense report emitters
+    RT_ROLE_BACKGROUND, // slow or blocking work (device discovery, trace dumps) started by a real-time thread
+} rt_role_t;
+
+/**
+ * Process-wide part of the real-time profile (mlockall): call once, as early as possible.
+ */
+void rt_process_setup(const controller_settings_t *const settings);
+
+/**
+ * Apply the real-time profile of role to the calling thread: SCHED_FIFO priority, CPU affinity and timer slack.
+ *
+ * Threads created afterwards by the caller inherit all of them. Without the privileges needed for SCHED_FIFO the
+ * thread gets a better nice value if possible and keeps running with the default policy otherwise.
+ *
+ * RT_ROLE_BACKGROUND undoes what the creating thread handed down, whether the profile is enabled or not:
+ * SCHED_OTHER at nice RT_BACKGROUND_NICE with the default timer slack.
+ */
+void rt_thread_setup(const controller_settings_t *const settings, rt_role_t role);
@@ -6,6 +6,63 @@ void init_config(controller_settings_t *const conf) {
     conf->ff_gain = 100;
     conf->enable_qam = 1;
     conf->nintendo_layout = 0;
+    conf->output_batch_size = 32;
+    conf->ds4_report_rate_hz = 1000;
+    conf->ds5_report_rate_hz = 1000;
+    conf->report_on_change = 0;
+    conf->input_reactor = 0;
+    conf->record_file[0] = '\0';
+    conf->rt_profile = 0;
+    conf->rt_mlockall = 1;
+    conf->rt_timer_slack_ns = 1000;
+    conf->rt_input_priority = 40;
+    conf->rt_output_priority = 39;
+    conf->rt_report_priority = 38;
+    conf->rt_input_cpus = 0;
+    conf->rt_output_cpus = 0;
+    conf->rt_report_cpus = 0;
+    conf->imu_fusion = 0;
+    conf->imu_fusion_beta = 0.1;
+    conf->imu_fusion_kp = 0.5;
+    conf->imu_fusion_ki = 0.0;
+    conf->imu_motion_space = 0;
+    conf->imu_report_gravity = 0;
+    conf->gyro_calibration = 1;
+    strcpy(conf->gyro_calibration_dir, "/var/lib/ROGueENEMY");
+    conf->gyro_mouse = 0;
+    conf->gyro_mouse_sensitivity = 8.0;
+    conf->gyro_mouse_min_sensitivity = 4.0;
+    conf->gyro_mouse_slow_dps = 5.0;
+    conf->gyro_mouse_fast_dps = 75.0;
+    conf->gyro_mouse_deadzone_dps = 1.5;
+    conf->log_level = 1;
+    conf->flight_recorder = 1;
+    strcpy(conf->flight_recorder_dir, "/var/log/ROGueENEMY");
+    strcpy(conf->metrics_socket, "/run/rogue-enemy-metrics.sock");
+}
+
+static void fill_cpu_mask(const config_t *const cfg, const char* name, uint64_t *const mask) {
+    const config_setting_t *const cpus = config_lookup(cfg, name);
+    if (cpus == NULL) {
+        fprintf(stderr, "%s (int array) configuration not found. Default value will be used.\n", name);
+        return;
+    } else if ((!config_setting_is_array(cpus)) && (!config_setting_is_list(cpus))) {
+        fprintf(stderr, "%s must be an array of cpu numbers, i.e. [2, 3]", name);
+        return;
+    }
+
+    uint64_t new_mask = 0;
+    for (int i = 0; i < config_setting_length(cpus); ++i) {
+        const int cpu = config_setting_get_int_elem(cpus, i);
+        if ((cpu < 0) || (cpu >= 64)) {
+            fprintf(stderr, "%s: cpu %d ignored, must be between 0 and 63", name, cpu);
+            continue;
+        }
+
+        new_mask |= (uint64_t)1 << cpu;
+    }
+
+    *mask = new_mask;
 }
 
 int fill_config(controller_settings_t *const conf, const char* file) {
@@ -18,6 +75,8 @@ int fill_config(controller_settings_t *const conf, const char* file) {
     const int config_read_res = config_read_file(&cfg, file);
     if (config_read_res != CONFIG_TRUE) {
         fprintf(stderr, "Error in reading config file: %s\n", config_error_text(&cfg));
+        res = -EINVAL;
+        config_destroy(&cfg);
         goto fill_config_err;
     }
 
@@ -46,8 +105,353 @@ int fill_config(controller_settings_t *const conf, const char* file) {
         fprintf(stderr, "nintendo_layout (bool) configuration not found. Default value will be used.\n");
     }
 
+    int output_batch_size;
+    if (config_lookup_int(&cfg, "output_batch_size", &output_batch_size) != CONFIG_FALSE) {
+        if (output_batch_size >= 1) {
+            conf->output_batch_size = output_batch_size;
+        } else {
+            fprintf(stderr, "output_batch_size (int) must be a positive number");
+        }
+    } else {
+        fprintf(stderr, "output_batch_size (int) configuration not found. Default value will be used.\n");
+    }
+
+    int ds4_report_rate_hz;
+    if (config_lookup_int(&cfg, "ds4_report_rate", &ds4_report_rate_hz) != CONFIG_FALSE) {
+        if ((ds4_report_rate_hz == 250) || (ds4_report_rate_hz == 500) || (ds4_report_rate_hz == 1000)) {
+            conf->ds4_report_rate_hz = ds4_report_rate_hz;
+        } else {
+            fprintf(stderr, "ds4_report_rate (int) must be one of 250, 500 or 1000");
+        }
+    } else {
+        fprintf(stderr, "ds4_report_rate (int) configuration not found. Default value will be used.\n");
+    }
+
+    int ds5_report_rate_hz;
+    if (config_lookup_int(&cfg, "ds5_report_rate", &ds5_report_rate_hz) != CONFIG_FALSE) {
+        if ((ds5_report_rate_hz == 250) || (ds5_report_rate_hz == 500) || (ds5_report_rate_hz == 1000)) {
+            conf->ds5_report_rate_hz = ds5_report_rate_hz;
+        } else {
+            fprintf(stderr, "ds5_report_rate (int) must be one of 250, 500 or 1000");
+        }
+    } else {
+        fprintf(stderr, "ds5_report_rate (int) configuration not found. Default value will be used.\n");
+    }
+
+    int report_on_change;
+    if (config_lookup_bool(&cfg, "report_on_change", &report_on_change) != CONFIG_FALSE) {
+        conf->report_on_change = report_on_change;
+    } else {
+        fprintf(stderr, "report_on_change (bool) configuration not found. Default value will be used.\n");
+    }
+
+    int input_reactor;
+    if (config_lookup_bool(&cfg, "input_reactor", &input_reactor) != CONFIG_FALSE) {
+        conf->input_reactor = input_reactor;
+    } else {
+        fprintf(stderr, "input_reactor (bool) configuration not found. Default value will be used.\n");
+    }
+
+    const char* record_file;
+    if (config_lookup_string(&cfg, "record_file", &record_file) != CONFIG_FALSE) {
+        if (strlen(record_file) < sizeof(conf->record_file)) {
+            strcpy(conf->record_file, record_file);
+        } else {
+            fprintf(stderr, "record_file (string) is too long: input will not be recorded");
+        }
+    } else {
+        fprintf(stderr, "record_file (string) configuration not found. Default value will be used.\n");
+    }
+
+    int rt_profile;
+    if (config_lookup_bool(&cfg, "rt_profile", &rt_profile) != CONFIG_FALSE) {
+        conf->rt_profile = rt_profile;
+    } else {
+        fprintf(stderr, "rt_profile (bool) configuration not found. Default value will be used.\n");
+    }
+
+    int rt_mlockall;
+    if (config_lookup_bool(&cfg, "rt_mlockall", &rt_mlockall) != CONFIG_FALSE) {
+        conf->rt_mlockall = rt_mlockall;
+    } else {
+        fprintf(stderr, "rt_mlockall (bool) configuration not found. Default value will be used.\n");
+    }
+
+    int rt_timer_slack_ns;
+    if (config_lookup_int(&cfg, "rt_timer_slack_ns", &rt_timer_slack_ns) != CONFIG_FALSE) {
+        if (rt_timer_slack_ns >= 0) {
+            conf->rt_timer_slack_ns = rt_timer_slack_ns;
+        } else {
+            fprintf(stderr, "rt_timer_slack_ns (int) must be 0 (kernel default) or a positive number");
+        }
+    } else {
+        fprintf(stderr, "rt_timer_slack_ns (int) configuration not found. Default value will be used.\n");
+    }
+
+    int rt_input_priority;
+    if (config_lookup_int(&cfg, "rt_input_priority", &rt_input_priority) != CONFIG_FALSE) {
+        if ((rt_input_priority >= 0) && (rt_input_priority <= 99)) {
+            conf->rt_input_priority = rt_input_priority;
+        } else {
+            fprintf(stderr, "rt_input_priority (int) must be between 0 (no SCHED_FIFO) and 99");
+        }
+    } else {
+        fprintf(stderr, "rt_input_priority (int) configuration not found. Default value will be used.\n");
+    }
+
+    int rt_output_priority;
+    if (config_lookup_int(&cfg, "rt_output_priority", &rt_output_priority) != CONFIG_FALSE) {
+        if ((rt_output_priority >= 0) && (rt_output_priority <= 99)) {
+            conf->rt_output_priority = rt_output_priority;
+        } else {
+            fprintf(stderr, "rt_output_priority (int) must be between 0 (no SCHED_FIFO) and 99");
+        }
+    } else {
+        fprintf(stderr, "rt_output_priority (int) configuration not found. Default value will be used.\n");
+    }
+
+    int rt_report_priority;
+    if (config_lookup_int(&cfg, "rt_report_priority", &rt_report_priority) != CONFIG_FALSE) {
+        if ((rt_report_priority >= 0) && (rt_report_priority <= 99)) {
+            conf->rt_report_priority = rt_report_priority;
+        } else {
+            fprintf(stderr, "rt_report_priority (int) must be between 0 (no SCHED_FIFO) and 99");
+        }
+    } else {
+        fprintf(stderr, "rt_report_priority (int) configuration not found. Default value will be used.\n");
+    }
+
+    fill_cpu_mask(&cfg, "rt_input_cpus", &conf->rt_input_cpus);
+    fill_cpu_mask(&cfg, "rt_output_cpus", &conf->rt_output_cpus);
+    fill_cpu_mask(&cfg, "rt_report_cpus", &conf->rt_report_cpus);
+
+    const char* imu_fusion;
+    if (config_lookup_string(&cfg, "imu_fusion", &imu_fusion) != CONFIG_FALSE) {
+        if (strcmp(imu_fusion, "off") == 0) {
+            conf->imu_fusion = 0;
+        } else if (strcmp(imu_fusion, "madgwick") == 0) {
+            conf->imu_fusion = 1;
+        } else if (strcmp(imu_fusion, "mahony") == 0) {
+            conf->imu_fusion = 2;
+        } else {
+            fprintf(stderr, "imu_fusion (string) must be one of \"off\", \"madgwick\" or \"mahony\"");
+        }
+    } else {
+        fprintf(stderr, "imu_fusion (string) configuration not found. Default value will be used.\n");
+    }
+
+    double imu_fusion_beta;
+    if (config_lookup_float(&cfg, "imu_fusion_beta", &imu_fusion_beta) != CONFIG_FALSE) {
+        if (imu_fusion_beta >= 0.0) {
+            conf->imu_fusion_beta = imu_fusion_beta;
+        } else {
+            fprintf(stderr, "imu_fusion_beta (float) cannot be negative");
+        }
+    } else {
+        fprintf(stderr, "imu_fusion_beta (float) configuration not found. Default value will be used.\n");
+    }
+
+    double imu_fusion_kp;
+    if (config_lookup_float(&cfg, "imu_fusion_kp", &imu_fusion_kp) != CONFIG_FALSE) {
+        if (imu_fusion_kp >= 0.0) {
+            conf->imu_fusion_kp = imu_fusion_kp;
+        } else {
+            fprintf(stderr, "imu_fusion_kp (float) cannot be negative");
+        }
+    } else {
+        fprintf(stderr, "imu_fusion_kp (float) configuration not found. Default value will be used.\n");
+    }
+
+    double imu_fusion_ki;
+    if (config_lookup_float(&cfg, "imu_fusion_ki", &imu_fusion_ki) != CONFIG_FALSE) {
+        if (imu_fusion_ki >= 0.0) {
+            conf->imu_fusion_ki = imu_fusion_ki;
+        } else {
+            fprintf(stderr, "imu_fusion_ki (float) cannot be negative");
+        }
+    } else {
+        fprintf(stderr, "imu_fusion_ki (float) configuration not found. Default value will be used.\n");
+    }
+
+    const char* imu_motion_space;
+    if (config_lookup_string(&cfg, "imu_motion_space", &imu_motion_space) != CONFIG_FALSE) {
+        if (strcmp(imu_motion_space, "local") == 0) {
+            conf->imu_motion_space = 0;
+        } else if (strcmp(imu_motion_space, "world") == 0) {
+            conf->imu_motion_space = 1;
+        } else {
+            fprintf(stderr, "imu_motion_space (string) must be either \"local\" or \"world\"");
+        }
+    } else {
+        fprintf(stderr, "imu_motion_space (string) configuration not found. Default value will be used.\n");
+    }
+
+    int imu_report_gravity;
+    if (config_lookup_bool(&cfg, "imu_report_gravity", &imu_report_gravity) != CONFIG_FALSE) {
+        conf->imu_report_gravity = imu_report_gravity;
+    } else {
+        fprintf(stderr, "imu_report_gravity (bool) configuration not found. Default value will be used.\n");
+    }
+
+    int gyro_calibration;
+    if (config_lookup_bool(&cfg, "gyro_calibration", &gyro_calibration) != CONFIG_FALSE) {
+        conf->gyro_calibration = gyro_calibration;
+    } else {
+        fprintf(stderr, "gyro_calibration (bool) configuration not found. Default value will be used.\n");
+    }
+
+    const char* gyro_calibration_dir;
+    if (config_lookup_string(&cfg, "gyro_calibration_dir", &gyro_calibration_dir) != CONFIG_FALSE) {
+        if ((strlen(gyro_calibration_dir) > 0) && (strlen(gyro_calibration_dir) < sizeof(conf->gyro_calibration_dir))) {
+            strcpy(conf->gyro_calibration_dir, gyro_calibration_dir);
+        } else {
+            fprintf(stderr, "gyro_calibration_dir (string) is empty or too long: default value will be used");
+        }
+    } else {
+        fprintf(stderr, "gyro_calibration_dir (string) configuration not found. Default value will be used.\n");
+    }
+
+    const char* gyro_mouse;
+    if (config_lookup_string(&cfg, "gyro_mouse", &gyro_mouse) != CONFIG_FALSE) {
+        if (strcmp(gyro_mouse, "off") == 0) {
+            conf->gyro_mouse = 0;
+        } else if (strcmp(gyro_mouse, "hold") == 0) {
+            conf->gyro_mouse = 1;
+        } else if (strcmp(gyro_mouse, "always") == 0) {
+            conf->gyro_mouse = 2;
+        } else {
+            fprintf(stderr, "gyro_mouse (string) must be one of \"off\", \"hold\" or \"always\"");
+        }
+    } else {
+        fprintf(stderr, "gyro_mouse (string) configuration not found. Default value will be used.\n");
+    }
+
+    double gyro_mouse_sensitivity;
+    if (config_lookup_float(&cfg, "gyro_mouse_sensitivity", &gyro_mouse_sensitivity) != CONFIG_FALSE) {
+        if (gyro_mouse_sensitivity >= 0.0) {
+            conf->gyro_mouse_sensitivity = gyro_mouse_sensitivity;
+        } else {
+            fprintf(stderr, "gyro_mouse_sensitivity (float) cannot be negative");
+        }
+    } else {
+        fprintf(stderr, "gyro_mouse_sensitivity (float) configuration not found. Default value will be used.\n");
+    }
+
+    double gyro_mouse_min_sensitivity;
+    if (config_lookup_float(&cfg, "gyro_mouse_min_sensitivity", &gyro_mouse_min_sensitivity) != CONFIG_FALSE) {
+        if (gyro_mouse_min_sensitivity >= 0.0) {
+            conf->gyro_mouse_min_sensitivity = gyro_mouse_min_sensitivity;
+        } else {
+            fprintf(stderr, "gyro_mouse_min_sensitivity (float) cannot be negative");
+        }
+    } else {
+        fprintf(stderr, "gyro_mouse_min_sensitivity (float) configuration not found. Default value will be used.\n");
+    }
+
+    double gyro_mouse_slow_dps;
+    if (config_lookup_float(&cfg, "gyro_mouse_slow_dps", &gyro_mouse_slow_dps) != CONFIG_FALSE) {
+        if (gyro_mouse_slow_dps >= 0.0) {
+            conf->gyro_mouse_slow_dps = gyro_mouse_slow_dps;
+        } else {
+            fprintf(stderr, "gyro_mouse_slow_dps (float) cannot be negative");
+        }
+    } else {
+        fprintf(stderr, "gyro_mouse_slow_dps (float) configuration not found. Default value will be used.\n");
+    }
+
+    double gyro_mouse_fast_dps;
+    if (config_lookup_float(&cfg, "gyro_mouse_fast_dps", &gyro_mouse_fast_dps) != CONFIG_FALSE) {
+        if (gyro_mouse_fast_dps >= 0.0) {
+            conf->gyro_mouse_fast_dps = gyro_mouse_fast_dps;
+        } else {
+            fprintf(stderr, "gyro_mouse_fast_dps (float) cannot be negative");
+        }
+    } else {
+        fprintf(stderr, "gyro_mouse_fast_dps (float) configuration not found. Default value will be used.\n");
+    }
+
+    double gyro_mouse_deadzone_dps;
+    if (config_lookup_float(&cfg, "gyro_mouse_deadzone_dps", &gyro_mouse_deadzone_dps) != CONFIG_FALSE) {
+        if (gyro_mouse_deadzone_dps >= 0.0) {
+            conf->gyro_mouse_deadzone_dps = gyro_mouse_deadzone_dps;
+        } else {
+            fprintf(stderr, "gyro_mouse_deadzone_dps (float) cannot be negative");
+        }
+    } else {
+        fprintf(stderr, "gyro_mouse_deadzone_dps (float) configuration not found. Default value will be used.\n");
+    }
+
+    const char* log_level;
+    if (config_lookup_string(&cfg, "log_level", &log_level) != CONFIG_FALSE) {
+        if (strcmp(log_level, "debug") == 0) {
+            conf->log_level = 0;
+        } else if (strcmp(log_level, "info") == 0) {
+            conf->log_level = 1;
+        } else if (strcmp(log_level, "warning") == 0) {
+            conf->log_level = 2;
+        } else if (strcmp(log_level, "error") == 0) {
+            conf->log_level = 3;
+        } else {
+            fprintf(stderr, "log_level (string) must be one of \"debug\", \"info\", \"warning\" or \"error\"");
+        }
+    } else {
+        fprintf(stderr, "log_level (string) configuration not found. Default value will be used.\n");
+    }
+
+    int flight_recorder;
+    if (config_lookup_bool(&cfg, "flight_recorder", &flight_recorder) != CONFIG_FALSE) {
+        conf->flight_recorder = flight_recorder;
+    } else {
+        fprintf(stderr, "flight_recorder (bool) configuration not found. Default value will be used.\n");
+    }
+
+    const char* flight_recorder_dir;
+    if (config_lookup_string(&cfg, "flight_recorder_dir", &flight_recorder_dir) != CONFIG_FALSE) {
+        if ((strlen(flight_recorder_dir) > 0) && (strlen(flight_recorder_dir) < sizeof(conf->flight_recorder_dir))) {
+            strcpy(conf->flight_recorder_dir, flight_recorder_dir);
+        } else {
+            fprintf(stderr, "flight_recorder_dir (string) is empty or too long: default value will be used");
+        }
+    } else {
+        fprintf(stderr, "flight_recorder_dir (string) configuration not found. Default value will be used.\n");
+    }
+
+    const char* metrics_socket;
+    if (config_lookup_string(&cfg, "metrics_socket", &metrics_socket) != CONFIG_FALSE) {
+        if (strlen(metrics_socket) < sizeof(conf->metrics_socket)) {
+            strcpy(conf->metrics_socket, metrics_socket);
+        } else {
+            fprintf(stderr, "metrics_socket (string) is too long: default value will be used");
+        }
+    } else {
+        fprintf(stderr, "metrics_socket (string) configuration not found. Default value will be used.\n");
+    }
+
     config_destroy(&cfg);
 
 fill_config_err:
     return res;
+}
+
+void copy_startup_only_config(controller_settings_t *const conf, const controller_settings_t *const running) {
+    conf->ds4_report_rate_hz = running->ds4_report_rate_hz;
+    conf->ds5_report_rate_hz = running->ds5_report_rate_hz;
+    conf->report_on_change = running->report_on_change;
+    conf->input_reactor = running->input_reactor;
+    memcpy(conf->record_file, running->record_file, sizeof(conf->record_file));
+
+    conf->rt_profile = running->rt_profile;
+    conf->rt_mlockall = running->rt_mlockall;
+    conf->rt_timer_slack_ns = running->rt_timer_slack_ns;
+    conf->rt_input_priority = running->rt_input_priority;
+    conf->rt_output_priority = running->rt_output_priority;
+    conf->rt_report_priority = running->rt_report_priority;
+    conf->rt_input_cpus = running->rt_input_cpus;
+    conf->rt_output_cpus = running->rt_output_cpus;
+    conf->rt_report_cpus = running->rt_report_cpus;
+
+    conf->gyro_calibration = running->gyro_calibration;
+    memcpy(conf->gyro_calibration_dir, running->gyro_calibration_dir, sizeof(conf->gyro_calibration_dir));
+
+    memcpy(conf->metrics_socket, running->metrics_socket, sizeof(conf->metrics_socket));
 }
\ No newline at end of file
@@ -2,12 +2,68 @@
 
 #include "rogue_enemy.h"
 
+#define CONFIGURATION_DIR       "/etc/ROGueENEMY"
+#define CONFIGURATION_FILE_NAME "config.cfg"
+
 typedef struct controller_settings {
     uint16_t ff_gain;
     int enable_qam;
     int nintendo_layout;
+    int output_batch_size;
+    int ds4_report_rate_hz;
+    int ds5_report_rate_hz;
+    int report_on_change;
+    int input_reactor;
+    char record_file[256];
+
+    // real-time profile (see rt_profile.h)
+    int rt_profile;
+    int rt_mlockall;
+    int rt_timer_slack_ns;
+    int rt_input_priority;
+    int rt_output_priority;
+    int rt_report_priority;
+    uint64_t rt_input_cpus; // bit n set: may run on cpu n, 0 for no pinning
+    uint64_t rt_output_cpus;
+    uint64_t rt_report_cpus;
+
+    // IMU sensor fusion (see imu_fusion.h)
+    int imu_fusion;
+    double imu_fusion_beta;
+    double imu_fusion_kp;
+    double imu_fusion_ki;
+    int imu_motion_space;
+    int imu_report_gravity;
+
+    // gyro bias estimated while the device is still, persisted in gyro_calibration_dir
+    int gyro_calibration;
+    char gyro_calibration_dir[256];
+
+    // gyro-to-mouse (see gyro_mouse.h)
+    int gyro_mouse;
+    double gyro_mouse_sensitivity;
+    double gyro_mouse_min_sensitivity;
+    double gyro_mouse_slow_dps;
+    double gyro_mouse_fast_dps;
+    double gyro_mouse_deadzone_dps;
+
+    // lowest level written by the log ring (see ring_log.h)
+    int log_level;
+
+    // flight recorder (see trace.h): dumps are written to flight_recorder_dir
+    int flight_recorder;
+    char flight_recorder_dir[256];
+
+    // UNIX socket the metrics are served on (see metrics.h), empty to disable
+    char metrics_socket[108];
 } controller_settings_t;
 
 void init_config(controller_settings_t *const conf);
 
-int fill_config(controller_settings_t *const conf, const char* file);
\ No newline at end of file
+int fill_config(controller_settings_t *const conf, const char* file);
+
+/**
+ * Keep the values of the settings that are only read at startup (threads, devices and files already set up)
+ * from running: the others of conf are applied live by a reload.
+ */
+void copy_startup_only_config(controller_settings_t *const conf, const controller_settings_t *const running);
\ No newline at end of file
@@ -0,0 +1,76 @@
+#include "settings_watch.h"
+#include "logic.h"
+
+#include <sys/inotify.h>
+#include <poll.h>
+
+// returns 1 if any of the pending events is about the configuration file
+static int settings_watch_drain(int fd) {
+    int touched = 0;
+
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        const ssize_t len = read(fd, buf, sizeof(buf));
+        if (len <= 0) {
+            break;
+        }
+
+        for (ssize_t off = 0; off < len; ) {
+            const struct inotify_event *const event = (const struct inotify_event*)&buf[off];
+            if ((event->len > 0) && (strcmp(event->name, CONFIGURATION_FILE_NAME) == 0)) {
+                touched = 1;
+            }
+
+            off += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return touched;
+}
+
+void *settings_watch_thread_func(void *ptr) {
+    logic_t *const logic = (logic_t*)ptr;
+
+    const int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        fprintf(stderr, "Unable to create the inotify instance: %d. Configuration changes will need a restart.\n", errno);
+        return NULL;
+    }
+
+    // the directory is watched, not the file: editors replace the file, and a watch on it would be lost
+    const int wd = inotify_add_watch(fd, CONFIGURATION_DIR, IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+        fprintf(stderr, "Unable to watch %s: %d. Configuration changes will need a restart.\n", CONFIGURATION_DIR, errno);
+        goto settings_watch_thread_func_err;
+    }
+
+    struct pollfd pfd = {
+        .fd = fd,
+        .events = POLLIN,
+        .revents = 0,
+    };
+
+    int pending = 0;
+    while (!logic_termination_requested(logic)) {
+        const int poll_res = poll(&pfd, 1, pending ? SETTINGS_WATCH_DEBOUNCE_MS : SETTINGS_WATCH_TERMINATION_CHECK_MS);
+        if (poll_res > 0) {
+            pending |= settings_watch_drain(fd);
+        } else if (poll_res == 0) {
+            if (pending) {
+                pending = 0;
+
+                if (logic_reload_settings(logic) == 0) {
+                    printf("Configuration reloaded from %s/%s\n", CONFIGURATION_DIR, CONFIGURATION_FILE_NAME);
+                }
+            }
+        } else if (errno != EINTR) {
+            fprintf(stderr, "Error waiting for configuration changes: %d\n", errno);
+            break;
+        }
+    }
+
+settings_watch_thread_func_err:
+    close(fd);
+
+    return NULL;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "rogue_enemy.h"
+
+// editors often write a file in several steps: wait for this long without changes before reloading
+#define SETTINGS_WATCH_DEBOUNCE_MS          100
+
+// how often the watcher checks for termination while the configuration is not touched
+#define SETTINGS_WATCH_TERMINATION_CHECK_MS 1000
+
+/**
+ * Watch the configuration directory with inotify and reload the settings whenever the configuration file is
+ * written or replaced (i.e. renamed over by an editor): ptr is the logic_t to publish them to.
+ */
+void *settings_watch_thread_func(void *ptr);
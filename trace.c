@@ -0,0 +1,257 @@
+#include "trace.h"
+#include "logic.h"
+#include "latency.h"
+#include "rt_profile.h"
+
+#include <limits.h>
+#include <sys/syscall.h>
+
+// seqlock-style slot: seq is 0 while being written, index + 1 once complete
+typedef struct trace_slot {
+    atomic_uint_fast64_t seq;
+    atomic_uint_fast64_t time_ns;
+    atomic_uint_fast64_t info; // event | detail << 16 | tid << 32
+    atomic_uint_fast64_t arg;
+} trace_slot_t;
+
+static trace_slot_t slots[TRACE_RECORDS];
+static atomic_uint_fast64_t head = 0;
+
+static atomic_int recording = 1;
+
+static trace_file_thread_t threads[TRACE_MAX_THREADS];
+static clockid_t thread_clocks[TRACE_MAX_THREADS];
+static atomic_int thread_ready[TRACE_MAX_THREADS];
+static atomic_uint threads_count = 0;
+
+static _Thread_local uint32_t thread_tid = 0;
+
+static atomic_uint dump_reasons = 0;
+static sem_t dump_sem;
+static atomic_int dump_sem_ready = 0;
+
+static uint32_t current_tid(void) {
+    if (thread_tid == 0) {
+        thread_tid = (uint32_t)syscall(SYS_gettid);
+    }
+
+    return thread_tid;
+}
+
+void trace_set_enabled(int enabled) {
+    atomic_store_explicit(&recording, enabled, memory_order_relaxed);
+}
+
+void trace_register_thread(const char *const name) {
+    const unsigned int index = atomic_fetch_add_explicit(&threads_count, 1, memory_order_relaxed);
+    if (index >= TRACE_MAX_THREADS) {
+        return;
+    }
+
+    threads[index].tid = current_tid();
+    strncpy(threads[index].name, name, TRACE_THREAD_NAME_MAX - 1);
+
+    // without its CPU-time clock the thread is only named in the dumps
+    if (pthread_getcpuclockid(pthread_self(), &thread_clocks[index]) == 0) {
+        atomic_store_explicit(&thread_ready[index], 1, memory_order_release);
+    }
+}
+
+int trace_thread_info(unsigned int index, const char **const name, uint32_t *const tid, clockid_t *const cpu_clock) {
+    const unsigned int registered = atomic_load_explicit(&threads_count, memory_order_relaxed);
+    if ((index >= registered) || (index >= TRACE_MAX_THREADS)) {
+        return -ENOENT;
+    } else if (!atomic_load_explicit(&thread_ready[index], memory_order_acquire)) {
+        return -EAGAIN;
+    }
+
+    *name = threads[index].name;
+    *tid = threads[index].tid;
+    *cpu_clock = thread_clocks[index];
+
+    return 0;
+}
+
+void trace_record(trace_event_t event, uint16_t detail, uint64_t arg) {
+    if (!atomic_load_explicit(&recording, memory_order_relaxed)) {
+        return;
+    }
+
+    const uint64_t info = (uint64_t)event | ((uint64_t)detail << 16) | ((uint64_t)current_tid() << 32);
+    const uint64_t time_ns = latency_now_ns();
+
+    const uint64_t index = atomic_fetch_add_explicit(&head, 1, memory_order_relaxed);
+    trace_slot_t *const slot = &slots[index & (TRACE_RECORDS - 1)];
+
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->time_ns, time_ns, memory_order_relaxed);
+    atomic_store_explicit(&slot->info, info, memory_order_relaxed);
+    atomic_store_explicit(&slot->arg, arg, memory_order_relaxed);
+
+    atomic_store_explicit(&slot->seq, index + 1, memory_order_release);
+}
+
+void trace_request_dump(trace_dump_reason_t reason) {
+    atomic_fetch_or_explicit(&dump_reasons, (unsigned int)reason, memory_order_relaxed);
+
+    if (atomic_load_explicit(&dump_sem_ready, memory_order_acquire)) {
+        sem_post(&dump_sem);
+    }
+}
+
+// copy the slot of index out of the ring: 0 if it has been overwritten (or is being written) meanwhile
+static int read_slot(uint64_t index, trace_file_record_t *const out) {
+    trace_slot_t *const slot = &slots[index & (TRACE_RECORDS - 1)];
+
+    const uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    const uint64_t time_ns = atomic_load_explicit(&slot->time_ns, memory_order_relaxed);
+    const uint64_t info = atomic_load_explicit(&slot->info, memory_order_relaxed);
+    const uint64_t arg = atomic_load_explicit(&slot->arg, memory_order_relaxed);
+    atomic_thread_fence(memory_order_acquire);
+
+    if ((seq != index + 1) || (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq)) {
+        return 0;
+    }
+
+    out->seq = index;
+    out->time_ns = time_ns;
+    out->event = (uint16_t)(info & 0xFFFF);
+    out->detail = (uint16_t)((info >> 16) & 0xFFFF);
+    out->tid = (uint32_t)(info >> 32);
+    out->arg = arg;
+
+    return 1;
+}
+
+int trace_dump(const char *const dir, uint32_t reasons) {
+    int res = 0;
+
+    trace_file_record_t *const records = malloc(sizeof(trace_file_record_t) * TRACE_RECORDS);
+    if (records == NULL) {
+        return -ENOMEM;
+    }
+
+    trace_file_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(TRACE_FILE_MAGIC));
+    header.version = TRACE_FILE_VERSION;
+    header.reasons = reasons;
+
+    struct timespec realtime;
+    clock_gettime(CLOCK_REALTIME, &realtime);
+    header.dump_time_ns = latency_now_ns();
+    header.dump_realtime_ns = (uint64_t)realtime.tv_sec * 1000000000ULL + (uint64_t)realtime.tv_nsec;
+
+    // the ring keeps being written: whatever gets overwritten while copying is skipped
+    const uint64_t end = atomic_load_explicit(&head, memory_order_acquire);
+    const uint64_t begin = (end > TRACE_RECORDS) ? end - TRACE_RECORDS : 0;
+    for (uint64_t index = begin; index < end; ++index) {
+        if (read_slot(index, &records[header.records_count])) {
+            ++header.records_count;
+        }
+    }
+
+    const unsigned int registered = atomic_load_explicit(&threads_count, memory_order_relaxed);
+    header.threads_count = (registered < TRACE_MAX_THREADS) ? registered : TRACE_MAX_THREADS;
+
+    if ((mkdir(dir, 0755) != 0) && (errno != EEXIST)) {
+        fprintf(stderr, "Unable to create the flight recorder directory %s: %d\n", dir, errno);
+    }
+
+    char path[PATH_MAX];
+    char tmp_path[PATH_MAX + 8];
+    // nanoseconds in the name: two dumps within the same second (a signal right after a stall) must not overwrite each other
+    snprintf(
+        path,
+        sizeof(path),
+        "%s/trace-%llu.%09ld-%s.bin",
+        dir,
+        (unsigned long long)realtime.tv_sec,
+        (long)realtime.tv_nsec,
+        (reasons & TRACE_DUMP_SIGNAL) ? "signal" : "stall"
+    );
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE *const f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        res = -errno;
+        fprintf(stderr, "Unable to write the flight recorder dump to %s: %d\n", tmp_path, res);
+        goto trace_dump_err;
+    }
+
+    size_t written = fwrite(&header, sizeof(header), 1, f);
+    written += fwrite(threads, sizeof(trace_file_thread_t), header.threads_count, f);
+    written += fwrite(records, sizeof(trace_file_record_t), header.records_count, f);
+    const int close_res = fclose(f);
+    if ((written != 1 + header.threads_count + header.records_count) || (close_res != 0)) {
+        fprintf(stderr, "Unable to write the flight recorder dump to %s\n", tmp_path);
+        unlink(tmp_path);
+        res = -EIO;
+        goto trace_dump_err;
+    }
+
+    if (rename(tmp_path, path) != 0) {
+        res = -errno;
+        fprintf(stderr, "Unable to rename the flight recorder dump to %s: %d\n", path, res);
+        unlink(tmp_path);
+        goto trace_dump_err;
+    }
+
+    printf("Flight recorder: %u events dumped to %s\n", header.records_count, path);
+
+trace_dump_err:
+    free(records);
+
+    return res;
+}
+
+void *trace_dump_thread_func(void *ptr) {
+    logic_t *const logic = (logic_t*)ptr;
+
+    // inherited from main(), possibly real-time: writing a dump must never compete with the input path
+    rt_thread_setup(&logic->controller_settings, RT_ROLE_BACKGROUND);
+
+    if (sem_init(&dump_sem, 0, 0) != 0) {
+        fprintf(stderr, "Unable to create the flight recorder semaphore: %d. Traces will not be dumped.\n", errno);
+        return NULL;
+    }
+    atomic_store_explicit(&dump_sem_ready, 1, memory_order_release);
+
+    uint64_t last_stall_dump_ns = 0;
+    while (!logic_termination_requested(logic)) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += TRACE_DUMP_CHECK_MS / 1000;
+
+        if ((sem_timedwait(&dump_sem, &deadline) != 0) && (errno != EINTR) && (errno != ETIMEDOUT)) {
+            fprintf(stderr, "Error waiting for flight recorder dump requests: %d\n", errno);
+            break;
+        }
+
+        uint32_t reasons = atomic_exchange_explicit(&dump_reasons, 0, memory_order_relaxed);
+        if (reasons == 0) {
+            continue;
+        }
+
+        // a stall dump too close to the previous one would only show the same stall again
+        const uint64_t now_ns = latency_now_ns();
+        if (reasons & TRACE_DUMP_STALL) {
+            if ((last_stall_dump_ns != 0) && ((now_ns - last_stall_dump_ns) < (TRACE_STALL_DUMP_INTERVAL_S * 1000000000ULL))) {
+                reasons &= ~(uint32_t)TRACE_DUMP_STALL;
+            } else {
+                last_stall_dump_ns = now_ns;
+            }
+        }
+
+        const controller_settings_t *const settings = logic_get_settings(logic);
+        if ((reasons != 0) && (settings->flight_recorder)) {
+            trace_dump(settings->flight_recorder_dir, reasons);
+        }
+    }
+
+    // the semaphore is left in place: a late SIGUSR1 may still post to it
+
+    return NULL;
+}
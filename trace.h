@@ -0,0 +1,95 @@
+#pragma once
+
+#include "rogue_enemy.h"
+
+/*
+ * Flight recorder: an always-on ring of the last TRACE_RECORDS pipeline events (about ten seconds
+ * at full IMU and report rate), dumped to a file on SIGUSR1 or when an input thread stalls.
+ *
+ * Recording is one fetch-add and a handful of relaxed stores: any thread can record at any time.
+ *
+ * Dump file: a trace_file_header_t, threads_count trace_file_thread_t and records_count
+ * trace_file_record_t ordered from the oldest to the newest. rogue-enemy-trace (trace_decode.c)
+ * converts it to the Chrome trace JSON format.
+ */
+#define TRACE_RECORDS               (1U << 16) // must be a power of two
+#define TRACE_MAX_THREADS           32
+#define TRACE_THREAD_NAME_MAX       28
+
+#define TRACE_FILE_MAGIC            "RGETRCE"
+#define TRACE_FILE_VERSION          1
+
+// stalls come in bursts: one dump every this many seconds is enough to see what caused them
+#define TRACE_STALL_DUMP_INTERVAL_S 60
+
+#define TRACE_DUMP_CHECK_MS         1000
+
+typedef enum trace_event {
+    TRACE_EV_READ = 0,      // detail: message_type_t, arg: events read (evdev only)
+    TRACE_EV_QUEUE_DEPTH,   // arg: messages waiting in the input queue
+    TRACE_EV_APPLY,         // detail: message_type_t, arg: ns from the read to the gamepad status update
+    TRACE_EV_REPORT,        // detail: latency_output_t, arg: bytes (uhid) or events (evdev) written
+    TRACE_EV_RUMBLE,        // arg: strong magnitude << 16 | weak magnitude
+    TRACE_EV_MODE_SWITCH,   // detail: new mode
+    TRACE_EV_STALL,         // detail: message_type_t of the stalled reader
+    TRACE_EV_COUNT,
+} trace_event_t;
+
+typedef enum trace_dump_reason {
+    TRACE_DUMP_SIGNAL = 0x00000001U,
+    TRACE_DUMP_STALL = 0x00000002U,
+} trace_dump_reason_t;
+
+typedef struct __attribute__((packed)) trace_file_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reasons;           // trace_dump_reason_t flags
+    uint64_t dump_time_ns;      // CLOCK_MONOTONIC, the clock of the records
+    uint64_t dump_realtime_ns;  // CLOCK_REALTIME taken together with dump_time_ns
+    uint32_t threads_count;
+    uint32_t records_count;
+} trace_file_header_t;
+
+typedef struct __attribute__((packed)) trace_file_thread {
+    uint32_t tid;
+    char name[TRACE_THREAD_NAME_MAX];
+} trace_file_thread_t;
+
+typedef struct __attribute__((packed)) trace_file_record {
+    uint64_t seq;
+    uint64_t time_ns;
+    uint16_t event;
+    uint16_t detail;
+    uint32_t tid;
+    uint64_t arg;
+} trace_file_record_t;
+
+void trace_set_enabled(int enabled);
+
+/**
+ * Name the calling thread in the dumps (and in the per-thread CPU time of metrics.h).
+ */
+void trace_register_thread(const char *const name);
+
+/**
+ * Name, tid and CPU-time clock of the index-th registered thread: returns -ENOENT past the last one
+ * and -EAGAIN for a thread still registering (or without a CPU-time clock). The thread may have exited since.
+ */
+int trace_thread_info(unsigned int index, const char **const name, uint32_t *const tid, clockid_t *const cpu_clock);
+
+void trace_record(trace_event_t event, uint16_t detail, uint64_t arg);
+
+/**
+ * Async-signal-safe: ask trace_dump_thread_func for a dump.
+ */
+void trace_request_dump(trace_dump_reason_t reason);
+
+/**
+ * Write the current content of the ring to a new file in dir: returns 0 or a negative errno.
+ */
+int trace_dump(const char *const dir, uint32_t reasons);
+
+/**
+ * Performs the requested dumps into the flight_recorder_dir of the current settings until termination is requested.
+ */
+void *trace_dump_thread_func(void *ptr);
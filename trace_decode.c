@@ -0,0 +1,162 @@
+#include "trace.h"
+#include "message.h"
+#include "latency.h"
+
+/*
+ * rogue-enemy-trace: convert a flight recorder dump (see trace.h) to the Chrome trace JSON format,
+ * to be opened in chrome://tracing or https://ui.perfetto.dev
+ *
+ * Timestamps are in microseconds from the oldest record of the dump.
+ */
+
+static const char *const message_names[] = {
+    [MSG_TYPE_EV] = "evdev",
+    [MSG_TYPE_IMU] = "imu",
+    [MSG_TYPE_HIDRAW] = "hidraw",
+};
+
+static const char *const output_names[] = {
+    [LATENCY_OUTPUT_EVDEV] = "evdev",
+    [LATENCY_OUTPUT_DS4] = "ds4",
+    [LATENCY_OUTPUT_DS5] = "ds5",
+};
+
+static const char* message_name(uint16_t type) {
+    return (type < sizeof(message_names) / sizeof(message_names[0])) ? message_names[type] : "unknown";
+}
+
+static const char* output_name(uint16_t output) {
+    return (output < sizeof(output_names) / sizeof(output_names[0])) ? output_names[output] : "unknown";
+}
+
+// thread names are written by the daemon: keep them from breaking the JSON
+static void write_json_string(FILE *const out, const char *const str, size_t max_len) {
+    fputc('"', out);
+    for (size_t i = 0; (i < max_len) && (str[i] != '\0'); ++i) {
+        const unsigned char c = (unsigned char)str[i];
+        if ((c == '"') || (c == '\\')) {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+static void write_record(FILE *const out, const trace_file_record_t *const rec, uint64_t base_ns) {
+    const double ts_us = (double)(int64_t)(rec->time_ns - base_ns) / 1000.0;
+
+    switch (rec->event) {
+        case TRACE_EV_READ:
+            fprintf(out, "{\"name\":\"read %s\",\"cat\":\"input\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"count\":%llu}}",
+                message_name(rec->detail), ts_us, rec->tid, (unsigned long long)rec->arg);
+            break;
+        case TRACE_EV_QUEUE_DEPTH:
+            fprintf(out, "{\"name\":\"input queue\",\"cat\":\"queue\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"args\":{\"depth\":%llu}}",
+                ts_us, (unsigned long long)rec->arg);
+            break;
+        case TRACE_EV_APPLY:
+            // drawn as a slice from the read of the message to its application
+            fprintf(out, "{\"name\":\"%s read->apply\",\"cat\":\"output\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+                message_name(rec->detail), ts_us - ((double)rec->arg / 1000.0), (double)rec->arg / 1000.0, rec->tid);
+            break;
+        case TRACE_EV_REPORT:
+            fprintf(out, "{\"name\":\"report %s\",\"cat\":\"output\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"size\":%llu}}",
+                output_name(rec->detail), ts_us, rec->tid, (unsigned long long)rec->arg);
+            break;
+        case TRACE_EV_RUMBLE:
+            fprintf(out, "{\"name\":\"rumble\",\"cat\":\"rumble\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"strong\":%u,\"weak\":%u}}",
+                ts_us, rec->tid, (unsigned)((rec->arg >> 16) & 0xFFFF), (unsigned)(rec->arg & 0xFFFF));
+            break;
+        case TRACE_EV_MODE_SWITCH:
+            fprintf(out, "{\"name\":\"mode switch\",\"cat\":\"state\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"mode\":%u}}",
+                ts_us, rec->tid, (unsigned)rec->detail);
+            break;
+        case TRACE_EV_STALL:
+            fprintf(out, "{\"name\":\"%s reader stalled\",\"cat\":\"stall\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+                message_name(rec->detail), ts_us, rec->tid);
+            break;
+        default:
+            fprintf(out, "{\"name\":\"event %u\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"detail\":%u,\"arg\":%llu}}",
+                (unsigned)rec->event, ts_us, rec->tid, (unsigned)rec->detail, (unsigned long long)rec->arg);
+            break;
+    }
+}
+
+int main(int argc, char ** argv) {
+    int ret = EXIT_FAILURE;
+
+    if ((argc < 2) || (argc > 3)) {
+        fprintf(stderr, "Usage: %s <flight recorder dump> [<output json>]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE *const in = fopen(argv[1], "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Cannot open %s: %d\n", argv[1], errno);
+        return EXIT_FAILURE;
+    }
+
+    FILE *const out = (argc == 3) ? fopen(argv[2], "w") : stdout;
+    if (out == NULL) {
+        fprintf(stderr, "Cannot open %s: %d\n", argv[2], errno);
+        goto main_err_out;
+    }
+
+    trace_file_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1) {
+        fprintf(stderr, "%s is truncated\n", argv[1]);
+        goto main_err;
+    } else if ((memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(TRACE_FILE_MAGIC)) != 0) || (header.version != TRACE_FILE_VERSION)) {
+        fprintf(stderr, "%s is not a flight recorder dump of a supported version\n", argv[1]);
+        goto main_err;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"reasons\":%u,\"dump_realtime_ns\":%llu},\"traceEvents\":[\n",
+        header.reasons, (unsigned long long)header.dump_realtime_ns);
+
+    fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"rogue-enemy\"}}");
+    for (uint32_t i = 0; i < header.threads_count; ++i) {
+        trace_file_thread_t thread;
+        if (fread(&thread, sizeof(thread), 1, in) != 1) {
+            fprintf(stderr, "%s is truncated\n", argv[1]);
+            goto main_err;
+        }
+
+        fprintf(out, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", thread.tid);
+        write_json_string(out, thread.name, sizeof(thread.name));
+        fprintf(out, "}}");
+    }
+
+    uint64_t base_ns = 0;
+    for (uint32_t i = 0; i < header.records_count; ++i) {
+        trace_file_record_t rec;
+        if (fread(&rec, sizeof(rec), 1, in) != 1) {
+            fprintf(stderr, "%s is truncated: %u records out of %u\n", argv[1], i, header.records_count);
+            break;
+        }
+
+        if (i == 0) {
+            base_ns = rec.time_ns;
+        }
+
+        fprintf(out, ",\n");
+        write_record(out, &rec, base_ns);
+    }
+
+    fprintf(out, "\n]}\n");
+
+    ret = EXIT_SUCCESS;
+
+main_err:
+    if (out != stdout) {
+        fclose(out);
+    }
+
+main_err_out:
+    fclose(in);
+
+    return ret;
+}
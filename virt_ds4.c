@@ -1,4 +1,10 @@
 #include "virt_ds4.h"
+#include "report_scheduler.h"
+#include "latency.h"
+#include "rt_profile.h"
+#include "ring_log.h"
+#include "trace.h"
+#include "metrics.h"
 
 #include <bits/types/time_t.h>
 #include <linux/uhid.h>
@@ -294,12 +300,19 @@ static int uhid_write(int fd, const struct uhid_event *ev)
 {
 	ssize_t ret;
 
+#if defined(ROGUE_ENEMY_BENCH)
+	// virt_ds4_bench_send_data: only the report construction is measured
+	if (fd < 0) {
+		return 0;
+	}
+#endif
+
 	ret = write(fd, ev, sizeof(*ev));
 	if (ret < 0) {
-		fprintf(stderr, "Cannot write to uhid: %d\n", (int)ret);
+		RING_LOG(RING_LOG_ERROR, "Cannot write to uhid: %d\n", (int)ret);
 		return -errno;
 	} else if (ret != sizeof(*ev)) {
-		fprintf(stderr, "Wrong size written to uhid: %zd != %zu\n",
+		RING_LOG(RING_LOG_ERROR, "Wrong size written to uhid: %zd != %zu\n",
 			ret, sizeof(ev));
 		return -EFAULT;
 	} else {
@@ -375,14 +388,14 @@ static void handle_output(struct uhid_event *ev, logic_t *const logic)
     */
 	
 	if (ev->u.output.size != 32) {
-        fprintf(stderr, "Invalid data length: got %d, expected 32\n", (int)ev->u.output.size);
+        RING_LOG(RING_LOG_ERROR, "Invalid data length: got %d, expected 32\n", (int)ev->u.output.size);
 
         return;
     }
 
 	// first byte is report-id which is 0x01
 	if (ev->u.output.data[0] != 0x05) {
-        fprintf(stderr, "Unrecognised report-id: %d\n", (int)ev->u.output.data[0]);
+        RING_LOG(RING_LOG_ERROR, "Unrecognised report-id: %d\n", (int)ev->u.output.data[0]);
         return;
     }
 	
@@ -398,21 +411,11 @@ static void handle_output(struct uhid_event *ev, logic_t *const logic)
 	const uint8_t lightbar_blink_off = ev->u.output.data[10];
 
     if ((valid_flag0 & DS4_OUTPUT_VALID_FLAG0_MOTOR) && (logic->gamepad_output == LOGIC_FLAGS_VIRT_DS4_ENABLE)) {    
-        const int lock_res = pthread_mutex_lock(&logic->gamepad_mutex);
-        if (lock_res != 0) {
-            printf("Unable to lock gamepad mutex: %d, rumble will not be updated.\n", lock_res);
-
-            return;
-        }
-
-        logic->gamepad.motors_intensity[0] = motor_left;
-        logic->gamepad.motors_intensity[1] = motor_right;
-        ++logic->gamepad.rumble_events_count;
-
-        pthread_mutex_unlock(&logic->gamepad_mutex);
+        logic_request_rumble(logic, (uint16_t)motor_right << (uint16_t)8, (uint16_t)motor_left << (uint16_t)8);
 
 #if defined(VIRT_DS4_DEBUG)
-        printf(
+        RING_LOG(
+            RING_LOG_DEBUG,
             "Updated rumble -- motor_left: %d, motor_right: %d, valid_flag0; %d, valid_flag1: %d\n",
             motor_left,
             motor_right,
@@ -431,15 +434,15 @@ static int event(int fd, logic_t *const logic)
 	memset(&ev, 0, sizeof(ev));
 	ret = read(fd, &ev, sizeof(ev));
 	if (ret == 0) {
-		fprintf(stderr, "Read HUP on uhid-cdev\n");
+		RING_LOG(RING_LOG_ERROR, "Read HUP on uhid-cdev\n");
 		return -EFAULT;
 	} else if (ret == -1) {
         return 0;
     } else if (ret < 0) {
-		fprintf(stderr, "Cannot read uhid-cdev: %d\n", (int)ret);
+		RING_LOG(RING_LOG_ERROR, "Cannot read uhid-cdev: %d\n", (int)ret);
 		return -errno;
 	} else if (ret != sizeof(ev)) {
-		fprintf(stderr, "Invalid size read from uhid-dev: %zd != %zu\n",
+		RING_LOG(RING_LOG_ERROR, "Invalid size read from uhid-dev: %zd != %zu\n",
 			ret, sizeof(ev));
 		return -EFAULT;
 	}
@@ -447,33 +450,33 @@ static int event(int fd, logic_t *const logic)
 	switch (ev.type) {
 	case UHID_START:
 #if defined(VIRT_DS4_DEBUG)
-		printf("UHID_START from uhid-dev\n");
+		RING_LOG(RING_LOG_DEBUG, "UHID_START from uhid-dev\n");
 #endif
 		break;
 	case UHID_STOP:
 #if defined(VIRT_DS4_DEBUG)
-        printf("UHID_STOP from uhid-dev\n");
+        RING_LOG(RING_LOG_DEBUG, "UHID_STOP from uhid-dev\n");
 #endif
         break;
 	case UHID_OPEN:
 #if defined(VIRT_DS4_DEBUG)
-        printf("UHID_OPEN from uhid-dev\n");
+        RING_LOG(RING_LOG_DEBUG, "UHID_OPEN from uhid-dev\n");
 #endif
 		break;
 	case UHID_CLOSE:
 #if defined(VIRT_DS4_DEBUG)
-        printf(stderr, "UHID_CLOSE from uhid-dev\n");
+        RING_LOG(RING_LOG_DEBUG, "UHID_CLOSE from uhid-dev\n");
 #endif
 		break;
 	case UHID_OUTPUT:
 #if defined(VIRT_DS4_DEBUG)
-		printf("UHID_OUTPUT from uhid-dev\n");
+		RING_LOG(RING_LOG_DEBUG, "UHID_OUTPUT from uhid-dev\n");
 #endif
 		handle_output(&ev, logic);
 		break;
 	case UHID_OUTPUT_EV:
 #if defined(VIRT_DS4_DEBUG)
-		printf("UHID_OUTPUT_EV from uhid-dev\n");
+		RING_LOG(RING_LOG_DEBUG, "UHID_OUTPUT_EV from uhid-dev\n");
 #endif
 		break;
     case UHID_GET_REPORT:
@@ -564,7 +567,7 @@ static int event(int fd, logic_t *const logic)
 
 		break;
 	default:
-		fprintf(stderr, "Invalid event from uhid-dev: %u\n", ev.type);
+		RING_LOG(RING_LOG_ERROR, "Invalid event from uhid-dev: %u\n", ev.type);
 	}
 
 	return 0;
@@ -643,11 +646,11 @@ static ds4_dpad_status_t ds4_dpad_from_gamepad(uint8_t dpad) {
 /**
  * This function arranges HID packets as described on https://www.psdevwiki.com/ps4/DS4-USB
  */
-static int send_data(int fd, logic_t *const logic) {
+static int send_data(int fd, logic_t *const logic, int only_if_changed) {
     gamepad_status_t gs;
     const int gs_copy_res = logic_copy_gamepad_status(logic, &gs);
     if (gs_copy_res != 0) {
-        fprintf(stderr, "Unable to copy the gamepad status: %d\n", gs_copy_res);
+        RING_LOG(RING_LOG_ERROR, "Unable to copy the gamepad status: %d\n", gs_copy_res);
         return gs_copy_res;
     }
 
@@ -778,6 +781,16 @@ static int send_data(int fd, logic_t *const logic) {
     buf[35] = 0x80; // IDK... it seems constant...
     buf[44] = 0x80; // IDK... it seems constant...
 
+    // compare everything but the timestamp and sequence fields with the last report written
+    static uint8_t last_sent[sizeof(buf)];
+    uint8_t cmp[sizeof(buf)];
+    memcpy(cmp, buf, sizeof(buf));
+    cmp[10] = cmp[11] = 0x00;
+    if ((only_if_changed) && (memcmp(cmp, last_sent, sizeof(cmp)) == 0)) {
+        // nothing written: the caller counts these to slow its timer down
+        return 1;
+    }
+
     struct uhid_event l = {
         .type = UHID_INPUT2,
         .u = {
@@ -789,7 +802,32 @@ static int send_data(int fd, logic_t *const logic) {
 
     memcpy(&l.u.input2.data[0], &buf[0], l.u.input2.size);
 
-    return uhid_write(fd, &l);
+    const int res = uhid_write(fd, &l);
+    if (res == 0) {
+        // a report that failed to be written must not suppress the next one
+        memcpy(last_sent, cmp, sizeof(cmp));
+
+        trace_record(TRACE_EV_REPORT, LATENCY_OUTPUT_DS4, l.u.input2.size);
+        metrics_count_report(LATENCY_OUTPUT_DS4);
+
+        // account each input once: on the first report that carries it
+        static uint64_t last_input_read_ns = 0;
+        static uint64_t last_imu_read_ns = 0;
+
+        if (gs.last_input_read_ns != last_input_read_ns) {
+            latency_record_output(LATENCY_OUTPUT_DS4, LATENCY_INPUT_BUTTONS, gs.last_input_read_ns);
+            last_input_read_ns = gs.last_input_read_ns;
+        }
+
+        if (gs.last_imu_read_ns != last_imu_read_ns) {
+            latency_record_output(LATENCY_OUTPUT_DS4, LATENCY_INPUT_IMU, gs.last_imu_read_ns);
+            last_imu_read_ns = gs.last_imu_read_ns;
+        }
+    } else {
+        metrics_count_uhid_error(LATENCY_OUTPUT_DS4);
+    }
+
+    return res;
 }
 
 /**
@@ -800,7 +838,9 @@ static int send_data(int fd, logic_t *const logic) {
 void *virt_ds4_thread_func(void *ptr) {
     logic_t *const logic = (logic_t*)ptr;
 
-    
+    rt_thread_setup(&logic->controller_settings, RT_ROLE_REPORT);
+    trace_register_thread("DualShock");
+
     for (;;) {
         if (logic->gamepad_output != GAMEPAD_OUTPUT_DS4) {
             // sleep for 500ms before re-checking
@@ -812,6 +852,8 @@ void *virt_ds4_thread_func(void *ptr) {
         int fd = open(path, O_RDWR | O_CLOEXEC | O_NONBLOCK);
         if (fd < 0) {
             fprintf(stderr, "Cannot open uhid-cdev %s: %d\n", path, fd);
+            // retry later instead of spinning (uhid may be missing, i.e. when replaying an input log)
+            sleep(1);
             continue;
         }
 
@@ -822,18 +864,80 @@ void *virt_ds4_thread_func(void *ptr) {
             continue;
         }
 
+        report_scheduler_t sched;
+        const int sched_res = report_scheduler_init(&sched, logic->controller_settings.ds4_report_rate_hz);
+        if (sched_res != 0) {
+            fprintf(stderr, "Unable to create the report scheduler: %d\n", sched_res);
+            destroy(fd);
+            continue;
+        }
+
+        // in change-driven mode the timer only paces IMU updates and a periodic keepalive report
+        const int report_on_change = logic->controller_settings.report_on_change;
+        const uint64_t keepalive_ticks = (sched.rate_hz >= REPORT_KEEPALIVE_HZ) ? (sched.rate_hz / REPORT_KEEPALIVE_HZ) : 1;
+
+        // timer ticks in a row whose report was the same as the last one written
+        uint64_t unchanged_ticks = 0;
+        metrics_set_report_target(LATENCY_OUTPUT_DS4, sched.rate_hz);
+
         for (;;) {
-            usleep(1250);
-        
-            event(fd, logic);
+            // wake up on either the next report deadline, a request from the kernel (i.e. rumble) or a gamepad change
+            struct pollfd pfds[] = {
+                { .fd = fd, .events = POLLIN },
+                { .fd = report_scheduler_get_fd(&sched), .events = POLLIN },
+                { .fd = report_on_change ? logic->gamepad_update_fd : -1, .events = POLLIN },
+            };
+
+            const int poll_res = poll(pfds, sizeof(pfds) / sizeof(pfds[0]), -1);
+            if ((poll_res < 0) && (errno != EINTR)) {
+                RING_LOG(RING_LOG_ERROR, "Error polling the uhid device: %d\n", errno);
+            }
+
+            if (pfds[0].revents & POLLIN) {
+                event(fd, logic);
+            }
+
+            const int gamepad_changed = (pfds[2].revents & POLLIN) != 0;
+            if (gamepad_changed) {
+                logic_ack_gamepad_update(logic);
+            }
+
+            const int tick = (pfds[1].revents & POLLIN) != 0;
+            if (tick) {
+                const int missed = report_scheduler_ack(&sched);
+                if (missed > 0) {
+                    metrics_count_missed_deadlines(LATENCY_OUTPUT_DS4, (uint64_t)missed);
+                }
+            } else if (!gamepad_changed) {
+                continue;
+            }
 
             if (logic->gamepad_output == GAMEPAD_OUTPUT_DS4) {
-                const int res = send_data(fd, logic);
+                // timer ticks in change-driven mode only write reports that differ from the last one, except for the keepalive:
+                // while idle every tick is a keepalive
+                const int only_if_changed = report_on_change && !gamepad_changed && !sched.idle && ((sched.ticks % keepalive_ticks) != 0);
+                const int res = send_data(fd, logic, only_if_changed);
                 if (res < 0) {
-                    fprintf(stderr, "Error sending HID report: %d\n", res);
+                    RING_LOG(RING_LOG_ERROR, "Error sending HID report: %d\n", res);
+                }
+
+                // a keepalive period without changes slows the timer down to the keepalive rate, the next change restores it
+                if (gamepad_changed) {
+                    unchanged_ticks = 0;
+                    report_scheduler_set_idle(&sched, 0);
+                    logic_set_report_idle(logic, sched.idle);
+                } else if ((report_on_change) && (tick) && (!sched.idle)) {
+                    unchanged_ticks = (res == 1) ? unchanged_ticks + 1 : 0;
+                    if (unchanged_ticks >= keepalive_ticks) {
+                        report_scheduler_set_idle(&sched, 1);
+                        logic_set_report_idle(logic, sched.idle);
+                    }
                 }
             } else {
                 printf("DualShock has been terminated: closing the device.\n");
+                printf("%lu reports sent at %u Hz, %lu deadlines missed.\n", (unsigned long)sched.ticks, sched.rate_hz, (unsigned long)sched.missed_deadlines);
+                report_scheduler_destroy(&sched);
+                logic_set_report_idle(logic, 0);
                 goto virt_ds4_thread_func_reset;
             }
         }
@@ -844,3 +948,9 @@ void *virt_ds4_thread_func(void *ptr) {
     
     return NULL;
 }
+
+#if defined(ROGUE_ENEMY_BENCH)
+int virt_ds4_bench_send_data(logic_t *const logic) {
+    return send_data(-1, logic, 0);
+}
+#endif
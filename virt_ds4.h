@@ -5,3 +5,10 @@
 #undef VIRT_DS4_DEBUG
 
 void *virt_ds4_thread_func(void *ptr);
+
+#if defined(ROGUE_ENEMY_BENCH)
+/**
+ * Build and account one report from the current gamepad status as the report thread does, without a uhid device.
+ */
+int virt_ds4_bench_send_data(logic_t *const logic);
+#endif
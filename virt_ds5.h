@@ -5,3 +5,10 @@
 #undef VIRT_DS5_DEBUG
 
 void *virt_ds5_thread_func(void *ptr);
+
+#if defined(ROGUE_ENEMY_BENCH)
+/**
+ * Build and account one report from the current gamepad status as the report thread does, without a uhid device.
+ */
+int virt_ds5_bench_send_data(logic_t *const logic);
+#endif